@@ -0,0 +1,208 @@
+/**
+ * Benchmark suite of ffmpeg-core under Node.js.
+ *
+ * Run scenarios and save results as JSON:
+ *
+ *     node bench/index.js run [--core ./packages/core] [--repeat 3]
+ *                             [--filter h264] [--output results.json]
+ *
+ * Compare two results, exit with 1 when any metric regresses more than
+ * threshold (in percent):
+ *
+ *     node bench/index.js compare base.json head.json [--threshold 5]
+ */
+const fs = require("fs");
+const path = require("path");
+const { performance } = require("perf_hooks");
+const { INPUTS, SCENARIOS } = require("./scenarios");
+
+const DEFAULT_CORE = "./packages/core";
+const DEFAULT_REPEAT = 3;
+const DEFAULT_THRESHOLD = 5;
+
+/**
+ * Metrics recorded for each scenario, `better` tells which direction is an
+ * improvement.
+ */
+const METRICS = {
+  wallTime: { unit: "ms", better: "lower" },
+  timeToFirstOutput: { unit: "ms", better: "lower" },
+  fps: { unit: "fps", better: "higher" },
+  peakHeap: { unit: "bytes", better: "lower" },
+};
+
+const log = (...args) => console.error(...args);
+
+const parseArgs = (argv) => {
+  const opts = { _: [] };
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i].startsWith("--")) opts[argv[i].slice(2)] = argv[++i];
+    else opts._.push(argv[i]);
+  }
+  return opts;
+};
+
+const median = (values) => {
+  const sorted = [...values].sort((a, b) => a - b);
+  const mid = sorted.length >> 1;
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+};
+
+const exec = (core, args) => {
+  core.reset();
+  const ret = core.exec(...args);
+  if (ret !== 0) throw new Error(`ffmpeg ${args.join(" ")} exited with ${ret}`);
+};
+
+/**
+ * Generates all inputs once, they are copied into a fresh core for each run.
+ */
+const generateInputs = async (createFFmpegCore, names) => {
+  const core = await createFFmpegCore();
+  const inputs = {};
+  for (const name of names) {
+    log(`generating ${name}`);
+    exec(core, [...INPUTS[name], name]);
+    inputs[name] = core.FS.readFile(name);
+  }
+  return inputs;
+};
+
+/**
+ * Runs one scenario in a fresh core, so peak wasm heap isn't affected by
+ * previous runs as wasm memory never shrinks.
+ */
+const runOnce = async (createFFmpegCore, inputs, { input, args, output }) => {
+  const core = await createFFmpegCore();
+  core.FS.writeFile(input, inputs[input]);
+
+  let frames = 0;
+  core.setLogger(({ message }) => {
+    const match = message.match(/frame=\s*(\d+)/);
+    if (match) frames = parseInt(match[1], 10);
+  });
+
+  // Output is considered started at the first write to any file other than
+  // the input and the standard streams.
+  let firstOutput = -1;
+  const write = core.FS.write;
+  core.FS.write = function (stream, ...rest) {
+    if (
+      firstOutput < 0 &&
+      !stream.path.startsWith("/dev/") &&
+      !stream.path.endsWith(input)
+    )
+      firstOutput = performance.now();
+    return write.call(this, stream, ...rest);
+  };
+
+  const start = performance.now();
+  exec(core, ["-i", input, ...args, output]);
+  const wallTime = performance.now() - start;
+  core.FS.write = write;
+
+  return {
+    wallTime,
+    timeToFirstOutput: firstOutput < 0 ? null : firstOutput - start,
+    fps: frames ? frames / (wallTime / 1000) : null,
+    peakHeap: core.HEAPU8 ? core.HEAPU8.buffer.byteLength : null,
+  };
+};
+
+const run = async (opts) => {
+  const corePath = path.resolve(opts.core || DEFAULT_CORE);
+  const repeat = parseInt(opts.repeat || DEFAULT_REPEAT, 10);
+  const scenarios = SCENARIOS.filter(
+    ({ name }) => !opts.filter || name.includes(opts.filter)
+  );
+  const createFFmpegCore = require(corePath);
+  const inputs = await generateInputs(createFFmpegCore, [
+    ...new Set(scenarios.map(({ input }) => input)),
+  ]);
+
+  const results = {};
+  for (const scenario of scenarios) {
+    const runs = [];
+    for (let i = 0; i < repeat; i++) {
+      runs.push(await runOnce(createFFmpegCore, inputs, scenario));
+    }
+    results[scenario.name] = Object.fromEntries(
+      Object.keys(METRICS).map((key) => {
+        const values = runs.map((r) => r[key]).filter((v) => v !== null);
+        return [key, values.length ? median(values) : null];
+      })
+    );
+    const { wallTime, fps } = results[scenario.name];
+    log(
+      `${scenario.name}: ${wallTime.toFixed(1)} ms` +
+        (fps ? `, ${fps.toFixed(1)} fps` : "")
+    );
+  }
+
+  const report = JSON.stringify(
+    {
+      core: corePath,
+      date: new Date().toISOString(),
+      node: process.version,
+      repeat,
+      results,
+    },
+    null,
+    2
+  );
+  if (opts.output) fs.writeFileSync(opts.output, report);
+  else console.log(report);
+};
+
+const compare = (opts) => {
+  const [basePath, headPath] = opts._;
+  if (!basePath || !headPath) {
+    log("usage: node bench/index.js compare <BASE_JSON> <HEAD_JSON>");
+    process.exit(1);
+  }
+  const threshold = parseFloat(opts.threshold || DEFAULT_THRESHOLD);
+  const base = JSON.parse(fs.readFileSync(basePath)).results;
+  const head = JSON.parse(fs.readFileSync(headPath)).results;
+
+  const regressions = [];
+  for (const [name, metrics] of Object.entries(head)) {
+    if (!base[name]) continue;
+    for (const [key, { unit, better }] of Object.entries(METRICS)) {
+      const before = base[name][key];
+      const after = metrics[key];
+      if (!before || after === null || after === undefined) continue;
+      // Positive change is always an improvement.
+      const change =
+        ((better === "lower" ? before - after : after - before) / before) * 100;
+      const regressed = change < -threshold;
+      if (regressed) regressions.push(`${name}.${key}`);
+      console.log(
+        `${regressed ? "✗" : "✓"} ${name}.${key}: ` +
+          `${before.toFixed(1)} -> ${after.toFixed(1)} ${unit} ` +
+          `(${change >= 0 ? "+" : ""}${change.toFixed(1)}%)`
+      );
+    }
+  }
+
+  if (regressions.length) {
+    console.log(
+      `${regressions.length} regression(s) over ${threshold}%: ` +
+        regressions.join(", ")
+    );
+    process.exit(1);
+  }
+};
+
+const main = async () => {
+  const [command, ...argv] = process.argv.slice(2);
+  const opts = parseArgs(argv);
+  if (command === "run") await run(opts);
+  else if (command === "compare") compare(opts);
+  else {
+    log("usage: node bench/index.js <run|compare> [options]");
+    process.exit(1);
+  }
+  process.exit(0);
+};
+
+main();
@@ -0,0 +1,109 @@
+/**
+ * Inputs are generated with lavfi testsrc2 / sine sources by the core under
+ * test, so the suite doesn't require any asset and is reproducible.
+ */
+const INPUTS = {
+  "360p-10s.mp4": [
+    "-f", "lavfi", "-i", "testsrc2=size=640x360:rate=30:duration=10",
+    "-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000:duration=10",
+    "-c:v", "libx264", "-preset", "veryfast", "-g", "60",
+    "-c:a", "aac", "-shortest",
+  ],
+  "720p-10s.mp4": [
+    "-f", "lavfi", "-i", "testsrc2=size=1280x720:rate=30:duration=10",
+    "-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000:duration=10",
+    "-c:v", "libx264", "-preset", "veryfast", "-g", "60",
+    "-c:a", "aac", "-shortest",
+  ],
+  "1080p-5s.mp4": [
+    "-f", "lavfi", "-i", "testsrc2=size=1920x1080:rate=30:duration=5",
+    "-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000:duration=5",
+    "-c:v", "libx264", "-preset", "veryfast", "-g", "60",
+    "-c:a", "aac", "-shortest",
+  ],
+  "audio-60s.wav": [
+    "-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000:duration=60",
+    "-ac", "2",
+  ],
+};
+
+/**
+ * Each scenario runs `ffmpeg -i <input> ...args <output>`, output is the
+ * file whose first write is used as time-to-first-output.
+ */
+const SCENARIOS = [
+  ...["360p-10s.mp4", "720p-10s.mp4", "1080p-5s.mp4"].map((input) => ({
+    name: `h264-h264-${input.split("-")[0]}`,
+    input,
+    args: ["-c:v", "libx264", "-preset", "veryfast", "-c:a", "copy"],
+    output: "output.mp4",
+  })),
+  {
+    name: "h264-vp9-360p",
+    input: "360p-10s.mp4",
+    args: [
+      "-c:v", "libvpx-vp9", "-deadline", "realtime", "-cpu-used", "8",
+      "-c:a", "libopus",
+    ],
+    output: "output.webm",
+  },
+  {
+    name: "remux-mp4-mkv-720p",
+    input: "720p-10s.mp4",
+    args: ["-c", "copy"],
+    output: "output.mkv",
+  },
+  {
+    name: "remux-mp4-ts-1080p",
+    input: "1080p-5s.mp4",
+    args: ["-c", "copy", "-f", "mpegts"],
+    output: "output.ts",
+  },
+  {
+    name: "thumbnails-720p",
+    input: "720p-10s.mp4",
+    args: ["-vf", "fps=1,scale=320:-2", "-frames:v", "10"],
+    output: "thumbnail-%03d.jpg",
+  },
+  {
+    name: "audio-opus",
+    input: "audio-60s.wav",
+    args: ["-c:a", "libopus", "-b:a", "96k"],
+    output: "output.opus",
+  },
+  {
+    name: "audio-mp3",
+    input: "audio-60s.wav",
+    args: ["-c:a", "libmp3lame", "-b:a", "128k"],
+    output: "output.mp3",
+  },
+  {
+    // 64 output streams, each step mostly costs choosing the next output.
+    // The input is opened twice, as a single input copied to every output
+    // takes the remux path, which never chooses an output.
+    name: "outputs-64",
+    input: "audio-60s.wav",
+    args: ["-i", "audio-60s.wav"]
+      .concat([...Array(32)].flatMap(() => ["-map", "0:a", "-map", "1:a"]))
+      .concat(["-c", "copy"]),
+    output: "output.mkv",
+  },
+  // A remux next to an encode, with the remux muxed in its own thread or in
+  // the main thread. The writes to MEMFS stay on the main thread either way,
+  // the difference is the time the muxer itself takes off the main loop.
+  ...[32, 0].map((size) => ({
+    name: `mux-thread-${size ? "on" : "off"}-720p`,
+    input: "720p-10s.mp4",
+    args: [
+      "-mux_thread_queue_size", `${size}`, "-c", "copy", "-f", "matroska", "copy.mkv",
+      "-mux_thread_queue_size", `${size}`,
+      "-c:v", "libx264", "-preset", "ultrafast", "-c:a", "copy",
+    ],
+    output: "output.mp4",
+  })),
+];
+
+module.exports = {
+  INPUTS,
+  SCENARIOS,
+};
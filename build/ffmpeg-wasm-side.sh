@@ -0,0 +1,33 @@
+#!/bin/bash
+# Build heavy external libraries as side modules, which are loaded by
+# ffmpeg-core.wasm on demand. `<OUTPUT_PREFIX>`, the path of the core without
+# extension, must be provided when using this build script.
+# ex:
+#     bash ffmpeg-wasm-side.sh dist/umd/ffmpeg-core
+
+set -euo pipefail
+
+OUTPUT_PREFIX=$1
+
+CONF_FLAGS=(
+  -L$INSTALL_DIR/lib
+  $LDFLAGS
+  -sSIDE_MODULE=1                          # export all symbols to ffmpeg-core.wasm
+  -sWASM_BIGINT                            # keep the same ABI as ffmpeg-core.wasm
+)
+
+# build_side_module <NAME> <LIBS...>
+# Links all objects of the given libraries into <OUTPUT_PREFIX>-<NAME>.wasm, as
+# nothing in the side module itself references them.
+build_side_module() {
+  local name=$1
+  shift
+  emcc "${CONF_FLAGS[@]}" \
+    -Wl,--whole-archive $@ -Wl,--no-whole-archive \
+    -o $OUTPUT_PREFIX-$name.wasm
+}
+
+build_side_module x265 -lx265
+build_side_module vpx -lvpx
+build_side_module ass -lass -lharfbuzz -lfribidi -lfreetype
+build_side_module zimg -lzimg
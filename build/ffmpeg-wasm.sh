@@ -5,6 +5,8 @@
 
 set -euo pipefail
 
+source $(dirname $0)/pgo/flags.sh
+
 EXPORT_NAME="createFFmpegCore"
 
 CONF_FLAGS=(
@@ -17,7 +19,6 @@ CONF_FLAGS=(
   -Llibavfilter 
   -Llibavformat 
   -Llibavutil 
-  -Llibpostproc 
   -Llibswresample 
   -Llibswscale 
   -lavcodec 
@@ -25,17 +26,19 @@ CONF_FLAGS=(
   -lavfilter 
   -lavformat 
   -lavutil 
-  -lpostproc 
   -lswresample 
   -lswscale 
   -Wno-deprecated-declarations 
   $LDFLAGS 
+  $PGO_FLAGS                               # profile-guided optimization, see pgo/flags.sh
   -sWASM_BIGINT                            # enable big int support
   -sUSE_SDL=2                              # use emscripten SDL2 lib port
   -sMODULARIZE                             # modularized to use as a library
   ${FFMPEG_MT:+ -sINITIAL_MEMORY=1024MB}   # ALLOW_MEMORY_GROWTH is not recommended when using threads, thus we use a large initial memory
   ${FFMPEG_MT:+ -sPTHREAD_POOL_SIZE=32}    # use 32 threads
   ${FFMPEG_ST:+ -sINITIAL_MEMORY=32MB -sALLOW_MEMORY_GROWTH} # Use just enough memory as memory usage can grow
+  ${FFMPEG_MODULAR:+ -sMAIN_MODULE=1}      # load heavy libraries as side modules, see ffmpeg-wasm-side.sh
+  ${FFMPEG_MODULAR:+ -sERROR_ON_UNDEFINED_SYMBOLS=0} # symbols of side modules are resolved when they are loaded
   -sEXPORT_NAME="$EXPORT_NAME"             # required in browser env, so that user can access this module from window object
   -sEXPORTED_FUNCTIONS=$(node src/bind/ffmpeg/export.js) # exported functions
   -sEXPORTED_RUNTIME_METHODS=$(node src/bind/ffmpeg/export-runtime.js) # exported built-in functions
@@ -43,12 +46,32 @@ CONF_FLAGS=(
   --pre-js src/bind/ffmpeg/bind.js        # extra bindings, contains most of the ffmpeg.wasm javascript code
   # ffmpeg source code
   src/fftools/cmdutils.c 
+  src/fftools/decode_audio.c 
   src/fftools/ffmpeg.c 
   src/fftools/ffmpeg_filter.c 
   src/fftools/ffmpeg_hw.c 
   src/fftools/ffmpeg_mux.c 
   src/fftools/ffmpeg_opt.c 
+  src/fftools/ffmpeg_sched.c 
+  src/fftools/ffmpeg_seekindex.c 
+  src/fftools/ffmpeg_smartcut.c 
+  src/fftools/ffmpeg_trace.c 
+  src/fftools/ffprobe.c 
+  src/fftools/thumbnails.c 
   src/fftools/opt_common.c 
 )
 
+# libraries to link, a profile links only the libraries it enables
+if [[ -n "${FFMPEG_PROFILE:-}" ]]; then
+  source $(dirname $0)/profiles/$FFMPEG_PROFILE.sh
+  CONF_FLAGS+=($PROFILE_LIBS)
+else
+  # libpostproc is only built with --enable-gpl, which profiles do not use
+  CONF_FLAGS+=(-Llibpostproc -lpostproc ${FFMPEG_LIBS:-})
+  # link heavy libraries statically when side modules are not built
+  if [[ -z "${FFMPEG_MODULAR:-}" ]]; then
+    CONF_FLAGS+=(${FFMPEG_SIDE_LIBS:-})
+  fi
+fi
+
 emcc "${CONF_FLAGS[@]}" $@
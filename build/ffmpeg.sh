@@ -2,6 +2,8 @@
 
 set -euo pipefail
 
+source $(dirname $0)/pgo/flags.sh
+
 CONF_FLAGS=(
   --target-os=none              # disable target specific configs
   --arch=x86_32                 # use x86_32 arch
@@ -22,12 +24,20 @@ CONF_FLAGS=(
   --cxx=em++
   --objcc=emcc
   --dep-cc=emcc
-  --extra-cflags="$CFLAGS"
-  --extra-cxxflags="$CXXFLAGS"
+  --extra-cflags="$CFLAGS $PGO_FLAGS"
+  --extra-cxxflags="$CXXFLAGS $PGO_FLAGS"
+  ${PGO_FLAGS:+ --extra-ldflags="$PGO_FLAGS"}
 
   # disable thread when FFMPEG_ST is NOT defined
   ${FFMPEG_ST:+ --disable-pthreads --disable-w32threads --disable-os2threads}
 )
 
+# FFMPEG_PROFILE replaces the configure flags passed to this script with the
+# explicit component list of a slim purpose-built core, see profiles/.
+if [[ -n "${FFMPEG_PROFILE:-}" ]]; then
+  source $(dirname $0)/profiles/$FFMPEG_PROFILE.sh
+  set -- "${PROFILE_CONF_FLAGS[@]}"
+fi
+
 emconfigure ./configure "${CONF_FLAGS[@]}" $@
 emmake make -j
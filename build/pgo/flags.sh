@@ -0,0 +1,19 @@
+# Profile-guided optimization flags of FFmpeg and ffmpeg.wasm, selected by
+# FFMPEG_PGO, see `make prd-pgo`.
+#
+# - generate: instrument the code to collect a profile
+# - use: optimize the code with the profile collected in ffmpeg.profdata
+
+PGO_PROFILE=$(cd $(dirname ${BASH_SOURCE[0]}) && pwd)/ffmpeg.profdata
+
+case "${FFMPEG_PGO:-}" in
+  generate)
+    PGO_FLAGS="-fprofile-instr-generate"
+    ;;
+  use)
+    PGO_FLAGS="-fprofile-instr-use=$PGO_PROFILE -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date"
+    ;;
+  *)
+    PGO_FLAGS=""
+    ;;
+esac
@@ -0,0 +1,19 @@
+# Audio only: decode common audio formats (including the audio track of
+# mp4/webm videos), encode to mp3, opus, vorbis, aac, flac and wav, or
+# decode to float PCM for JS with decodeAudio().
+
+PROFILE_CONF_FLAGS=(
+  --disable-everything
+  --enable-protocol=file
+  --enable-demuxer=mov,matroska,ogg,mp3,wav,flac,aac
+  --enable-decoder=aac,mp3,mp3float,opus,vorbis,flac,alac,pcm_s16le,pcm_s24le,pcm_f32le
+  --enable-encoder=aac,libmp3lame,libopus,libvorbis,flac,pcm_s16le,pcm_f32le
+  --enable-muxer=mp3,ogg,opus,wav,ipod,mp4,adts,flac,webm,f32le,s16le,null
+  --enable-parser=aac,mpegaudio,opus,vorbis,flac
+  --enable-filter=abuffer,abuffersink,anull,aformat,aresample,atrim,apad,pan,volume,afade,amix,loudnorm
+  --enable-libmp3lame
+  --enable-libvorbis
+  --enable-libopus
+)
+
+PROFILE_LIBS="-lmp3lame -logg -lvorbis -lvorbisenc -lvorbisfile -lopus"
@@ -0,0 +1,15 @@
+# Remux: change container or trim with `-c copy`, no decoder or encoder is
+# included.
+
+PROFILE_CONF_FLAGS=(
+  --disable-everything
+  --enable-protocol=file
+  --enable-demuxer=mov,matroska,mpegts,flv,avi,mp3,aac,ogg,wav,h264,hevc
+  --enable-muxer=mp4,mov,ipod,matroska,webm,mpegts,flv,hls,segment,mp3,adts,ogg
+  --enable-parser=h264,hevc,aac,mpegaudio,opus,vorbis,vp8,vp9,av1
+  --enable-bsf=aac_adtstoasc,h264_mp4toannexb,hevc_mp4toannexb,extract_extradata,vp9_superframe,null
+  --enable-filter=buffer,buffersink,abuffer,abuffersink,null,anull
+  --enable-zlib
+)
+
+PROFILE_LIBS="-lz"
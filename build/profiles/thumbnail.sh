@@ -0,0 +1,17 @@
+# Thumbnail: decode common video codecs, grab frames and encode them as
+# jpeg, png or webp images, or send them to JS with -js_frames.
+
+PROFILE_CONF_FLAGS=(
+  --disable-everything
+  --enable-protocol=file
+  --enable-demuxer=mov,matroska,mpegts,avi,flv,image2
+  --enable-decoder=h264,hevc,vp8,vp9,mpeg4,mpeg2video,mjpeg,png
+  --enable-encoder=mjpeg,png,libwebp,wrapped_avframe
+  --enable-muxer=image2,image2pipe,mjpeg,webp,null
+  --enable-parser=h264,hevc,vp8,vp9,mpeg4video,mpegvideo
+  --enable-filter=buffer,buffersink,null,format,scale,trim,setpts,fps,select,thumbnail,tile,crop,pad,transpose,hflip,vflip
+  --enable-zlib
+  --enable-libwebp
+)
+
+PROFILE_LIBS="-lz -lwebpmux -lwebp -lsharpyuv"
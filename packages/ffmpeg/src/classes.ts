@@ -1,4 +1,11 @@
-import { FFMessageType } from "./const.js";
+import {
+  FFMessageType,
+  TRACE_FILE,
+  INPUT_HEADER_SIZE,
+  INPUT_QUEUE_SIZE,
+  INPUT_WAIT_TIMEOUT,
+  InputState,
+} from "./const.js";
 import {
   CallbackData,
   Callbacks,
@@ -10,20 +17,110 @@ import {
   LogEvent,
   Message,
   ProgressEvent,
+  StatsEvent,
+  FrameEvent,
+  AudioEvent,
   LogEventCallback,
   ProgressEventCallback,
+  StatsEventCallback,
+  FrameEventCallback,
+  AudioEventCallback,
   FileData,
   FFFSType,
   FFFSMountOptions,
   FFFSPath,
+  TraceResult,
+  ChromeTrace,
+  ProbeResult,
+  DecodedAudio,
 } from "./types.js";
-import { getMessageID } from "./utils.js";
-import { ERROR_TERMINATED, ERROR_NOT_LOADED } from "./errors.js";
+import { getMessageID, getTransferables } from "./utils.js";
+import {
+  ERROR_TERMINATED,
+  ERROR_NOT_LOADED,
+  ERROR_NO_SHARED_ARRAY_BUFFER,
+  ERROR_INPUT_ENDED,
+} from "./errors.js";
 
 type FFMessageOptions = {
   signal?: AbortSignal;
 };
 
+type AtomicsWaitAsync = (
+  typedArray: Int32Array,
+  index: number,
+  value: number,
+  timeout?: number
+) => { async: boolean; value: Promise<string> | string };
+
+/**
+ * Writer of an input created by `FFmpeg.createInput()`, data is copied into
+ * a ring buffer shared with the worker, so memory stays constant however
+ * long the input is.
+ */
+export class FFmpegInput {
+  #state: Int32Array;
+  #data: Uint8Array;
+
+  constructor(buffer: SharedArrayBuffer) {
+    this.#state = new Int32Array(buffer, 0, INPUT_HEADER_SIZE / 4);
+    this.#data = new Uint8Array(buffer, INPUT_HEADER_SIZE);
+  }
+
+  /**
+   * Resolves when used (number of bytes in the ring buffer) changes, or
+   * after INPUT_WAIT_TIMEOUT when Atomics.waitAsync is not supported.
+   */
+  #wait = async (used: number) => {
+    const waitAsync = (Atomics as unknown as { waitAsync?: AtomicsWaitAsync })
+      .waitAsync;
+    if (waitAsync) {
+      await waitAsync(this.#state, InputState.USED, used, INPUT_WAIT_TIMEOUT)
+        .value;
+    } else {
+      await new Promise((resolve) => setTimeout(resolve, INPUT_WAIT_TIMEOUT));
+    }
+  };
+
+  /**
+   * Write data (ex. a raw frame or a PCM chunk), the returned Promise
+   * resolves once all data is in the ring buffer, so awaiting it keeps the
+   * producer at the pace of ffmpeg. It rejects when ffmpeg stops reading the
+   * input (end of file or end of exec), as remaining data would never be read.
+   */
+  public write = async (data: ArrayBufferView): Promise<void> => {
+    const bytes = new Uint8Array(data.buffer, data.byteOffset, data.byteLength);
+    const capacity = this.#data.length;
+    let offset = 0;
+
+    while (offset < bytes.length) {
+      if (Atomics.load(this.#state, InputState.ENDED)) throw ERROR_INPUT_ENDED;
+      const used = Atomics.load(this.#state, InputState.USED);
+      if (used === capacity) {
+        await this.#wait(used);
+        continue;
+      }
+      const size = Math.min(capacity - used, bytes.length - offset);
+      const write = this.#state[InputState.WRITE];
+      const first = Math.min(size, capacity - write);
+      this.#data.set(bytes.subarray(offset, offset + first), write);
+      this.#data.set(bytes.subarray(offset + first, offset + size), 0);
+      this.#state[InputState.WRITE] = (write + size) % capacity;
+      Atomics.add(this.#state, InputState.USED, size);
+      Atomics.notify(this.#state, InputState.USED);
+      offset += size;
+    }
+  };
+
+  /**
+   * End the input, ffmpeg reaches the end of file once remaining data is read.
+   */
+  public close = (): void => {
+    Atomics.store(this.#state, InputState.CLOSED, 1);
+    Atomics.notify(this.#state, InputState.USED);
+  };
+}
+
 /**
  * Provides APIs to interact with ffmpeg web worker.
  *
@@ -43,6 +140,19 @@ export class FFmpeg {
 
   #logEventCallbacks: LogEventCallback[] = [];
   #progressEventCallbacks: ProgressEventCallback[] = [];
+  #statsEventCallbacks: StatsEventCallback[] = [];
+  #frameEventCallbacks: FrameEventCallback[] = [];
+  #audioEventCallbacks: AudioEventCallback[] = [];
+  /**
+   * Frames posted by the worker and not yet handled, the worker waits when
+   * FRAME_QUEUE_DEPTH is reached. Requires SharedArrayBuffer, frames are
+   * not bounded otherwise.
+   */
+  #frameQueue: Int32Array | null =
+    typeof SharedArrayBuffer !== "undefined" && globalThis.crossOriginIsolated
+      ? new Int32Array(new SharedArrayBuffer(Int32Array.BYTES_PER_ELEMENT))
+      : null;
+  #frames: Promise<void> = Promise.resolve();
 
   public loaded = false;
 
@@ -62,6 +172,10 @@ export class FFmpeg {
           case FFMessageType.MOUNT:
           case FFMessageType.UNMOUNT:
           case FFMessageType.EXEC:
+          case FFMessageType.FFPROBE:
+          case FFMessageType.THUMBNAILS:
+          case FFMessageType.CREATE_INPUT:
+          case FFMessageType.DECODE_AUDIO:
           case FFMessageType.WRITE_FILE:
           case FFMessageType.READ_FILE:
           case FFMessageType.DELETE_FILE:
@@ -79,6 +193,15 @@ export class FFmpeg {
               f(data as ProgressEvent)
             );
             break;
+          case FFMessageType.STATS:
+            this.#statsEventCallbacks.forEach((f) => f(data as StatsEvent));
+            break;
+          case FFMessageType.FRAME:
+            this.#handleFrame(data as FrameEvent);
+            break;
+          case FFMessageType.AUDIO:
+            this.#audioEventCallbacks.forEach((f) => f(data as AudioEvent));
+            break;
           case FFMessageType.ERROR:
             this.#rejects[id](data);
             break;
@@ -89,6 +212,24 @@ export class FFmpeg {
     }
   };
 
+  /**
+   * Frames are handled one after another in order, a frame leaves the frame
+   * queue once all callbacks (and the promises they return) are done.
+   */
+  #handleFrame = (frame: FrameEvent) => {
+    const release = () => {
+      if (this.#frameQueue) {
+        Atomics.sub(this.#frameQueue, 0, 1);
+        Atomics.notify(this.#frameQueue, 0);
+      }
+    };
+    this.#frames = this.#frames
+      .then(() =>
+        Promise.all(this.#frameEventCallbacks.map((f) => f(frame)))
+      )
+      .then(release, release);
+  };
+
   /**
    * Generic function to send messages to web worker.
    */
@@ -118,7 +259,7 @@ export class FFmpeg {
   };
 
   /**
-   * Listen to log or prgress events from `ffmpeg.exec()`.
+   * Listen to log, prgress, stats, frame or audio events.
    *
    * @example
    * ```ts
@@ -134,6 +275,31 @@ export class FFmpeg {
    * })
    * ```
    *
+   * @example
+   * ```ts
+   * // ffmpeg -i video.mp4 -vf scale=224:224 -pix_fmt rgb24 -js_frames -
+   * ffmpeg.on("frame", async ({ planes: [rgb], width, height, time }) => {
+   *   // ffmpeg waits while a few frames are being handled
+   *   await model.run(rgb, width, height);
+   * })
+   * ```
+   *
+   * @example
+   * ```ts
+   * // ffmpeg.decodeAudio([...], { stream: true })
+   * ffmpeg.on("audio", ({ data: [pcm], time }) => {
+   *   // ...
+   * })
+   * ```
+   *
+   * @example
+   * ```ts
+   * ffmpeg.on("stats", ({ type, stats }) => {
+   *   // type === "stages": time spent in demux, decode, filter, encode
+   *   // and mux of each stream, updated along with progress.
+   * })
+   * ```
+   *
    * @remarks
    * - log includes output to stdout and stderr.
    * - The progress events are accurate only when the length of
@@ -143,27 +309,49 @@ export class FFmpeg {
    */
   public on(event: "log", callback: LogEventCallback): void;
   public on(event: "progress", callback: ProgressEventCallback): void;
+  public on(event: "stats", callback: StatsEventCallback): void;
+  public on(event: "frame", callback: FrameEventCallback): void;
+  public on(event: "audio", callback: AudioEventCallback): void;
   public on(
-    event: "log" | "progress",
-    callback: LogEventCallback | ProgressEventCallback
+    event: "log" | "progress" | "stats" | "frame" | "audio",
+    callback:
+      | LogEventCallback
+      | ProgressEventCallback
+      | StatsEventCallback
+      | FrameEventCallback
+      | AudioEventCallback
   ) {
     if (event === "log") {
       this.#logEventCallbacks.push(callback as LogEventCallback);
     } else if (event === "progress") {
       this.#progressEventCallbacks.push(callback as ProgressEventCallback);
+    } else if (event === "stats") {
+      this.#statsEventCallbacks.push(callback as StatsEventCallback);
+    } else if (event === "frame") {
+      this.#frameEventCallbacks.push(callback as FrameEventCallback);
+    } else if (event === "audio") {
+      this.#audioEventCallbacks.push(callback as AudioEventCallback);
     }
   }
 
   /**
-   * Unlisten to log or prgress events from `ffmpeg.exec()`.
+   * Unlisten to log, prgress or stats events from `ffmpeg.exec()`.
    *
    * @category FFmpeg
    */
   public off(event: "log", callback: LogEventCallback): void;
   public off(event: "progress", callback: ProgressEventCallback): void;
+  public off(event: "stats", callback: StatsEventCallback): void;
+  public off(event: "frame", callback: FrameEventCallback): void;
+  public off(event: "audio", callback: AudioEventCallback): void;
   public off(
-    event: "log" | "progress",
-    callback: LogEventCallback | ProgressEventCallback
+    event: "log" | "progress" | "stats" | "frame" | "audio",
+    callback:
+      | LogEventCallback
+      | ProgressEventCallback
+      | StatsEventCallback
+      | FrameEventCallback
+      | AudioEventCallback
   ) {
     if (event === "log") {
       this.#logEventCallbacks = this.#logEventCallbacks.filter(
@@ -173,6 +361,18 @@ export class FFmpeg {
       this.#progressEventCallbacks = this.#progressEventCallbacks.filter(
         (f) => f !== callback
       );
+    } else if (event === "stats") {
+      this.#statsEventCallbacks = this.#statsEventCallbacks.filter(
+        (f) => f !== callback
+      );
+    } else if (event === "frame") {
+      this.#frameEventCallbacks = this.#frameEventCallbacks.filter(
+        (f) => f !== callback
+      );
+    } else if (event === "audio") {
+      this.#audioEventCallbacks = this.#audioEventCallbacks.filter(
+        (f) => f !== callback
+      );
     }
   }
 
@@ -243,12 +443,190 @@ export class FFmpeg {
     this.#send(
       {
         type: FFMessageType.EXEC,
-        data: { args, timeout },
+        data: { args, timeout, frameQueue: this.#frameQueue },
+      },
+      undefined,
+      signal
+    ) as Promise<number>;
+
+  /**
+   * Execute ffprobe command in the same core, output is JSON by default.
+   * Several input files are probed in one call, one output per file.
+   *
+   * @example
+   * ```ts
+   * const { outputs } = await ffmpeg.ffprobe([
+   *   "-show_format", "-show_streams", "a.mp4", "b.webm",
+   * ]);
+   * const [a, b] = outputs.map((output) => JSON.parse(output));
+   * ```
+   *
+   * @category FFmpeg
+   */
+  public ffprobe = (
+    /** ffprobe command line args */
+    args: string[],
+    { signal }: FFMessageOptions = {}
+  ): Promise<ProbeResult> =>
+    this.#send(
+      {
+        type: FFMessageType.FFPROBE,
+        data: { args },
+      },
+      undefined,
+      signal
+    ) as Promise<ProbeResult>;
+
+  /**
+   * Extract thumbnails at several timestamps of one input in a single run,
+   * far faster than one exec per thumbnail as the input is opened once and
+   * only keyframes are decoded (the last keyframe before each timestamp).
+   * Pass `-accurate` to extract the frame shown at each timestamp, and
+   * `-sprite COLSxROWS` to tile thumbnails in sprite sheets.
+   *
+   * @example
+   * ```ts
+   * await ffmpeg.thumbnails([
+   *   "-i", "video.mp4", "-ts", "1,30,60", "-width", "320", "thumb-%d.jpg",
+   * ]);
+   * const thumb = await ffmpeg.readFile("thumb-1.jpg");
+   * ```
+   *
+   * @category FFmpeg
+   */
+  public thumbnails = (
+    /** thumbnails command line args */
+    args: string[],
+    { signal }: FFMessageOptions = {}
+  ): Promise<number> =>
+    this.#send(
+      {
+        type: FFMessageType.THUMBNAILS,
+        data: { args },
       },
       undefined,
       signal
     ) as Promise<number>;
 
+  /**
+   * Decode the audio of one input to float PCM, resampled (`-ar`) and
+   * downmixed (`-ac`) natively, without writing a file to MEMFS. Samples
+   * are interleaved, or one plane per channel with `-planar`, `-ss` and
+   * `-t` are sample accurate.
+   *
+   * Planes of `output` are decoded into and transferred back in the result
+   * (or written in place when backed by a SharedArrayBuffer), larger ones
+   * are allocated when they are too short. With `stream`, chunks of
+   * `-chunk_size` samples are emitted as "audio" events instead, so long
+   * inputs never need the whole PCM in memory.
+   *
+   * With `-peaks N` (or `-peak_rate` buckets per second) samples are reduced
+   * natively to the min, max and RMS of N buckets, returned in `peaks`, to
+   * draw a waveform without moving the PCM out of the core.
+   *
+   * @example
+   * ```ts
+   * const { data: [pcm], sampleRate } = await ffmpeg.decodeAudio([
+   *   "-i", "podcast.mp3", "-ar", "48000", "-ac", "1",
+   * ]);
+   * audioBuffer.copyToChannel(pcm, 0);
+   *
+   * const { peaks } = await ffmpeg.decodeAudio([
+   *   "-i", "podcast.mp3", "-ac", "1", "-peaks", "2000",
+   * ]);
+   * ```
+   *
+   * @category FFmpeg
+   */
+  public decodeAudio = (
+    /** decode_audio command line args */
+    args: string[],
+    {
+      output = [],
+      stream = false,
+    }: { output?: Float32Array[]; stream?: boolean } = {},
+    { signal }: FFMessageOptions = {}
+  ): Promise<DecodedAudio> =>
+    this.#send(
+      {
+        type: FFMessageType.DECODE_AUDIO,
+        data: { args, output, stream },
+      },
+      getTransferables(output),
+      signal
+    ) as Promise<DecodedAudio>;
+
+  /**
+   * Create an input fed from JS while ffmpeg runs, read as `js:<name>`.
+   * Frames or PCM chunks written to it go through a ring buffer of
+   * `queueSize` bytes, ffmpeg waits for data when it is empty and writes
+   * wait when it is full. Inputs only live until the end of the next exec.
+   *
+   * Requires SharedArrayBuffer (cross-origin isolated pages).
+   *
+   * @example
+   * ```ts
+   * const input = await ffmpeg.createInput("canvas");
+   * const done = ffmpeg.exec([
+   *   "-f", "rawvideo", "-pix_fmt", "rgba", "-s", "1280x720", "-r", "30",
+   *   "-i", "js:canvas", "output.mp4",
+   * ]);
+   * for (const frame of frames) await input.write(frame);
+   * input.close();
+   * await done;
+   * ```
+   *
+   * @category FFmpeg
+   */
+  public createInput = async (
+    name: string,
+    { queueSize = INPUT_QUEUE_SIZE }: { queueSize?: number } = {},
+    { signal }: FFMessageOptions = {}
+  ): Promise<FFmpegInput> => {
+    if (typeof SharedArrayBuffer === "undefined")
+      throw ERROR_NO_SHARED_ARRAY_BUFFER;
+    const buffer = new SharedArrayBuffer(INPUT_HEADER_SIZE + queueSize);
+    await this.#send(
+      {
+        type: FFMessageType.CREATE_INPUT,
+        data: { name, buffer },
+      },
+      undefined,
+      signal
+    );
+    return new FFmpegInput(buffer);
+  };
+
+  /**
+   * Execute ffmpeg command with `-trace_file`, and collect the trace of
+   * when each packet / frame is demuxed, decoded, filtered, encoded and
+   * muxed, and on which thread.
+   *
+   * @example
+   * ```ts
+   * const { ret, trace } = await ffmpeg.trace(["-i", "video.avi", "video.mp4"]);
+   * // Save JSON.stringify(trace) as a .json file and open it in
+   * // https://ui.perfetto.dev or chrome://tracing.
+   * ```
+   *
+   * @category FFmpeg
+   */
+  public trace = async (
+    /** ffmpeg command line args */
+    args: string[],
+    timeout = -1,
+    { signal }: FFMessageOptions = {}
+  ): Promise<TraceResult> => {
+    const ret = await this.exec(["-trace_file", TRACE_FILE, ...args], timeout, {
+      signal,
+    });
+    const trace = JSON.parse(
+      (await this.readFile(TRACE_FILE, "utf8", { signal })) as string
+    ) as ChromeTrace;
+    await this.deleteFile(TRACE_FILE, { signal });
+    return { ret, trace };
+  };
+
   /**
    * Terminate all ongoing API calls and terminate web worker.
    * `FFmpeg.load()` must be called again before calling any other APIs.
@@ -269,6 +647,7 @@ export class FFmpeg {
       this.#worker = null;
       this.loaded = false;
     }
+    if (this.#frameQueue) Atomics.store(this.#frameQueue, 0, 0);
   };
 
   /**
@@ -4,9 +4,62 @@ export const MIME_TYPE_WASM = "application/wasm";
 export const CORE_VERSION = "0.12.6";
 export const CORE_URL = `https://unpkg.com/@ffmpeg/core@${CORE_VERSION}/dist/umd/ffmpeg-core.js`;
 
+/**
+ * Maximum number of frames of `-js_frames` posted by the worker and not yet
+ * handled by frame callbacks, ffmpeg waits when it is reached. Only applies
+ * when SharedArrayBuffer is available (cross-origin isolated pages).
+ */
+export const FRAME_QUEUE_DEPTH = 4;
+
+/**
+ * Shared memory of an input created by FFmpeg.createInput(): a header of
+ * InputState int32 values followed by a ring buffer of INPUT_QUEUE_SIZE bytes
+ * (by default) written by the main thread and read by ffmpeg.
+ */
+export enum InputState {
+  READ = 0,
+  WRITE = 1,
+  USED = 2,
+  // set by FFmpegInput.close()
+  CLOSED = 3,
+  // set by the worker once ffmpeg stops reading (end of file or of exec)
+  ENDED = 4,
+}
+export const INPUT_HEADER_SIZE = 5 * Int32Array.BYTES_PER_ELEMENT;
+export const INPUT_QUEUE_SIZE = 16 * 1024 * 1024;
+// Milliseconds between checks of a full or empty input queue.
+export const INPUT_WAIT_TIMEOUT = 50;
+
+// Temporary file of FFmpeg.trace().
+export const TRACE_FILE = "/tmp/ffmpeg-trace.json";
+
+/**
+ * Minimal wasm modules used to probe runtime features, a module is valid only
+ * when the runtime supports the feature it uses.
+ */
+// i8x16.popcnt
+export const WASM_SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1,
+  8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+// i8x16.relaxed_swizzle
+export const WASM_RELAXED_SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 15, 1,
+  13, 0, 65, 1, 253, 15, 65, 2, 253, 15, 253, 128, 2, 11,
+]);
+// try / catch_all
+export const WASM_EXCEPTIONS_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 4, 1, 96, 0, 0, 3, 2, 1, 0, 10, 8, 1, 6, 0, 6,
+  64, 25, 11, 11,
+]);
+
 export enum FFMessageType {
   LOAD = "LOAD",
   EXEC = "EXEC",
+  FFPROBE = "FFPROBE",
+  THUMBNAILS = "THUMBNAILS",
+  CREATE_INPUT = "CREATE_INPUT",
+  DECODE_AUDIO = "DECODE_AUDIO",
   WRITE_FILE = "WRITE_FILE",
   READ_FILE = "READ_FILE",
   DELETE_FILE = "DELETE_FILE",
@@ -19,6 +72,9 @@ export enum FFMessageType {
   DOWNLOAD = "DOWNLOAD",
   PROGRESS = "PROGRESS",
   LOG = "LOG",
+  STATS = "STATS",
+  FRAME = "FRAME",
+  AUDIO = "AUDIO",
   MOUNT = "MOUNT",
   UNMOUNT = "UNMOUNT",
 }
@@ -3,6 +3,15 @@ export const ERROR_NOT_LOADED = new Error(
   "ffmpeg is not loaded, call `await ffmpeg.load()` first"
 );
 export const ERROR_TERMINATED = new Error("called FFmpeg.terminate()");
+export const ERROR_NO_SHARED_ARRAY_BUFFER = new Error(
+  "SharedArrayBuffer is not available, the page must be cross-origin isolated"
+);
+export const ERROR_INPUT_ENDED = new Error(
+  "ffmpeg stopped reading the input"
+);
 export const ERROR_IMPORT_FAILURE = new Error(
   "failed to import ffmpeg-core.js"
 );
+export const ERROR_TIER_URL = new Error(
+  "tier requires coreURL, wasmURL and workerURL to name ffmpeg-core files, not Blob URLs"
+);
@@ -1,5 +1,14 @@
 export type FFFSPath = string;
 
+/**
+ * ffmpeg-core build tiers, built with `make prd-tiers` / `make prd-mt-tiers`.
+ *
+ * - baseline: no wasm SIMD.
+ * - simd: wasm SIMD, the default ffmpeg-core.js.
+ * - relaxed: wasm SIMD, relaxed SIMD and native wasm exceptions / longjmp.
+ */
+export type FFCoreTier = "baseline" | "simd" | "relaxed";
+
 /**
  * ffmpeg-core loading configuration.
  */
@@ -23,6 +32,23 @@ export interface FFMessageLoadConfig {
    * @defaultValue `https://unpkg.com/@ffmpeg/core-mt@${CORE_VERSION}/dist/umd/ffmpeg-core.worker.js`;
    */
   workerURL?: string;
+  /**
+   * Side module URLs of a modular ffmpeg-core (built with `MODULAR=yes`),
+   * keyed by side module name (`x265`, `vpx`, `ass` and `zimg`). Side modules
+   * are only downloaded when a command requires them.
+   *
+   * @defaultValue `ffmpeg-core-<name>.wasm` next to `wasmURL`
+   */
+  sideModuleURLs?: Record<string, string>;
+  /**
+   * ffmpeg-core tier to load, `auto` picks the best tier supported by the
+   * runtime. The URLs of a tier are derived from `coreURL`, `wasmURL` and
+   * `workerURL` (ex. `ffmpeg-core.relaxed.js`), thus load() rejects when any
+   * of them doesn't name an ffmpeg-core file (ex. a Blob URL).
+   *
+   * @defaultValue undefined, load `coreURL` as it is.
+   */
+  tier?: FFCoreTier | "auto";
   /**
    * `ffmpeg.worker.js` URL. This worker is spawned when FFmpeg.load() is called, it is an essential worker and usually you don't need to update this config.
    *
@@ -35,6 +61,34 @@ export interface FFMessageLoadConfig {
 export interface FFMessageExecData {
   args: string[];
   timeout?: number;
+  /**
+   * number of frames posted and not yet handled, over a SharedArrayBuffer,
+   * see FRAME_QUEUE_DEPTH
+   */
+  frameQueue?: Int32Array | null;
+}
+
+export interface FFMessageProbeData {
+  args: string[];
+}
+
+export interface FFMessageThumbnailsData {
+  args: string[];
+}
+
+export interface FFMessageDecodeAudioData {
+  args: string[];
+  /** planes to decode into, replaced by larger ones when too short */
+  output?: Float32Array[];
+  /** post chunks as "audio" events instead of returning all samples */
+  stream?: boolean;
+}
+
+export interface FFMessageCreateInputData {
+  /** read by ffmpeg as js:name */
+  name: string;
+  /** InputState header and ring buffer */
+  buffer: SharedArrayBuffer;
 }
 
 export interface FFMessageWriteFileData {
@@ -110,6 +164,10 @@ export interface FFMessageUnmountData {
 export type FFMessageData =
   | FFMessageLoadConfig
   | FFMessageExecData
+  | FFMessageProbeData
+  | FFMessageThumbnailsData
+  | FFMessageDecodeAudioData
+  | FFMessageCreateInputData
   | FFMessageWriteFileData
   | FFMessageReadFileData
   | FFMessageDeleteFileData
@@ -143,6 +201,236 @@ export interface ProgressEvent {
   time: number;
 }
 
+/**
+ * Filtered frame of an output with `-js_frames`, planes are views over one
+ * ArrayBuffer transferred from the worker.
+ */
+export interface FrameEvent {
+  /** output file index */
+  file: number;
+  /** output stream index */
+  stream: number;
+  type: "video" | "audio";
+  /** pixel format (ex. rgb24) or sample format (ex. fltp) */
+  format: string;
+  width: number;
+  height: number;
+  sampleRate: number;
+  channels: number;
+  /** number of samples per channel */
+  samples: number;
+  /** in timeBase units, NaN when unknown */
+  pts: number;
+  timeBase: [number, number];
+  /** pts in seconds */
+  time: number;
+  /** one plane per component (ex. yuv420p) or channel (ex. fltp) */
+  planes: Uint8Array[];
+  /** bytes per row of each plane (video), or size of each plane (audio) */
+  linesizes: number[];
+}
+
+/**
+ * Cumulative time (in microseconds) and number of calls of one pipeline stage.
+ */
+export interface StageTimer {
+  time: number;
+  count: number;
+}
+
+/**
+ * Stage timers of an input stream (demux, decode, filter_send) or an output
+ * stream (filter_reap, encode, mux).
+ */
+export interface StreamStageStats {
+  file: number;
+  stream: number;
+  type: string;
+  demux?: StageTimer;
+  decode?: StageTimer;
+  filter_send?: StageTimer;
+  filter_reap?: StageTimer;
+  encode?: StageTimer;
+  mux?: StageTimer;
+}
+
+export interface StageStats {
+  inputs: StreamStageStats[];
+  outputs: StreamStageStats[];
+}
+
+/**
+ * Resource usage of an exec, times are in microseconds and sizes in bytes.
+ */
+export interface ResourceStats {
+  /**
+   * wall time spent in pipeline stages, it is not CPU time as time blocked
+   * in a stage is included and stages running in other threads are not
+   */
+  busy_time: number;
+  /** wall time since the start of transcoding */
+  rtime: number;
+  /** size of wasm memory, which never shrinks */
+  heap_size: number;
+  sbrk_high_water: number;
+  /** size of all files in MEMFS */
+  memfs_bytes: number;
+  /** number of pthread pool workers used, always 0 in single thread */
+  pool_threads: number;
+}
+
+/**
+ * A link of a filter, format is ex. `yuv420p 1280x720` or
+ * `fltp 48000Hz stereo`.
+ */
+export interface FilterLinkStats {
+  format: string;
+  /** number of frames through the link */
+  frames: number;
+}
+
+export interface FilterStats {
+  name: string;
+  filter: string;
+  /**
+   * - auto: conversion inserted by libavfilter during format negotiation
+   * - ffmpeg: inserted by ffmpeg (buffers, trim, format, ...)
+   * - user: from the filtergraph description
+   */
+  origin: "auto" | "ffmpeg" | "user";
+  inputs: FilterLinkStats[];
+  outputs: FilterLinkStats[];
+}
+
+export interface FilterGraphStats {
+  index: number;
+  description: string;
+  /** time spent in the filtergraph in microseconds */
+  time: number;
+  filters: FilterStats[];
+}
+
+/**
+ * Packets buffered until an output file is initialized (its header is
+ * written), sizes are in bytes.
+ */
+export interface MuxingQueueStats {
+  file: number;
+  /** packets queued in total */
+  packets: number;
+  /** packets currently queued */
+  queued: number;
+  /** size of the packets currently held in memory */
+  bytes: number;
+  peak_bytes: number;
+  /** packets spilled to a temporary file once -mux_queue_size was reached */
+  spilled_packets: number;
+  spilled_bytes: number;
+}
+
+export interface Stats {
+  stages?: StageStats;
+  resources?: ResourceStats;
+  filters?: {
+    graphs: FilterGraphStats[];
+  };
+  muxing_queue?: {
+    outputs: MuxingQueueStats[];
+  };
+}
+
+export interface StatsEvent {
+  type: keyof Stats;
+  stats: Stats[keyof Stats];
+}
+
+/**
+ * Event of a Chrome trace, see the Trace Event Format.
+ */
+export interface ChromeTraceEvent {
+  /** stage name, ex: decode, encode, queue_send */
+  name: string;
+  cat?: string;
+  /** X for complete events, M for metadata (thread names) */
+  ph: string;
+  pid: number;
+  tid: number;
+  /** start time in microseconds */
+  ts?: number;
+  /** duration in microseconds */
+  dur?: number;
+  /**
+   * stream as "file:stream", and pts_time, the timestamp in seconds of the
+   * packet or frame of the event when there is one
+   */
+  args: { stream?: string; pts_time?: number; name?: string };
+}
+
+export interface ChromeTrace {
+  displayTimeUnit: string;
+  traceEvents: ChromeTraceEvent[];
+}
+
+export interface TraceResult {
+  ret: ExitCode;
+  trace: ChromeTrace;
+}
+
+/**
+ * Output of ffprobe for each input file, in the same order. Outputs of
+ * `-print_format bin` are Uint8Array, see parseProbeColumns() of @ffmpeg/util.
+ */
+export interface ProbeResult {
+  ret: ExitCode;
+  outputs: (string | Uint8Array)[];
+}
+
+/**
+ * Chunk of float PCM of `FFmpeg.decodeAudio()` with `stream`, planes are
+ * transferred from the worker.
+ */
+export interface AudioEvent {
+  /** one interleaved plane, or one plane per channel with -planar */
+  data: Float32Array[];
+  /** number of samples per channel */
+  samples: number;
+  channels: number;
+  sampleRate: number;
+  /** time of the first sample in seconds */
+  time: number;
+  /** expected duration of the whole output in seconds, NaN when unknown */
+  duration: number;
+}
+
+/**
+ * Waveform peaks of `FFmpeg.decodeAudio()` with `-peaks` or `-peak_rate`,
+ * values of bucket b and channel c are at index b * channels + c.
+ */
+export interface Peaks {
+  min: Float32Array;
+  max: Float32Array;
+  rms: Float32Array;
+  buckets: number;
+  channels: number;
+  /** duration of a bucket in seconds */
+  bucketDuration: number;
+}
+
+/**
+ * Result of `FFmpeg.decodeAudio()`, data is empty with `stream`, `-peaks`
+ * or `-peak_rate`.
+ */
+export interface DecodedAudio {
+  ret: ExitCode;
+  /** one interleaved plane, or one plane per channel with -planar */
+  data: Float32Array[];
+  /** number of samples per channel */
+  samples: number;
+  channels: number;
+  sampleRate: number;
+  peaks: Peaks | null;
+}
+
 export type ExitCode = number;
 export type ErrorMessage = string;
 export type FileData = Uint8Array | string;
@@ -157,9 +445,14 @@ export interface FSNode {
 export type CallbackData =
   | FileData
   | ExitCode
+  | ProbeResult
+  | DecodedAudio
   | ErrorMessage
   | LogEvent
   | ProgressEvent
+  | StatsEvent
+  | FrameEvent
+  | AudioEvent
   | IsFirst
   | OK // eslint-disable-line
   | Error
@@ -172,6 +465,10 @@ export interface Callbacks {
 
 export type LogEventCallback = (event: LogEvent) => void;
 export type ProgressEventCallback = (event: ProgressEvent) => void;
+export type StatsEventCallback = (event: StatsEvent) => void;
+/** the frame is released to ffmpeg when the returned promise settles */
+export type FrameEventCallback = (event: FrameEvent) => void | Promise<void>;
+export type AudioEventCallback = (event: AudioEvent) => void;
 
 export interface FFMessageEventCallback {
   data: {
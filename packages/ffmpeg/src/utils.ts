@@ -1,3 +1,10 @@
+import type { FFCoreTier } from "./types";
+import {
+  WASM_SIMD_PROBE,
+  WASM_RELAXED_SIMD_PROBE,
+  WASM_EXCEPTIONS_PROBE,
+} from "./const.js";
+
 /**
  * Generate an unique message ID.
  */
@@ -5,3 +12,49 @@ export const getMessageID = (() => {
   let messageID = 0;
   return () => messageID++;
 })();
+
+/**
+ * Detect the best ffmpeg-core tier supported by current runtime.
+ */
+export const detectCoreTier = (): FFCoreTier => {
+  if (!WebAssembly.validate(WASM_SIMD_PROBE)) return "baseline";
+  if (
+    WebAssembly.validate(WASM_RELAXED_SIMD_PROBE) &&
+    WebAssembly.validate(WASM_EXCEPTIONS_PROBE)
+  )
+    return "relaxed";
+  return "simd";
+};
+
+const CORE_FILE_REGEX = /ffmpeg-core(\.worker\.js|\.wasm|\.js)$/;
+
+/**
+ * Whether the URL of a given tier can be derived from url, which must name
+ * one of the default ffmpeg-core.js, ffmpeg-core.wasm and
+ * ffmpeg-core.worker.js files (ex. not a Blob URL).
+ */
+export const isCoreTierURL = (url: string): boolean => CORE_FILE_REGEX.test(url);
+
+/**
+ * Get the URL of given tier from the URL of a default ffmpeg-core file, which
+ * is the simd tier.
+ */
+export const getCoreTierURL = (url: string, tier?: FFCoreTier): string =>
+  !tier || tier === "simd"
+    ? url
+    : url.replace(CORE_FILE_REGEX, `ffmpeg-core.${tier}$1`);
+
+/**
+ * Buffers of planes that can be transferred, each once, skipping shared ones.
+ */
+export const getTransferables = (planes: ArrayBufferView[]): ArrayBuffer[] => [
+  ...new Set(
+    planes
+      .map(({ buffer }) => buffer)
+      .filter(
+        (buffer): buffer is ArrayBuffer =>
+          typeof SharedArrayBuffer === "undefined" ||
+          !(buffer instanceof SharedArrayBuffer)
+      )
+  ),
+];
@@ -2,11 +2,20 @@
 /// <reference lib="esnext" />
 /// <reference lib="webworker" />
 
-import type { FFmpegCoreModule, FFmpegCoreModuleFactory } from "@ffmpeg/types";
+import type {
+  FFmpegCoreModule,
+  FFmpegCoreModuleFactory,
+  FrameEvent,
+  AudioChunk,
+} from "@ffmpeg/types";
 import type {
   FFMessageEvent,
   FFMessageLoadConfig,
   FFMessageExecData,
+  FFMessageProbeData,
+  FFMessageThumbnailsData,
+  FFMessageCreateInputData,
+  FFMessageDecodeAudioData,
   FFMessageWriteFileData,
   FFMessageReadFileData,
   FFMessageDeleteFileData,
@@ -20,15 +29,31 @@ import type {
   IsFirst,
   OK,
   ExitCode,
+  ProbeResult,
+  DecodedAudio,
   FSNode,
   FileData,
 } from "./types";
-import { CORE_URL, FFMessageType } from "./const.js";
+import {
+  CORE_URL,
+  FFMessageType,
+  FRAME_QUEUE_DEPTH,
+  INPUT_HEADER_SIZE,
+  INPUT_WAIT_TIMEOUT,
+  InputState,
+} from "./const.js";
 import {
   ERROR_UNKNOWN_MESSAGE_TYPE,
   ERROR_NOT_LOADED,
   ERROR_IMPORT_FAILURE,
+  ERROR_TIER_URL,
 } from "./errors.js";
+import {
+  detectCoreTier,
+  getCoreTierURL,
+  isCoreTierURL,
+  getTransferables,
+} from "./utils.js";
 
 declare global {
   interface WorkerGlobalScope {
@@ -41,20 +66,97 @@ interface ImportedFFmpegCoreModuleFactory {
 }
 
 let ffmpeg: FFmpegCoreModule;
+let frameQueue: Int32Array | null = null;
+let inputs: Record<string, { state: Int32Array; data: Uint8Array }> = {};
+
+/**
+ * Copies the planes of a frame out of the wasm heap into one transferred
+ * buffer. With a frame queue, ffmpeg waits here while FRAME_QUEUE_DEPTH
+ * frames are not handled by the main thread.
+ */
+const sendFrame = ({ planes, ...frame }: FrameEvent) => {
+  if (frameQueue) {
+    let pending;
+    while ((pending = Atomics.load(frameQueue, 0)) >= FRAME_QUEUE_DEPTH)
+      Atomics.wait(frameQueue, 0, pending);
+    Atomics.add(frameQueue, 0, 1);
+  }
+  const data = new Uint8Array(
+    planes.reduce((size, plane) => size + plane.length, 0)
+  );
+  let offset = 0;
+  const copies = planes.map((plane) => {
+    data.set(plane, offset);
+    offset += plane.length;
+    return data.subarray(offset - plane.length, offset);
+  });
+  self.postMessage(
+    { type: FFMessageType.FRAME, data: { ...frame, planes: copies } },
+    [data.buffer]
+  );
+};
+
+/**
+ * Marks an input as no longer read, so pending FFmpegInput.write() calls
+ * reject instead of waiting for ffmpeg forever.
+ */
+const endInput = (state: Int32Array) => {
+  Atomics.store(state, InputState.ENDED, 1);
+  Atomics.notify(state, InputState.USED);
+};
+
+/**
+ * Reads input js:name from its ring buffer, waiting while it is empty and
+ * not closed.
+ */
+const readInput = (name: string, dest: Uint8Array): number => {
+  const input = inputs[name];
+  if (!input) return -1;
+  const { state, data } = input;
+
+  let used;
+  while (!(used = Atomics.load(state, InputState.USED))) {
+    if (Atomics.load(state, InputState.CLOSED)) {
+      endInput(state);
+      return 0;
+    }
+    Atomics.wait(state, InputState.USED, 0, INPUT_WAIT_TIMEOUT);
+  }
+
+  const size = Math.min(used, dest.length);
+  const read = state[InputState.READ];
+  const first = Math.min(size, data.length - read);
+  dest.set(data.subarray(read, read + first));
+  dest.set(data.subarray(0, size - first), first);
+  state[InputState.READ] = (read + size) % data.length;
+  Atomics.sub(state, InputState.USED, size);
+  Atomics.notify(state, InputState.USED);
+  return size;
+};
 
 const load = async ({
   coreURL: _coreURL,
   wasmURL: _wasmURL,
   workerURL: _workerURL,
+  sideModuleURLs = {},
+  tier: _tier,
 }: FFMessageLoadConfig): Promise<IsFirst> => {
   const first = !ffmpeg;
+  // checked for any tier, so "auto" doesn't only fail on some runtimes
+  if (
+    _tier &&
+    [_coreURL, _wasmURL, _workerURL].some((url) => url && !isCoreTierURL(url))
+  )
+    throw ERROR_TIER_URL;
+  const tier = _tier === "auto" ? detectCoreTier() : _tier;
+  const defaultCoreURL = getCoreTierURL(CORE_URL, tier);
 
   try {
-    if (!_coreURL) _coreURL = CORE_URL;
+    _coreURL = _coreURL ? getCoreTierURL(_coreURL, tier) : defaultCoreURL;
     // when web worker type is `classic`.
     importScripts(_coreURL);
   } catch {
-    if (!_coreURL || _coreURL === CORE_URL) _coreURL = CORE_URL.replace('/umd/', '/esm/');
+    if (!_coreURL || _coreURL === defaultCoreURL) _coreURL = defaultCoreURL.replace('/umd/', '/esm/');
     // when web worker type is `module`.
     (self as WorkerGlobalScope).createFFmpegCore = (
       (await import(
@@ -68,16 +170,18 @@ const load = async ({
   }
 
   const coreURL = _coreURL;
-  const wasmURL = _wasmURL ? _wasmURL : _coreURL.replace(/.js$/g, ".wasm");
+  const wasmURL = _wasmURL
+    ? getCoreTierURL(_wasmURL, tier)
+    : _coreURL.replace(/.js$/g, ".wasm");
   const workerURL = _workerURL
-    ? _workerURL
+    ? getCoreTierURL(_workerURL, tier)
     : _coreURL.replace(/.js$/g, ".worker.js");
 
   ffmpeg = await (self as WorkerGlobalScope).createFFmpegCore({
     // Fix `Overload resolution failed.` when using multi-threaded ffmpeg-core.
-    // Encoded wasmURL and workerURL in the URL as a hack to fix locateFile issue.
+    // Encoded wasmURL, workerURL and sideModuleURLs in the URL as a hack to fix locateFile issue.
     mainScriptUrlOrBlob: `${coreURL}#${btoa(
-      JSON.stringify({ wasmURL, workerURL })
+      JSON.stringify({ wasmURL, workerURL, sideModuleURLs })
     )}`,
   });
   ffmpeg.setLogger((data) =>
@@ -89,17 +193,120 @@ const load = async ({
       data,
     })
   );
+  ffmpeg.setStats((data) =>
+    self.postMessage({
+      type: FFMessageType.STATS,
+      data,
+    })
+  );
+  ffmpeg.setFrameHandler(sendFrame);
+  ffmpeg.setInputReader(readInput);
   return first;
 };
 
-const exec = ({ args, timeout = -1 }: FFMessageExecData): ExitCode => {
+const exec = ({
+  args,
+  timeout = -1,
+  frameQueue: _frameQueue = null,
+}: FFMessageExecData): ExitCode => {
+  frameQueue = _frameQueue;
   ffmpeg.setTimeout(timeout);
   ffmpeg.exec(...args);
   const ret = ffmpeg.ret;
   ffmpeg.reset();
+  frameQueue = null;
+  Object.values(inputs).forEach(({ state }) => endInput(state));
+  inputs = {};
+  return ret;
+};
+
+const createInput = ({ name, buffer }: FFMessageCreateInputData): OK => {
+  inputs[name] = {
+    state: new Int32Array(buffer, 0, INPUT_HEADER_SIZE / 4),
+    data: new Uint8Array(buffer, INPUT_HEADER_SIZE),
+  };
+  return true;
+};
+
+const ffprobe = ({ args }: FFMessageProbeData): ProbeResult => {
+  ffmpeg.ffprobe(...args);
+  const result = { ret: ffmpeg.ret, outputs: ffmpeg.probe };
+  ffmpeg.reset();
+  return result;
+};
+
+const thumbnails = ({ args }: FFMessageThumbnailsData): ExitCode => {
+  ffmpeg.thumbnails(...args);
+  const ret = ffmpeg.ret;
+  ffmpeg.reset();
   return ret;
 };
 
+/**
+ * Decodes audio into output planes, allocated from the expected duration
+ * sent with the first chunk and grown when it is too short. With stream,
+ * chunks are posted as they are decoded and nothing is kept here.
+ */
+const decodeAudio = ({
+  args,
+  output = [],
+  stream = false,
+}: FFMessageDecodeAudioData): DecodedAudio => {
+  let data = output;
+  let samples = 0;
+  let channels = 0;
+  let sampleRate = 0;
+
+  ffmpeg.setAudioHandler(({ data: planes, ...chunk }: AudioChunk) => {
+    ({ channels, sampleRate } = chunk);
+    if (stream) {
+      const copies = planes.map((plane) => plane.slice());
+      self.postMessage(
+        { type: FFMessageType.AUDIO, data: { ...chunk, data: copies } },
+        getTransferables(copies)
+      );
+      samples += chunk.samples;
+      return;
+    }
+
+    // floats per sample in a plane
+    const width = planes.length > 1 ? 1 : channels;
+    const end = (samples + chunk.samples) * width;
+    if (data.length !== planes.length || data[0].length < end) {
+      const expected =
+        (Math.ceil((chunk.duration || 0) * sampleRate) + chunk.samples) * width;
+      const size = Math.max(
+        end,
+        samples ? Math.ceil(data[0].length * 1.5) : expected
+      );
+      data = planes.map((_, i) => {
+        const plane = new Float32Array(size);
+        if (samples) plane.set(data[i].subarray(0, samples * width));
+        return plane;
+      });
+    }
+    planes.forEach((plane, i) => data[i].set(plane, samples * width));
+    samples += chunk.samples;
+  });
+  ffmpeg.decodeAudio(...args);
+  ffmpeg.setAudioHandler(() => {});
+
+  const { ret, peaks } = ffmpeg;
+  ffmpeg.reset();
+  const width = data.length > 1 ? 1 : channels;
+  return {
+    ret,
+    peaks,
+    data: stream ? [] : data.map((plane) => plane.subarray(0, samples * width)),
+    samples,
+    channels,
+    sampleRate,
+  };
+};
+
+const getDecodedAudioBuffers = ({ data, peaks }: DecodedAudio) =>
+  getTransferables(peaks ? [...data, peaks.min, peaks.max, peaks.rms] : data);
+
 const writeFile = ({ path, data }: FFMessageWriteFileData): OK => {
   ffmpeg.FS.writeFile(path, data);
   return true;
@@ -170,6 +377,19 @@ self.onmessage = async ({
       case FFMessageType.EXEC:
         data = exec(_data as FFMessageExecData);
         break;
+      case FFMessageType.FFPROBE:
+        data = ffprobe(_data as FFMessageProbeData);
+        break;
+      case FFMessageType.THUMBNAILS:
+        data = thumbnails(_data as FFMessageThumbnailsData);
+        break;
+      case FFMessageType.DECODE_AUDIO:
+        data = decodeAudio(_data as FFMessageDecodeAudioData);
+        trans.push(...getDecodedAudioBuffers(data as DecodedAudio));
+        break;
+      case FFMessageType.CREATE_INPUT:
+        data = createInput(_data as FFMessageCreateInputData);
+        break;
       case FFMessageType.WRITE_FILE:
         data = writeFile(_data as FFMessageWriteFileData);
         break;
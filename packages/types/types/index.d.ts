@@ -99,12 +99,218 @@ export interface Progress {
   time: number;
 }
 
+/**
+ * Cumulative time (in microseconds) and number of calls of one pipeline stage.
+ */
+export interface StageTimer {
+  time: number;
+  count: number;
+}
+
+/**
+ * Stage timers of an input stream (demux, decode, filter_send) or an output
+ * stream (filter_reap, encode, mux).
+ */
+export interface StreamStageStats {
+  file: number;
+  stream: number;
+  type: string;
+  demux?: StageTimer;
+  decode?: StageTimer;
+  filter_send?: StageTimer;
+  filter_reap?: StageTimer;
+  encode?: StageTimer;
+  mux?: StageTimer;
+}
+
+/**
+ * Resource usage of an exec, times are in microseconds and sizes in bytes.
+ */
+export interface ResourceStats {
+  /**
+   * wall time spent in pipeline stages, it is not CPU time as time blocked
+   * in a stage is included and stages running in other threads are not
+   */
+  busy_time: number;
+  /** wall time since the start of transcoding */
+  rtime: number;
+  /** size of wasm memory, which never shrinks */
+  heap_size: number;
+  sbrk_high_water: number;
+  /** size of all files in MEMFS */
+  memfs_bytes: number;
+  /** number of pthread pool workers used, always 0 in single thread */
+  pool_threads: number;
+}
+
+/**
+ * A link of a filter, format is ex. `yuv420p 1280x720` or
+ * `fltp 48000Hz stereo`.
+ */
+export interface FilterLinkStats {
+  format: string;
+  /** number of frames through the link */
+  frames: number;
+}
+
+export interface FilterStats {
+  name: string;
+  filter: string;
+  /**
+   * - auto: conversion inserted by libavfilter during format negotiation
+   * - ffmpeg: inserted by ffmpeg (buffers, trim, format, ...)
+   * - user: from the filtergraph description
+   */
+  origin: "auto" | "ffmpeg" | "user";
+  inputs: FilterLinkStats[];
+  outputs: FilterLinkStats[];
+}
+
+export interface FilterGraphStats {
+  index: number;
+  description: string;
+  /** time spent in the filtergraph in microseconds */
+  time: number;
+  filters: FilterStats[];
+}
+
+/**
+ * Time spent opening an input file, in microseconds.
+ */
+export interface InputProbeStats {
+  file: number;
+  /** name of the demuxer, ex. `mov,mp4,m4a,3gp,3g2,mj2` */
+  format: string;
+  /** stream info was found from the header and the first packets only */
+  fast_probe: boolean;
+  /** stream info was taken from the header only, all outputs are `-c copy` */
+  header_probe: boolean;
+  open: number;
+  find_stream_info: number;
+}
+
+/**
+ * Packets buffered until an output file is initialized (its header is
+ * written), sizes are in bytes.
+ */
+export interface MuxingQueueStats {
+  file: number;
+  /** packets queued in total */
+  packets: number;
+  /** packets currently queued */
+  queued: number;
+  /** size of the packets currently held in memory */
+  bytes: number;
+  peak_bytes: number;
+  /** packets spilled to a temporary file once -mux_queue_size was reached */
+  spilled_packets: number;
+  spilled_bytes: number;
+}
+
+/**
+ * Stats reported by ffmpeg during and after exec(), by type.
+ */
+export interface Stats {
+  stages?: {
+    inputs: StreamStageStats[];
+    outputs: StreamStageStats[];
+  };
+  resources?: ResourceStats;
+  probe?: {
+    inputs: InputProbeStats[];
+  };
+  filters?: {
+    graphs: FilterGraphStats[];
+  };
+  muxing_queue?: {
+    outputs: MuxingQueueStats[];
+  };
+}
+
+/**
+ * Arguments passed to setStats callback function.
+ */
+export interface StatsEvent {
+  type: keyof Stats;
+  stats: Stats[keyof Stats];
+}
+
+/**
+ * Filtered frame of an output with `-js_frames`.
+ */
+export interface FrameEvent {
+  /** output file index */
+  file: number;
+  /** output stream index */
+  stream: number;
+  type: "video" | "audio";
+  /** pixel format (ex. rgb24) or sample format (ex. fltp) */
+  format: string;
+  width: number;
+  height: number;
+  sampleRate: number;
+  channels: number;
+  /** number of samples per channel */
+  samples: number;
+  /** in timeBase units, NaN when unknown */
+  pts: number;
+  timeBase: [number, number];
+  /** pts in seconds */
+  time: number;
+  /**
+   * one plane per component (ex. yuv420p) or channel (ex. fltp), views over
+   * the wasm heap only valid during the frame handler
+   */
+  planes: Uint8Array[];
+  /** bytes per row of each plane (video), or size of each plane (audio) */
+  linesizes: number[];
+}
+
+/**
+ * Chunk of float PCM of decodeAudio().
+ */
+export interface AudioChunk {
+  /**
+   * one interleaved plane, or one plane per channel with -planar, views over
+   * the wasm heap only valid during the audio handler
+   */
+  data: Float32Array[];
+  /** number of samples per channel */
+  samples: number;
+  channels: number;
+  sampleRate: number;
+  /** time of the first sample in seconds */
+  time: number;
+  /** expected duration of the whole output in seconds, NaN when unknown */
+  duration: number;
+}
+
+/**
+ * Waveform peaks of decodeAudio() with -peaks or -peak_rate, values of
+ * bucket b and channel c are at index b * channels + c.
+ */
+export interface Peaks {
+  min: Float32Array;
+  max: Float32Array;
+  rms: Float32Array;
+  buckets: number;
+  channels: number;
+  /** duration of a bucket in seconds */
+  bucketDuration: number;
+}
+
 /**
  * FFmpeg core module, an object to interact with ffmpeg.
  */
 export interface FFmpegCoreModule {
   /** default arguments prepend when running exec() */
   DEFAULT_ARGS: string[];
+  /** default arguments prepend when running ffprobe() */
+  DEFAULT_PROBE_ARGS: string[];
+  /** default arguments prepend when running thumbnails() */
+  DEFAULT_THUMBNAILS_ARGS: string[];
+  /** default arguments prepend when running decodeAudio() */
+  DEFAULT_DECODE_AUDIO_ARGS: string[];
   FS: FS;
   NULL: Pointer;
   SIZE_I32: number;
@@ -112,15 +318,46 @@ export interface FFmpegCoreModule {
   /** return code of the ffmpeg exec, error when ret != 0 */
   ret: number;
   timeout: number;
+  /** stats of the current / last exec, cleared by reset() */
+  stats: Stats;
+  /**
+   * output of each input file of the last ffprobe(), a Uint8Array with
+   * `-print_format bin`, cleared by reset()
+   */
+  probe: (string | Uint8Array)[];
+  /** peaks of the last decodeAudio() with -peaks, cleared by reset() */
+  peaks: Peaks | null;
   mainScriptUrlOrBlob: string;
 
   exec: (...args: string[]) => number;
+  ffprobe: (...args: string[]) => number;
+  thumbnails: (...args: string[]) => number;
+  decodeAudio: (...args: string[]) => number;
   reset: () => void;
   setLogger: (logger: (log: Log) => void) => void;
   setTimeout: (timeout: number) => void;
   setProgress: (handler: (progress: Progress) => void) => void;
+  setStats: (handler: (event: StatsEvent) => void) => void;
+  /** handler of frames of outputs with -js_frames, ffmpeg waits for it */
+  setFrameHandler: (handler: (event: FrameEvent) => void) => void;
+  /**
+   * reader of inputs named js:NAME, it copies up to dest.length bytes into
+   * dest and returns the number of bytes copied, 0 at the end of the input
+   * or < 0 on error. ffmpeg waits for it.
+   */
+  setInputReader: (reader: (name: string, dest: Uint8Array) => number) => void;
+  /** handler of chunks of decodeAudio() */
+  setAudioHandler: (handler: (chunk: AudioChunk) => void) => void;
 
   locateFile: (path: string, prefix: string) => string;
+
+  /** side modules loaded so far, only used by modular builds */
+  sideModules: Record<string, boolean>;
+  /**
+   * write side modules required by a codec name or filtergraph description
+   * to the file system, returns their paths to be loaded with dlopen()
+   */
+  stageSideModules: (names: string) => string[];
 }
 
 /**
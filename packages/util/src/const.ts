@@ -1 +1,3 @@
 export const HeaderContentLength = "Content-Length";
+// "FFPB" read as a little-endian u32, header of ffprobe `-print_format bin`.
+export const PROBE_COLUMNS_MAGIC = 0x42504646;
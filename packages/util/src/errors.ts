@@ -4,3 +4,6 @@ export const ERROR_RESPONSE_BODY_READER = new Error(
 export const ERROR_INCOMPLETED_DOWNLOAD = new Error(
   "failed to complete download"
 );
+export const ERROR_INVALID_PROBE_COLUMNS = new Error(
+  "invalid ffprobe bin output"
+);
@@ -1,9 +1,10 @@
 import {
   ERROR_RESPONSE_BODY_READER,
   ERROR_INCOMPLETED_DOWNLOAD,
+  ERROR_INVALID_PROBE_COLUMNS,
 } from "./errors.js";
-import { HeaderContentLength } from "./const.js";
-import { ProgressCallback } from "./types.js";
+import { HeaderContentLength, PROBE_COLUMNS_MAGIC } from "./const.js";
+import { ProgressCallback, ProbeColumns } from "./types.js";
 
 const readFromBlobOrFile = (blob: Blob | File): Promise<Uint8Array> =>
   new Promise((resolve, reject) => {
@@ -178,3 +179,39 @@ export const toBlobURL = async (
   const blob = new Blob([buf], { type: mimeType });
   return URL.createObjectURL(blob);
 };
+
+/**
+ * parseProbeColumns wraps each column of ffprobe `-print_format bin` output
+ * in a typed array, without copying when data is 8 bytes aligned.
+ *
+ * Example:
+ *
+ * ```ts
+ * const { outputs: [data] } = await ffmpeg.ffprobe([
+ *   "-print_format", "bin", "-show_packets", "video.mp4",
+ * ]);
+ * const { pts, size } = parseProbeColumns(data as Uint8Array);
+ * ```
+ */
+export const parseProbeColumns = (data: Uint8Array): ProbeColumns => {
+  if (data.byteOffset % 8) data = data.slice();
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  if (data.byteLength < 16 || view.getUint32(0, true) !== PROBE_COLUMNS_MAGIC)
+    throw ERROR_INVALID_PROBE_COLUMNS;
+
+  const rows = view.getUint32(8, true);
+  const nbColumns = view.getUint32(12, true);
+  const columns: Record<string, BigInt64Array | Int32Array> = {};
+  let offset = data.byteOffset + 16 + nbColumns * 16;
+  for (let i = 0; i < nbColumns; i++) {
+    const desc = data.subarray(16 + i * 16, 16 + i * 16 + 12);
+    const name = new TextDecoder().decode(desc.subarray(0, desc.indexOf(0)));
+    const size = view.getUint32(16 + i * 16 + 12, true);
+    columns[name] =
+      size === 8
+        ? new BigInt64Array(data.buffer, offset, rows)
+        : new Int32Array(data.buffer, offset, rows);
+    offset += rows * size;
+  }
+  return columns as unknown as ProbeColumns;
+};
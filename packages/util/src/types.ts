@@ -7,3 +7,20 @@ export interface DownloadProgressEvent {
 }
 
 export type ProgressCallback = (event: DownloadProgressEvent) => void;
+
+/**
+ * Columns of ffprobe `-print_format bin` output, with one value per packet /
+ * frame. Missing timestamps are -2^63, other missing values are -1.
+ */
+export interface ProbeColumns {
+  pts: BigInt64Array;
+  dts: BigInt64Array;
+  duration: BigInt64Array;
+  pos: BigInt64Array;
+  size: Int32Array;
+  /** AV_PKT_FLAG_*, bit 0 is set for key frames */
+  flags: Int32Array;
+  stream: Int32Array;
+  /** 0 for packets, 1 for frames */
+  type: Int32Array;
+}
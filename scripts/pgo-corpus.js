@@ -0,0 +1,82 @@
+/**
+ * Run a fixed corpus of representative jobs with an instrumented ffmpeg-core
+ * (built with FFMPEG_PGO=generate) and save the collected raw profile.
+ *
+ * Inputs are generated with lavfi sources, so the corpus is the same for
+ * every build and doesn't require any asset.
+ *
+ * ex:
+ *     node scripts/pgo-corpus.js ./packages/core build/pgo/ffmpeg.profraw
+ */
+const fs = require("fs");
+const path = require("path");
+
+const PROFILE_PATH = "/default.profraw";
+
+/**
+ * Jobs are executed in order, later jobs use the outputs of earlier ones.
+ */
+const JOBS = [
+  // transcode
+  [
+    "-f", "lavfi", "-i", "testsrc2=size=1280x720:rate=30:duration=4",
+    "-f", "lavfi", "-i", "sine=frequency=440:sample_rate=48000:duration=4",
+    "-c:v", "libx264", "-preset", "veryfast", "-c:a", "aac", "-shortest",
+    "transcode.mp4",
+  ],
+  [
+    "-i", "transcode.mp4", "-vf", "scale=640:-2", "-c:v", "libx264",
+    "-c:a", "copy", "transcode-480p.mp4",
+  ],
+  [
+    "-i", "transcode.mp4", "-t", "2", "-c:v", "libvpx-vp9",
+    "-deadline", "realtime", "-cpu-used", "8", "-c:a", "libopus",
+    "transcode.webm",
+  ],
+  // thumbnail
+  ["-ss", "1", "-i", "transcode.mp4", "-frames:v", "1", "thumbnail.jpg"],
+  [
+    "-i", "transcode.webm", "-vf", "fps=1,scale=160:-2,tile=2x2",
+    "-frames:v", "1", "thumbnail.png",
+  ],
+  // remux
+  ["-i", "transcode.mp4", "-c", "copy", "remux.mkv"],
+  ["-i", "transcode.mp4", "-c", "copy", "-f", "mpegts", "remux.ts"],
+  ["-ss", "1", "-i", "remux.ts", "-t", "2", "-c", "copy", "remux.mp4"],
+  // audio
+  ["-i", "transcode.mp4", "-vn", "-c:a", "libmp3lame", "audio.mp3"],
+  ["-i", "audio.mp3", "-c:a", "libopus", "-b:a", "64k", "audio.opus"],
+  ["-i", "audio.opus", "-ac", "1", "-ar", "16000", "audio.wav"],
+  // decode only
+  ["-i", "transcode.webm", "-f", "null", "-"],
+];
+
+const main = async () => {
+  const [corePath, outputPath] = process.argv.slice(2);
+  if (!corePath || !outputPath) {
+    console.error("usage: node pgo-corpus.js <CORE_PATH> <OUTPUT_PATH>");
+    process.exit(1);
+  }
+
+  const createFFmpegCore = require(path.resolve(corePath));
+  const core = await createFFmpegCore();
+  if (!core.___llvm_profile_write_file) {
+    console.error(`${corePath} is not built with FFMPEG_PGO=generate`);
+    process.exit(1);
+  }
+
+  for (const args of JOBS) {
+    const start = Date.now();
+    const ret = core.exec(...args);
+    console.log(`[${ret}] ${Date.now() - start} ms: ffmpeg ${args.join(" ")}`);
+    core.reset();
+    if (ret !== 0) process.exit(1);
+  }
+
+  core.___llvm_profile_write_file();
+  fs.writeFileSync(outputPath, core.FS.readFile(PROFILE_PATH));
+  console.log(`profile saved to ${outputPath}`);
+  process.exit(0);
+};
+
+main();
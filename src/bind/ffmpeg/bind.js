@@ -5,10 +5,28 @@
 const NULL = 0;
 const SIZE_I32 = Uint32Array.BYTES_PER_ELEMENT;
 const DEFAULT_ARGS = ["./ffmpeg", "-nostdin", "-y"];
+const DEFAULT_PROBE_ARGS = ["./ffprobe", "-hide_banner", "-print_format", "json"];
+const DEFAULT_THUMBNAILS_ARGS = ["./thumbnails"];
+const DEFAULT_DECODE_AUDIO_ARGS = ["./decode_audio"];
+/**
+ * Side modules built with FFMPEG_MODULAR, and the codecs / filters requiring
+ * them. Each entry is loaded from ffmpeg-core-<name>.wasm the first time one
+ * of its codecs or filters is looked up.
+ */
+const SIDE_MODULES = {
+  x265: ["libx265"],
+  vpx: ["libvpx", "libvpx-vp9"],
+  ass: ["ass", "subtitles", "drawtext"],
+  zimg: ["zscale"],
+};
 
 Module["NULL"] = NULL;
 Module["SIZE_I32"] = SIZE_I32;
 Module["DEFAULT_ARGS"] = DEFAULT_ARGS;
+Module["DEFAULT_PROBE_ARGS"] = DEFAULT_PROBE_ARGS;
+Module["DEFAULT_THUMBNAILS_ARGS"] = DEFAULT_THUMBNAILS_ARGS;
+Module["DEFAULT_DECODE_AUDIO_ARGS"] = DEFAULT_DECODE_AUDIO_ARGS;
+Module["SIDE_MODULES"] = SIDE_MODULES;
 
 /**
  * Variables
@@ -18,6 +36,14 @@ Module["ret"] = -1;
 Module["timeout"] = -1;
 Module["logger"] = () => {};
 Module["progress"] = () => {};
+Module["stats"] = {};
+Module["probe"] = [];
+Module["peaks"] = null;
+Module["statsHandler"] = () => {};
+Module["frameHandler"] = () => {};
+Module["inputReader"] = () => -1;
+Module["audioHandler"] = () => {};
+Module["sideModules"] = {};
 
 /**
  * Functions
@@ -62,6 +88,90 @@ function exec(..._args) {
   return Module["ret"];
 }
 
+/**
+ * Runs ffprobe in the same core, the output of each input file is kept in
+ * Module["probe"] (as JSON unless -print_format is given). Passing several
+ * input files probes them in a batch.
+ */
+function ffprobe(..._args) {
+  const args = [...Module["DEFAULT_PROBE_ARGS"], ..._args];
+  Module["probe"] = [];
+  try {
+    Module["ret"] = Module["_ffprobe"](args.length, stringsToPtr(args));
+  } catch (e) {
+    if (!e.message.startsWith("Aborted")) {
+      throw e;
+    }
+  }
+  return Module["ret"];
+}
+
+/**
+ * Extracts thumbnails at several timestamps of one input in a single run,
+ * with one decoder, one scaler and one image encoder:
+ *
+ *   thumbnails("-i", "video.mp4", "-ts", "1,5,10", "-width", "320", "thumb-%d.jpg")
+ *
+ * Only keyframes are decoded unless -accurate is given.
+ */
+function thumbnails(..._args) {
+  const args = [...Module["DEFAULT_THUMBNAILS_ARGS"], ..._args];
+  try {
+    Module["ret"] = Module["_thumbnails"](args.length, stringsToPtr(args));
+  } catch (e) {
+    if (!e.message.startsWith("Aborted")) {
+      throw e;
+    }
+  }
+  return Module["ret"];
+}
+
+/**
+ * Decodes the audio of one input to float PCM, passed to the audio handler
+ * in chunks instead of written to a file:
+ *
+ *   decodeAudio("-i", "podcast.mp3", "-ar", "8000", "-ac", "1")
+ *
+ * Samples are interleaved unless -planar is given. With -peaks or -peak_rate
+ * only the min, max and RMS of each bucket are kept, in Module["peaks"].
+ */
+function decodeAudio(..._args) {
+  const args = [...Module["DEFAULT_DECODE_AUDIO_ARGS"], ..._args];
+  try {
+    Module["ret"] = Module["_decode_audio"](args.length, stringsToPtr(args));
+  } catch (e) {
+    if (!e.message.startsWith("Aborted")) {
+      throw e;
+    }
+  }
+  return Module["ret"];
+}
+
+/**
+ * Writes the side modules needed by any of the codecs or filters mentioned in
+ * names, which is a codec name or a filtergraph description, to the file
+ * system and returns their paths, they are then loaded with dlopen() by
+ * require_side_modules().
+ *
+ * Synchronous reading is possible as ffmpeg-core always runs in a web worker
+ * or in Node.js, where readBinary() does not require a Promise.
+ */
+function stageSideModules(names) {
+  // dlopen only works when ffmpeg-core is a MAIN_MODULE.
+  if (typeof loadDynamicLibrary === "undefined") return [];
+  const tokens = names.split(/[^\w-]+/);
+  const paths = [];
+  for (const [name, triggers] of Object.entries(SIDE_MODULES)) {
+    if (Module["sideModules"][name]) continue;
+    if (!triggers.some((trigger) => tokens.includes(trigger))) continue;
+    const path = `/ffmpeg-core-${name}.wasm`;
+    FS.writeFile(path, readBinary(locateFile(`ffmpeg-core-${name}.wasm`)));
+    Module["sideModules"][name] = true;
+    paths.push(path);
+  }
+  return paths;
+}
+
 function setLogger(logger) {
   Module["logger"] = logger;
 }
@@ -78,9 +188,80 @@ function receiveProgress(progress, time) {
   Module["progress"]({ progress, time });
 }
 
+function setStats(handler) {
+  Module["statsHandler"] = handler;
+}
+
+/**
+ * Receives a JSON document of one type of stats (ex. stages) from ffmpeg,
+ * stats are kept in Module["stats"] until reset().
+ */
+function receiveStats(type, json) {
+  Module["stats"][type] = JSON.parse(json);
+  Module["statsHandler"]({ type, stats: Module["stats"][type] });
+}
+
+function setFrameHandler(handler) {
+  Module["frameHandler"] = handler;
+}
+
+/**
+ * Receives a filtered frame of an output with -js_frames, planes are views
+ * over the wasm heap and must be copied if used after the handler returns.
+ * ffmpeg waits for the handler, which gives backpressure for free.
+ */
+function receiveFrame(frame) {
+  Module["frameHandler"](frame);
+}
+
+function setInputReader(reader) {
+  Module["inputReader"] = reader;
+}
+
+/**
+ * Reads up to size bytes of input js:name into the wasm heap at ptr, the
+ * reader blocks until data is available. Returns the number of bytes read,
+ * 0 at the end of the input or < 0 on error.
+ */
+function readInput(name, ptr, size) {
+  return Module["inputReader"](name, Module["HEAPU8"].subarray(ptr, ptr + size));
+}
+
+function setAudioHandler(handler) {
+  Module["audioHandler"] = handler;
+}
+
+/**
+ * Receives a chunk of decodeAudio(), data are views over the wasm heap and
+ * must be copied if used after the handler returns.
+ */
+function receiveAudio(chunk) {
+  Module["audioHandler"](chunk);
+}
+
+/**
+ * Receives the peaks of decodeAudio() with -peaks or -peak_rate, copied out
+ * of the wasm heap as they are kept until reset().
+ */
+function receivePeaks({ min, max, rms, ...peaks }) {
+  Module["peaks"] = {
+    ...peaks,
+    min: min.slice(),
+    max: max.slice(),
+    rms: rms.slice(),
+  };
+}
+
+function receiveProbeOutput(output) {
+  Module["probe"].push(output);
+}
+
 function reset() {
   Module["ret"] = -1;
   Module["timeout"] = -1;
+  Module["stats"] = {};
+  Module["probe"] = [];
+  Module["peaks"] = null;
 }
 
 /**
@@ -101,13 +282,21 @@ function reset() {
  *   http://example.com/ffmpeg-core.js#{btoa(JSON.stringify({"wasmURL": "...", "workerURL": "..."}))}
  *
  * Thus, we can successfully extract custom URLs using _locateFile funciton.
+ * The same applies to side modules of a modular build, whose URLs are derived
+ * from wasmURL unless given in sideModuleURLs.
  */
 function _locateFile(path, prefix) {
   const mainScriptUrlOrBlob = Module["mainScriptUrlOrBlob"];
   if (mainScriptUrlOrBlob) {
-    const { wasmURL, workerURL } = JSON.parse(
+    const { wasmURL, workerURL, sideModuleURLs = {} } = JSON.parse(
       atob(mainScriptUrlOrBlob.slice(mainScriptUrlOrBlob.lastIndexOf("#") + 1))
     );
+    const sideModule = path.match(/ffmpeg-core-(\w+)\.wasm$/);
+    if (sideModule)
+      return (
+        sideModuleURLs[sideModule[1]] ||
+        wasmURL.replace(/\.wasm$/, `-${sideModule[1]}.wasm`)
+      );
     if (path.endsWith(".wasm")) return wasmURL;
     if (path.endsWith(".worker.js")) return workerURL;
   }
@@ -119,10 +308,24 @@ Module["stringsToPtr"] = stringsToPtr;
 Module["print"] = print;
 Module["printErr"] = printErr;
 Module["locateFile"] = _locateFile;
+Module["stageSideModules"] = stageSideModules;
 
 Module["exec"] = exec;
+Module["ffprobe"] = ffprobe;
+Module["thumbnails"] = thumbnails;
+Module["decodeAudio"] = decodeAudio;
 Module["setLogger"] = setLogger;
 Module["setTimeout"] = setTimeout;
 Module["setProgress"] = setProgress;
+Module["setStats"] = setStats;
+Module["setFrameHandler"] = setFrameHandler;
+Module["setInputReader"] = setInputReader;
+Module["setAudioHandler"] = setAudioHandler;
 Module["reset"] = reset;
 Module["receiveProgress"] = receiveProgress;
+Module["receiveStats"] = receiveStats;
+Module["receiveFrame"] = receiveFrame;
+Module["readInput"] = readInput;
+Module["receiveAudio"] = receiveAudio;
+Module["receivePeaks"] = receivePeaks;
+Module["receiveProbeOutput"] = receiveProbeOutput;
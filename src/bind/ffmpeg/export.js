@@ -1,3 +1,8 @@
-const EXPORTED_FUNCTIONS = ["_ffmpeg", "_abort", "_malloc"];
+const EXPORTED_FUNCTIONS = ["_ffmpeg", "_ffprobe", "_thumbnails", "_decode_audio", "_abort", "_malloc"];
+
+// instrumented builds write the collected profile on demand, see `make prd-pgo`
+if (process.env.FFMPEG_PGO === "generate") {
+  EXPORTED_FUNCTIONS.push("___llvm_profile_write_file");
+}
 
 console.log(EXPORTED_FUNCTIONS.join(","));
@@ -0,0 +1,667 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Audio decoding to float PCM delivered to JS, run in the same core as
+ * ffmpeg:
+ *
+ *   decode_audio -i input.mp4 [-stream 1] [-ss 10] [-t 30] [-ar 44100]
+ *                [-ac 1] [-planar] [-chunk_size 65536]
+ *
+ * The audio stream is decoded, then resampled and downmixed by swresample
+ * straight into a buffer of -chunk_size samples per channel, which is sent
+ * to Module.receiveAudio() each time it is full. JS gets views over the
+ * wasm heap, so memory stays bounded however long the input is and nothing
+ * goes through MEMFS.
+ *
+ * Samples are interleaved (f32le) by default, or one plane per channel
+ * (as AudioBuffer.copyToChannel() expects) with -planar. -ss and -t are
+ * sample accurate.
+ *
+ * With -peaks N (N buckets over the whole output) or -peak_rate R (R
+ * buckets per second), chunks are reduced here to the min, max and RMS of
+ * each bucket and channel instead, and only those are sent to
+ * Module.receivePeaks() at the end, for waveform overviews of inputs too
+ * long to move their PCM to JS.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <emscripten.h>
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#include "cmdutils.h"
+#include "opt_common.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libswresample/swresample.h"
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+
+typedef struct DecodeContext {
+    AVFormatContext *ic;
+    AVStream *st;
+    AVCodecContext *dec;
+    SwrContext *swr;
+
+    AVPacket *pkt;
+    AVFrame *frame;
+
+    AVChannelLayout ch_layout;  ///< output channel layout
+    int sample_rate;            ///< output sample rate
+    int nb_planes;
+    int in_format, in_rate, in_channels;
+
+    float *buf;                 ///< plane i starts at buf + i * capacity
+    uint8_t **out;              ///< where swr_convert() writes next
+    int capacity;               ///< samples per channel of buf
+    int nb_buffered;            ///< samples per channel not sent yet
+
+    /* positions in output samples from the start of the stream */
+    int64_t pos;                ///< of the next converted sample
+    int64_t chunk_pos;          ///< of the first buffered sample
+    int64_t start, end;         ///< -ss and -ss + -t
+    double duration;            ///< expected output duration in seconds
+
+    int64_t nb_samples;
+    int nb_chunks;
+
+    /* -peaks / -peak_rate: min, max and sum of squares of bucket b and
+     * channel c at index b * channels + c */
+    int64_t bucket_size;        ///< samples per bucket
+    int64_t nb_reduced;         ///< samples reduced so far
+    float *peak_min;
+    float *peak_max;
+    double *peak_sum;
+    int nb_buckets;
+    int nb_buckets_allocated;
+} DecodeContext;
+
+static const char *input_filename;
+static int stream_index;
+static int64_t start_time;
+static int64_t duration;
+static int sample_rate;
+static int channels;
+static int planar;
+static int chunk_size;
+static int peaks;
+static double peak_rate;
+
+static DecodeContext decode;
+
+static int opt_input(void *optctx, const char *opt, const char *arg)
+{
+    if (input_filename) {
+        av_log(NULL, AV_LOG_ERROR, "Only one input file is supported\n");
+        return AVERROR(EINVAL);
+    }
+    input_filename = arg;
+    return 0;
+}
+
+static const OptionDef options[] = {
+    CMDUTILS_COMMON_OPTIONS
+    { "i",          HAS_ARG, { .func_arg = opt_input },
+        "input file", "filename" },
+    { "stream",     HAS_ARG | OPT_INT, { &stream_index },
+        "index of the audio stream, the best one by default", "index" },
+    { "ss",         HAS_ARG | OPT_TIME, { &start_time },
+        "start decoding at position", "time_off" },
+    { "t",          HAS_ARG | OPT_TIME, { &duration },
+        "decode only this duration", "duration" },
+    { "ar",         HAS_ARG | OPT_INT, { &sample_rate },
+        "output sample rate, the input one by default", "rate" },
+    { "ac",         HAS_ARG | OPT_INT, { &channels },
+        "output channels (downmixed), the input ones by default", "channels" },
+    { "planar",     OPT_BOOL, { &planar },
+        "send one plane per channel instead of interleaved samples" },
+    { "chunk_size", HAS_ARG | OPT_INT, { &chunk_size },
+        "samples per channel sent to JS at once", "samples" },
+    { "peaks",      HAS_ARG | OPT_INT, { &peaks },
+        "send the min, max and RMS of this many buckets instead of samples", "buckets" },
+    { "peak_rate",  HAS_ARG | OPT_DOUBLE, { &peak_rate },
+        "send the min, max and RMS of buckets of 1 / rate seconds", "rate" },
+    { NULL, },
+};
+
+static void init_globals(void)
+{
+    input_filename = NULL;
+    stream_index   = -1;
+    start_time     = 0;
+    duration       = INT64_MAX;
+    sample_rate    = 0;
+    channels       = 0;
+    planar         = 0;
+    chunk_size     = DEFAULT_CHUNK_SIZE;
+    peaks          = 0;
+    peak_rate      = 0;
+    memset(&decode, 0, sizeof(decode));
+}
+
+static void decode_audio_cleanup(int ret)
+{
+    DecodeContext *d = &decode;
+
+    av_frame_free(&d->frame);
+    av_packet_free(&d->pkt);
+    swr_free(&d->swr);
+    avcodec_free_context(&d->dec);
+    avformat_close_input(&d->ic);
+    av_channel_layout_uninit(&d->ch_layout);
+    av_freep(&d->buf);
+    av_freep(&d->out);
+    av_freep(&d->peak_min);
+    av_freep(&d->peak_max);
+    av_freep(&d->peak_sum);
+}
+
+/* send_audio passes a chunk to Module.receiveAudio(), data holds nb_planes
+ * planes of plane_size floats, of which nb_samples (times channels when
+ * interleaved) are valid. */
+EM_JS(void, send_audio, (const float *data, int nb_planes, int plane_size,
+                         int nb_samples, int channels, int sample_rate,
+                         double time, double duration), {
+    var planes = [];
+    var len = nb_planes > 1 ? nb_samples : nb_samples * channels;
+    for (var i = 0; i < nb_planes; i++) {
+        var offset = (data >> 2) + i * plane_size;
+        planes.push(HEAPF32.subarray(offset, offset + len));
+    }
+    Module.receiveAudio({
+        data: planes,
+        samples: nb_samples,
+        channels: channels,
+        sampleRate: sample_rate,
+        time: time,
+        duration: duration,
+    });
+});
+
+/* send_peaks passes the min, max and RMS of nb_buckets buckets of each
+ * channel to Module.receivePeaks(). */
+EM_JS(void, send_peaks, (const float *min, const float *max, const float *rms,
+                         int nb_buckets, int channels, double bucket_duration), {
+    var len = nb_buckets * channels;
+    Module.receivePeaks({
+        min: HEAPF32.subarray(min >> 2, (min >> 2) + len),
+        max: HEAPF32.subarray(max >> 2, (max >> 2) + len),
+        rms: HEAPF32.subarray(rms >> 2, (rms >> 2) + len),
+        buckets: nb_buckets,
+        channels: channels,
+        bucketDuration: bucket_duration,
+    });
+});
+
+/*
+ * Reduces n samples into the min, max and sum of squares of a bucket. The
+ * SIMD tiers handle four samples at a time, squares are summed in float
+ * per call and accumulated in double per bucket.
+ */
+static void reduce_peaks(const float *src, int n, float *pmin, float *pmax,
+                         double *psum)
+{
+    float min = *pmin, max = *pmax, sum = 0;
+    int i = 0;
+
+#if defined(__wasm_simd128__)
+    if (n >= 4) {
+        v128_t vmin = wasm_f32x4_splat(min);
+        v128_t vmax = wasm_f32x4_splat(max);
+        v128_t vsum = wasm_f32x4_splat(0);
+
+        for (; i <= n - 4; i += 4) {
+            v128_t v = wasm_v128_load(src + i);
+            vmin = wasm_f32x4_pmin(vmin, v);
+            vmax = wasm_f32x4_pmax(vmax, v);
+            vsum = wasm_f32x4_add(vsum, wasm_f32x4_mul(v, v));
+        }
+        /* fold lanes 2, 3 into 0, 1 then lane 1 into 0 */
+        vmin = wasm_f32x4_pmin(vmin, wasm_i32x4_shuffle(vmin, vmin, 2, 3, 0, 1));
+        vmax = wasm_f32x4_pmax(vmax, wasm_i32x4_shuffle(vmax, vmax, 2, 3, 0, 1));
+        vsum = wasm_f32x4_add(vsum, wasm_i32x4_shuffle(vsum, vsum, 2, 3, 0, 1));
+        vmin = wasm_f32x4_pmin(vmin, wasm_i32x4_shuffle(vmin, vmin, 1, 0, 3, 2));
+        vmax = wasm_f32x4_pmax(vmax, wasm_i32x4_shuffle(vmax, vmax, 1, 0, 3, 2));
+        vsum = wasm_f32x4_add(vsum, wasm_i32x4_shuffle(vsum, vsum, 1, 0, 3, 2));
+        min = wasm_f32x4_extract_lane(vmin, 0);
+        max = wasm_f32x4_extract_lane(vmax, 0);
+        sum = wasm_f32x4_extract_lane(vsum, 0);
+    }
+#endif
+    for (; i < n; i++) {
+        float v = src[i];
+        min  = FFMIN(min, v);
+        max  = FFMAX(max, v);
+        sum += v * v;
+    }
+
+    *pmin  = min;
+    *pmax  = max;
+    *psum += sum;
+}
+
+static int add_bucket(DecodeContext *d)
+{
+    int nb_channels = d->ch_layout.nb_channels;
+    int i, ret;
+
+    if (d->nb_buckets == d->nb_buckets_allocated) {
+        int nb = FFMAX(64, d->nb_buckets_allocated * 2) * nb_channels;
+        if ((ret = av_reallocp_array(&d->peak_min, nb, sizeof(*d->peak_min))) < 0 ||
+            (ret = av_reallocp_array(&d->peak_max, nb, sizeof(*d->peak_max))) < 0 ||
+            (ret = av_reallocp_array(&d->peak_sum, nb, sizeof(*d->peak_sum))) < 0)
+            return ret;
+        d->nb_buckets_allocated = nb / nb_channels;
+    }
+    for (i = d->nb_buckets * nb_channels; i < (d->nb_buckets + 1) * nb_channels; i++) {
+        d->peak_min[i] =  FLT_MAX;
+        d->peak_max[i] = -FLT_MAX;
+        d->peak_sum[i] = 0;
+    }
+    d->nb_buckets++;
+    return 0;
+}
+
+/* reduces buffered samples, runs of samples in the same bucket at once */
+static int reduce_chunk(DecodeContext *d)
+{
+    int nb_channels = d->ch_layout.nb_channels;
+    int i = 0, c, ret;
+
+    while (i < d->nb_buffered) {
+        int64_t pos = d->nb_reduced + i;
+        int64_t b = pos / d->bucket_size;
+        int n = FFMIN(d->nb_buffered - i, (b + 1) * d->bucket_size - pos);
+
+        while (b >= d->nb_buckets)
+            if ((ret = add_bucket(d)) < 0)
+                return ret;
+        for (c = 0; c < nb_channels; c++) {
+            int idx = b * nb_channels + c;
+            reduce_peaks(d->buf + c * d->capacity + i, n, &d->peak_min[idx],
+                         &d->peak_max[idx], &d->peak_sum[idx]);
+        }
+        i += n;
+    }
+    d->nb_reduced += d->nb_buffered;
+    return 0;
+}
+
+static int finish_peaks(DecodeContext *d)
+{
+    int nb_channels = d->ch_layout.nb_channels;
+    int nb = d->nb_buckets * nb_channels;
+    float *rms;
+    int i;
+
+    rms = av_malloc_array(FFMAX(nb, 1), sizeof(*rms));
+    if (!rms)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb; i++) {
+        int64_t b = i / nb_channels;
+        /* the last bucket may be shorter */
+        int64_t count = FFMIN(d->bucket_size, d->nb_reduced - b * d->bucket_size);
+        rms[i] = sqrt(d->peak_sum[i] / FFMAX(count, 1));
+    }
+    send_peaks(d->peak_min, d->peak_max, rms, d->nb_buckets, nb_channels,
+               (double)d->bucket_size / d->sample_rate);
+    av_free(rms);
+    return 0;
+}
+
+static int send_chunk(DecodeContext *d)
+{
+    int ret = 0;
+
+    if (!d->nb_buffered)
+        return 0;
+    if (d->bucket_size)
+        ret = reduce_chunk(d);
+    else
+        send_audio(d->buf, d->nb_planes, d->nb_planes > 1 ? d->capacity : 0,
+                   d->nb_buffered, d->ch_layout.nb_channels, d->sample_rate,
+                   (double)d->chunk_pos / d->sample_rate, d->duration);
+    d->chunk_pos  += d->nb_buffered;
+    d->nb_buffered = 0;
+    d->nb_chunks++;
+    return ret;
+}
+
+static int alloc_buffer(DecodeContext *d, int capacity)
+{
+    av_freep(&d->buf);
+    d->buf = av_malloc_array(capacity, d->ch_layout.nb_channels * sizeof(*d->buf));
+    if (!d->buf)
+        return AVERROR(ENOMEM);
+    d->capacity = capacity;
+    return 0;
+}
+
+/* points out at the first free sample of each plane */
+static void set_out(DecodeContext *d)
+{
+    int i;
+
+    if (d->nb_planes > 1)
+        for (i = 0; i < d->nb_planes; i++)
+            d->out[i] = (uint8_t *)(d->buf + i * d->capacity + d->nb_buffered);
+    else
+        d->out[0] = (uint8_t *)(d->buf + d->nb_buffered * d->ch_layout.nb_channels);
+}
+
+/*
+ * n samples were just converted after the buffered ones, keeps those
+ * between -ss and -ss + -t and sends the buffer once it holds -chunk_size
+ * samples.
+ */
+static int keep_samples(DecodeContext *d, int n)
+{
+    int nb_channels = d->ch_layout.nb_channels;
+    int64_t drop = av_clip64(d->start - d->pos, 0, n);
+    int64_t keep = FFMIN(n, d->end - d->pos) - drop;
+    int i;
+
+    d->pos += n;
+    if (keep <= 0)
+        return 0;
+
+    if (drop && d->nb_planes > 1) {
+        for (i = 0; i < d->nb_planes; i++) {
+            float *plane = d->buf + i * d->capacity + d->nb_buffered;
+            memmove(plane, plane + drop, keep * sizeof(*plane));
+        }
+    } else if (drop) {
+        float *samples = d->buf + d->nb_buffered * nb_channels;
+        memmove(samples, samples + drop * nb_channels,
+                keep * nb_channels * sizeof(*samples));
+    }
+
+    if (!d->nb_buffered)
+        d->chunk_pos = d->pos - n + drop;
+    d->nb_buffered += keep;
+    d->nb_samples  += keep;
+    return d->nb_buffered >= chunk_size ? send_chunk(d) : 0;
+}
+
+/* converts in_samples samples of in, or drains the resampler if in is NULL */
+static int convert(DecodeContext *d, const uint8_t **in, int in_samples)
+{
+    int need = swr_get_out_samples(d->swr, in_samples);
+    int n, ret;
+
+    if (need < 0)
+        return need;
+    if (d->nb_buffered + need > d->capacity) {
+        if ((ret = send_chunk(d)) < 0)
+            return ret;
+        /* a single frame may give more than -chunk_size samples */
+        if (need > d->capacity && (ret = alloc_buffer(d, need)) < 0)
+            return ret;
+    }
+
+    set_out(d);
+    n = swr_convert(d->swr, d->out, d->capacity - d->nb_buffered, in, in_samples);
+    if (n < 0)
+        return n;
+    if ((ret = keep_samples(d, n)) < 0)
+        return ret;
+    return n;
+}
+
+static int init_resampler(DecodeContext *d, const AVFrame *frame)
+{
+    AVChannelLayout in_layout = { 0 };
+    int64_t first = d->st->start_time != AV_NOPTS_VALUE ? d->st->start_time : 0;
+    int64_t pts = frame->best_effort_timestamp;
+    int ret;
+
+    /* swresample needs to know which channel is which to downmix */
+    if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
+        av_channel_layout_default(&in_layout, frame->ch_layout.nb_channels);
+    else if ((ret = av_channel_layout_copy(&in_layout, &frame->ch_layout)) < 0)
+        return ret;
+
+    if (channels > 0)
+        av_channel_layout_default(&d->ch_layout, channels);
+    else if ((ret = av_channel_layout_copy(&d->ch_layout, &in_layout)) < 0)
+        goto end;
+    d->sample_rate = sample_rate > 0 ? sample_rate : frame->sample_rate;
+    /* peaks are reduced one plane at a time */
+    d->nb_planes   = planar || peaks > 0 || peak_rate > 0 ? d->ch_layout.nb_channels : 1;
+    d->in_format   = frame->format;
+    d->in_rate     = frame->sample_rate;
+    d->in_channels = frame->ch_layout.nb_channels;
+
+    ret = swr_alloc_set_opts2(&d->swr, &d->ch_layout,
+                              d->nb_planes > 1 ? AV_SAMPLE_FMT_FLTP : AV_SAMPLE_FMT_FLT,
+                              d->sample_rate, &in_layout, frame->format,
+                              frame->sample_rate, 0, NULL);
+    if (ret < 0 || (ret = swr_init(d->swr)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error initializing the resampler: %s\n",
+               av_err2str(ret));
+        goto end;
+    }
+
+    d->out = av_calloc(d->nb_planes, sizeof(*d->out));
+    if (!d->out) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = alloc_buffer(d, chunk_size)) < 0)
+        goto end;
+
+    if (peak_rate > 0) {
+        d->bucket_size = FFMAX(1, lrint(d->sample_rate / peak_rate));
+    } else if (peaks > 0) {
+        if (isnan(d->duration)) {
+            av_log(NULL, AV_LOG_ERROR, "%s: unknown duration, use -peak_rate "
+                   "instead of -peaks\n", input_filename);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        d->bucket_size = FFMAX(1, ceil(d->duration * d->sample_rate / peaks));
+    }
+
+    /* the first frame may start before -ss, as seeking lands on a packet */
+    d->pos   = pts == AV_NOPTS_VALUE ? 0 :
+               av_rescale_q(pts - first, d->st->time_base,
+                            (AVRational){ 1, d->sample_rate });
+    d->start = av_rescale(start_time, d->sample_rate, AV_TIME_BASE);
+    d->end   = duration == INT64_MAX ? INT64_MAX :
+               d->start + av_rescale(duration, d->sample_rate, AV_TIME_BASE);
+
+end:
+    av_channel_layout_uninit(&in_layout);
+    return ret;
+}
+
+static int open_input(DecodeContext *d)
+{
+    const AVCodec *codec;
+    int64_t total;
+    int i, ret;
+
+    if ((ret = avformat_open_input(&d->ic, input_filename, NULL, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", input_filename, av_err2str(ret));
+        return ret;
+    }
+    if ((ret = avformat_find_stream_info(d->ic, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: could not find codec parameters\n",
+               input_filename);
+        return ret;
+    }
+
+    ret = av_find_best_stream(d->ic, AVMEDIA_TYPE_AUDIO, stream_index, -1, &codec, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: no audio stream to decode\n",
+               input_filename);
+        return ret;
+    }
+    d->st = d->ic->streams[ret];
+    for (i = 0; i < d->ic->nb_streams; i++)
+        if (i != d->st->index)
+            d->ic->streams[i]->discard = AVDISCARD_ALL;
+
+    d->dec = avcodec_alloc_context3(codec);
+    if (!d->dec)
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_to_context(d->dec, d->st->codecpar)) < 0)
+        return ret;
+    d->dec->pkt_timebase = d->st->time_base;
+    /* as many threads as cores in the MT core, if the decoder supports it */
+    d->dec->thread_count = 0;
+    if ((ret = avcodec_open2(d->dec, codec, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error opening decoder %s: %s\n",
+               codec->name, av_err2str(ret));
+        return ret;
+    }
+
+    if (start_time > 0) {
+        int64_t ts = start_time +
+                     (d->ic->start_time != AV_NOPTS_VALUE ? d->ic->start_time : 0);
+        ret = avformat_seek_file(d->ic, -1, INT64_MIN, ts, ts, 0);
+        if (ret < 0)
+            av_log(NULL, AV_LOG_WARNING, "%s: could not seek to position %0.3f, "
+                   "decoding from the start\n", input_filename,
+                   (double)start_time / AV_TIME_BASE);
+    }
+
+    /* sent along with chunks, so JS can allocate the whole output once */
+    total = d->st->duration != AV_NOPTS_VALUE ?
+            av_rescale_q(d->st->duration, d->st->time_base, AV_TIME_BASE_Q) :
+            d->ic->duration;
+    d->duration = total == AV_NOPTS_VALUE ? NAN :
+                  (double)FFMIN(FFMAX(total - start_time, 0), duration) / AV_TIME_BASE;
+    return 0;
+}
+
+static int receive_frames(DecodeContext *d)
+{
+    AVFrame *frame = d->frame;
+    int ret;
+
+    while ((ret = avcodec_receive_frame(d->dec, frame)) >= 0) {
+        if (!d->swr && (ret = init_resampler(d, frame)) < 0)
+            return ret;
+        if (frame->format != d->in_format || frame->sample_rate != d->in_rate ||
+            frame->ch_layout.nb_channels != d->in_channels) {
+            av_log(NULL, AV_LOG_ERROR, "Audio parameters changed mid-stream\n");
+            return AVERROR_INPUT_CHANGED;
+        }
+        ret = convert(d, (const uint8_t **)frame->extended_data, frame->nb_samples);
+        av_frame_unref(frame);
+        if (ret < 0)
+            return ret;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int decode_stream(DecodeContext *d)
+{
+    int ret = 0;
+
+    d->end = INT64_MAX;
+    while (d->pos < d->end) {
+        ret = av_read_frame(d->ic, d->pkt);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            return ret;
+        if (d->pkt->stream_index != d->st->index) {
+            av_packet_unref(d->pkt);
+            continue;
+        }
+
+        ret = avcodec_send_packet(d->dec, d->pkt);
+        av_packet_unref(d->pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN))
+            av_log(NULL, AV_LOG_WARNING, "Error decoding packet: %s\n",
+                   av_err2str(ret));
+        if ((ret = receive_frames(d)) < 0)
+            return ret;
+    }
+
+    avcodec_send_packet(d->dec, NULL);
+    if ((ret = receive_frames(d)) < 0)
+        return ret;
+    /* samples still buffered in the resampler */
+    while (d->swr && (ret = convert(d, NULL, 0)) > 0)
+        ;
+    if (ret < 0)
+        return ret;
+    if ((ret = send_chunk(d)) < 0)
+        return ret;
+    return d->bucket_size ? finish_peaks(d) : 0;
+}
+
+int decode_audio(int argc, char **argv)
+{
+    DecodeContext *d = &decode;
+    int ret;
+
+    init_globals();
+    init_dynload();
+    register_exit(decode_audio_cleanup);
+
+    parse_loglevel(argc, argv, options);
+    parse_options(NULL, argc, argv, options, NULL);
+
+    if (!input_filename) {
+        av_log(NULL, AV_LOG_ERROR, "usage: decode_audio -i input [options]\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+    if (chunk_size <= 0 || channels < 0 || sample_rate < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid -chunk_size, -ac or -ar\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    d->pkt   = av_packet_alloc();
+    d->frame = av_frame_alloc();
+    if (!d->pkt || !d->frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    if ((ret = open_input(d)) < 0)
+        goto end;
+    if ((ret = decode_stream(d)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error decoding audio: %s\n", av_err2str(ret));
+        goto end;
+    }
+    av_log(NULL, AV_LOG_INFO, "%"PRId64" samples at %d Hz in %d chunks\n",
+           d->nb_samples, d->sample_rate, d->nb_chunks);
+
+end:
+    decode_audio_cleanup(ret);
+    uninit_opts();
+    return ret < 0;
+}
@@ -33,6 +33,8 @@
 #include <stdatomic.h>
 #include <stdint.h>
 #include <emscripten.h>
+#include <emscripten/heap.h>
+#include <dlfcn.h>
 
 #if HAVE_IO_H
 #include <io.h>
@@ -126,10 +128,14 @@ typedef struct BenchmarkTimeStamps {
     int64_t real_usec;
     int64_t user_usec;
     int64_t sys_usec;
+    int64_t busy_usec; ///< wall time spent in pipeline stages, not CPU time
 } BenchmarkTimeStamps;
 
 static BenchmarkTimeStamps get_benchmark_time_stamps(void);
 static int64_t getmaxrss(void);
+static void send_resource_stats(void);
+static void send_filter_stats(void);
+static void send_muxing_queue_stats(void);
 static int ifilter_has_all_input_formats(FilterGraph *fg);
 
 static int64_t nb_frames_dup = 0;
@@ -141,6 +147,38 @@ unsigned nb_output_dumped = 0;
 int want_sdp = 1;
 
 static BenchmarkTimeStamps current_time;
+static BenchmarkTimeStamps start_time;
+int64_t stage_busy_time = 0;
+
+/* high-water marks of resources sampled by sample_resources() */
+static int64_t sbrk_high_water = 0;
+static int pool_threads_used = 0;
+
+/* memfs_used_bytes returns the size of all files in MEMFS. */
+EM_JS(double, memfs_used_bytes, (void), {
+    var size = function(node) {
+        if (node.mount.type !== MEMFS) return 0;
+        if (FS.isFile(node.mode)) return node.usedBytes || 0;
+        if (!FS.isDir(node.mode)) return 0;
+        var total = 0;
+        for (var name in node.contents) total += size(node.contents[name]);
+        return total;
+    };
+    return size(FS.root);
+});
+
+/* pthread_pool_running returns the number of pool workers running a thread,
+ * always 0 for single thread builds. */
+EM_JS(int, pthread_pool_running, (void), {
+    return typeof PThread !== "undefined" ? PThread.runningWorkers.length : 0;
+});
+
+static void sample_resources(void)
+{
+    sbrk_high_water   = FFMAX(sbrk_high_water, (intptr_t)sbrk(0));
+    pool_threads_used = FFMAX(pool_threads_used, pthread_pool_running());
+}
+
 AVIOContext *progress_avio = NULL;
 
 static uint8_t *subtitle_out;
@@ -519,7 +557,13 @@ static void ffmpeg_cleanup(int ret)
     if (do_benchmark) {
         int maxrss = getmaxrss() / 1024;
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
+        av_log(NULL, AV_LOG_INFO, "bench: heap=%ikB memfs=%ikB threads=%d\n",
+               (int)(emscripten_get_heap_size() / 1024),
+               (int)(memfs_used_bytes() / 1024), pool_threads_used);
     }
+    send_resource_stats();
+    send_filter_stats();
+    send_muxing_queue_stats();
 
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
@@ -563,6 +607,8 @@ static void ffmpeg_cleanup(int ret)
 
     av_freep(&subtitle_out);
 
+    sched_uninit();
+
     /* close files */
     for (i = 0; i < nb_output_files; i++)
         of_close(&output_files[i]);
@@ -578,6 +624,7 @@ static void ffmpeg_cleanup(int ret)
         av_frame_free(&ost->filtered_frame);
         av_frame_free(&ost->last_frame);
         av_packet_free(&ost->pkt);
+        smart_cut_free(&ost->smart_cut);
         av_dict_free(&ost->encoder_opts);
 
         av_freep(&ost->forced_keyframes);
@@ -594,20 +641,19 @@ static void ffmpeg_cleanup(int ret)
         avcodec_free_context(&ost->enc_ctx);
         avcodec_parameters_free(&ost->ref_par);
 
-        if (ost->muxing_queue) {
-            AVPacket *pkt;
-            while (av_fifo_read(ost->muxing_queue, &pkt, 1) >= 0)
-                av_packet_free(&pkt);
-            av_fifo_freep2(&ost->muxing_queue);
-        }
-
         av_freep(&output_streams[i]);
     }
 #if HAVE_THREADS
     free_input_threads();
 #endif
     for (i = 0; i < nb_input_files; i++) {
+        seek_index_close(&input_files[i]->seek_index, input_files[i]->ctx);
         avformat_close_input(&input_files[i]->ctx);
+        if (input_files[i]->js_pb) {
+            av_freep(&input_files[i]->js_pb->opaque);
+            av_freep(&input_files[i]->js_pb->buffer);
+            avio_context_free(&input_files[i]->js_pb);
+        }
         av_packet_free(&input_files[i]->pkt);
         av_freep(&input_files[i]);
     }
@@ -635,6 +681,9 @@ static void ffmpeg_cleanup(int ret)
                    av_err2str(AVERROR(errno)));
     }
     av_freep(&vstats_filename);
+    if (trace_enabled)
+        trace_uninit(trace_filename);
+    av_freep(&trace_filename);
     av_freep(&filter_nbthreads);
 
     av_freep(&input_streams);
@@ -690,17 +739,24 @@ static void update_benchmark(const char *fmt, ...)
             va_start(va, fmt);
             vsnprintf(buf, sizeof(buf), fmt, va);
             va_end(va);
+#if defined(__EMSCRIPTEN__)
+            av_log(NULL, AV_LOG_INFO,
+                   "bench: %8" PRIu64 " busy %8" PRIu64 " real %s \n",
+                   t.busy_usec - current_time.busy_usec,
+                   t.real_usec - current_time.real_usec, buf);
+#else
             av_log(NULL, AV_LOG_INFO,
                    "bench: %8" PRIu64 " user %8" PRIu64 " sys %8" PRIu64 " real %s \n",
                    t.user_usec - current_time.user_usec,
                    t.sys_usec - current_time.sys_usec,
                    t.real_usec - current_time.real_usec, buf);
+#endif
         }
         current_time = t;
     }
 }
 
-static void close_output_stream(OutputStream *ost)
+void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
     AVRational time_base = ost->stream_copy ? ost->mux_timebase : ost->enc_ctx->time_base;
@@ -896,6 +952,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     AVPacket         *pkt = ost->pkt;
     const char *type_desc = av_get_media_type_string(enc->codec_type);
     const char    *action = frame ? "encode" : "flush";
+    int64_t timer;
     int ret;
 
     if (frame) {
@@ -911,6 +968,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
     }
 
     update_benchmark(NULL);
+    timer = av_gettime_relative();
 
     ret = avcodec_send_frame(enc, frame);
     if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
@@ -923,6 +981,10 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
         ret = avcodec_receive_packet(enc, pkt);
         update_benchmark("%s_%s %d.%d", action, type_desc,
                          ost->file_index, ost->index);
+        stage_timer_update(ost->stage_timers, STAGE_ENCODE,
+                           ost->file_index, ost->index, timer,
+                           ret != AVERROR(EAGAIN),
+                           ret >= 0 ? pkt->pts : AV_NOPTS_VALUE, enc->time_base);
 
         /* if two pass, output log on success and EOF */
         if ((ret >= 0 || ret == AVERROR_EOF) && ost->logfile && enc->stats_out)
@@ -967,6 +1029,7 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
         ost->packets_encoded++;
 
         output_packet(of, pkt, ost, 0);
+        timer = av_gettime_relative();
     }
 
     av_assert0(0);
@@ -1075,6 +1138,128 @@ static void do_subtitle_out(OutputFile *of,
     }
 }
 
+/* send_frame calls Module.receiveFrame with the planes of a frame as
+ * views over the wasm heap, which are only valid during the call. Planes
+ * after the last of sizes have the same size, ex. planar audio.
+ */
+EM_JS(void, send_frame, (int file_index, int stream_index, const char *type,
+                         const char *format, int width, int height,
+                         int sample_rate, int channels, int nb_samples,
+                         double pts, int tb_num, int tb_den, int nb_planes,
+                         uint8_t *const *data, const int *sizes, int nb_sizes,
+                         const int *linesizes), {
+    var planes = [];
+    var strides = [];
+    for (var i = 0; i < nb_planes; i++) {
+        var ptr = HEAPU32[(data >> 2) + i];
+        var size = HEAP32[(sizes >> 2) + Math.min(i, nb_sizes - 1)];
+        planes.push(HEAPU8.subarray(ptr, ptr + size));
+        strides.push(linesizes ? HEAP32[(linesizes >> 2) + i] : size);
+    }
+    Module.receiveFrame({
+        file: file_index,
+        stream: stream_index,
+        type: UTF8ToString(type),
+        format: UTF8ToString(format),
+        width: width,
+        height: height,
+        sampleRate: sample_rate,
+        channels: channels,
+        samples: nb_samples,
+        pts: pts,
+        timeBase: [tb_num, tb_den],
+        time: pts * tb_num / tb_den,
+        planes: planes,
+        linesizes: strides,
+    });
+});
+
+/*
+ * do_js_out sends a filtered frame of an output with -js_frames to JS
+ * instead of encoding it. The filtergraph runs as usual, so -frames, -t
+ * and the fps / format / scale filters apply, but there is no vsync:
+ * frames are sent as they leave the filtergraph.
+ */
+static void do_js_out(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    AVFrame *tmp = NULL;
+    int sizes[4], linesizes[4];
+    int i, nb_planes = 0, nb_sizes = 0;
+
+    init_output_stream_wrapper(ost, frame, 1);
+    adjust_frame_pts_to_encoder_tb(of, ost, frame);
+    if (frame->pts != AV_NOPTS_VALUE)
+        ost->sync_opts = frame->pts;
+    if (!check_recording_time(ost))
+        return;
+    /* frames reaped before the file is closed by sched_need_output() */
+    if (ost->frame_number >= ost->max_frames)
+        return;
+
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+        size_t plane_sizes[4];
+        ptrdiff_t strides[4];
+
+        /* planes are sent as contiguous bytes, ex. vflip outputs negative
+         * linesizes */
+        if (frame->linesize[0] < 0) {
+            tmp = av_frame_alloc();
+            if (!tmp)
+                exit_program(1);
+            tmp->format = frame->format;
+            tmp->width  = frame->width;
+            tmp->height = frame->height;
+            if (av_frame_get_buffer(tmp, 0) < 0 || av_frame_copy(tmp, frame) < 0 ||
+                av_frame_copy_props(tmp, frame) < 0)
+                exit_program(1);
+            frame = tmp;
+        }
+
+        for (i = 0; i < 4; i++)
+            strides[i] = frame->linesize[i];
+        if (av_image_fill_plane_sizes(plane_sizes, frame->format, frame->height,
+                                      strides) < 0)
+            exit_program(1);
+        for (i = 0; i < 4 && frame->data[i]; i++) {
+            sizes[i]     = plane_sizes[i];
+            linesizes[i] = frame->linesize[i];
+            ost->data_size += sizes[i];
+        }
+        nb_planes = nb_sizes = i;
+
+        send_frame(of->index, ost->index, "video",
+                   av_get_pix_fmt_name(frame->format), frame->width, frame->height,
+                   0, 0, 0, frame->pts == AV_NOPTS_VALUE ? NAN : frame->pts,
+                   enc->time_base.num, enc->time_base.den,
+                   nb_planes, frame->data, sizes, nb_sizes, linesizes);
+    } else {
+        int channels = frame->ch_layout.nb_channels;
+        int planar   = av_sample_fmt_is_planar(frame->format);
+
+        nb_planes = planar ? channels : 1;
+        nb_sizes  = 1;
+        sizes[0]  = frame->nb_samples * av_get_bytes_per_sample(frame->format) *
+                    (planar ? 1 : channels);
+        ost->data_size       += (int64_t)sizes[0] * nb_planes;
+        ost->samples_encoded += frame->nb_samples;
+
+        send_frame(of->index, ost->index, "audio",
+                   av_get_sample_fmt_name(frame->format), 0, 0,
+                   frame->sample_rate, channels, frame->nb_samples,
+                   frame->pts == AV_NOPTS_VALUE ? NAN : frame->pts,
+                   enc->time_base.num, enc->time_base.den,
+                   nb_planes, frame->extended_data, sizes, nb_sizes, NULL);
+    }
+    av_frame_free(&tmp);
+
+    ost->frames_encoded++;
+    ost->packets_written++;
+    ost->frame_number++;
+    if (ost->frame_number >= ost->max_frames)
+        sched_max_frames(ost);
+}
+
 /* May modify/reset next_picture */
 static void do_video_out(OutputFile *of,
                          OutputStream *ost,
@@ -1285,6 +1470,8 @@ static void do_video_out(OutputFile *of,
 
         ost->sync_opts++;
         ost->frame_number++;
+        if (ost->frame_number >= ost->max_frames)
+            sched_max_frames(ost);
     }
 
     av_frame_unref(ost->last_frame);
@@ -1343,14 +1530,21 @@ static int reap_filters(int flush)
         filtered_frame = ost->filtered_frame;
 
         while (1) {
+            int64_t timer = av_gettime_relative();
             ret = av_buffersink_get_frame_flags(filter, filtered_frame,
                                                AV_BUFFERSINK_FLAG_NO_REQUEST);
+            ost->filter->graph->process_time +=
+                stage_timer_update(ost->stage_timers, STAGE_FILTER_REAP,
+                                   ost->file_index, ost->index, timer, ret >= 0,
+                                   ret >= 0 ? filtered_frame->pts : AV_NOPTS_VALUE,
+                                   av_buffersink_get_time_base(filter)) - timer;
             if (ret < 0) {
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
                     av_log(NULL, AV_LOG_WARNING,
                            "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
                 } else if (flush && ret == AVERROR_EOF) {
-                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
+                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO &&
+                        !of->js_frames)
                         do_video_out(of, ost, NULL);
                 }
                 break;
@@ -1359,6 +1553,11 @@ static int reap_filters(int flush)
                 av_frame_unref(filtered_frame);
                 continue;
             }
+            if (of->js_frames) {
+                do_js_out(of, ost, filtered_frame);
+                av_frame_unref(filtered_frame);
+                continue;
+            }
 
             switch (av_buffersink_get_type(filter)) {
             case AVMEDIA_TYPE_VIDEO:
@@ -1509,11 +1708,211 @@ EM_JS(void, send_progress, (double progress, double time), {
     Module.receiveProgress(progress, time);
 });
 
+/* stage_side_modules writes the side modules (see FFMPEG_MODULAR) providing
+ * any of the codecs or filters named in names to the file system, their paths
+ * are stored in paths separated by '\n'.
+ */
+EM_JS(int, stage_side_modules, (const char *names, char *paths, int size), {
+    return stringToUTF8(Module.stageSideModules(UTF8ToString(names)).join("\n"),
+                        paths, size);
+});
+
+/* require_side_modules loads the side modules providing any of the codecs or
+ * filters named in names, which can be a single codec name or a whole
+ * filtergraph description. It is a no-op when all libraries are linked into
+ * ffmpeg-core.wasm, returns the number of modules loaded.
+ *
+ * Modules are loaded with dlopen() instead of from JS, so that with threads
+ * Emscripten also loads them in every worker (ex. frame threads of a decoder).
+ */
+int require_side_modules(const char *names)
+{
+    char paths[1024], *path, *next;
+    int loaded = 0;
+
+    if (!stage_side_modules(names, paths, sizeof(paths)))
+        return 0;
+    for (path = paths; path; path = next) {
+        if ((next = strchr(path, '\n')))
+            *next++ = 0;
+        if (!dlopen(path, RTLD_NOW | RTLD_GLOBAL)) {
+            av_log(NULL, AV_LOG_FATAL, "Error loading side module %s: %s\n",
+                   path, dlerror());
+            exit_program(1);
+        }
+        loaded++;
+    }
+    return loaded;
+}
+
+/* send_stats publishes a JSON document as Module.stats[type], so it can be
+ * read from JS during (ex. in the progress callback) and after exec.
+ */
+EM_JS(void, send_stats, (const char *type, const char *json), {
+    Module.receiveStats(UTF8ToString(type), UTF8ToString(json));
+});
+
+static const char *const stage_names[STAGE_NB] = {
+    [STAGE_DEMUX]       = "demux",
+    [STAGE_DECODE]      = "decode",
+    [STAGE_FILTER_SEND] = "filter_send",
+    [STAGE_FILTER_REAP] = "filter_reap",
+    [STAGE_ENCODE]      = "encode",
+    [STAGE_MUX]         = "mux",
+};
+
+static void bprint_stage_timers(AVBPrint *buf, int file_index, AVStream *st,
+                                const StageTimer *timers,
+                                enum StageTimerID first, enum StageTimerID last)
+{
+    const char *type = av_get_media_type_string(st->codecpar->codec_type);
+    int i;
+
+    av_bprintf(buf, "{\"file\":%d,\"stream\":%d,\"type\":\"%s\"",
+               file_index, st->index, type ? type : "unknown");
+    for (i = first; i <= last; i++)
+        av_bprintf(buf, ",\"%s\":{\"time\":%"PRId64",\"count\":%"PRIu64"}",
+                   stage_names[i], timers[i].time, timers[i].count);
+    av_bprintf(buf, "}");
+}
+
+/* send_stage_stats publishes the stage timers of all streams as
+ * Module.stats.stages = { inputs: [...], outputs: [...] }, times are in
+ * microseconds.
+ */
+static void send_stage_stats(void)
+{
+    AVBPrint buf;
+    int i;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&buf, "{\"inputs\":[");
+    for (i = 0; i < nb_input_streams; i++) {
+        InputStream *ist = input_streams[i];
+        if (i)
+            av_bprintf(&buf, ",");
+        bprint_stage_timers(&buf, ist->file_index, ist->st, ist->stage_timers,
+                            STAGE_DEMUX, STAGE_FILTER_SEND);
+    }
+    av_bprintf(&buf, "],\"outputs\":[");
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        if (i)
+            av_bprintf(&buf, ",");
+        bprint_stage_timers(&buf, ost->file_index, ost->st, ost->stage_timers,
+                            STAGE_FILTER_REAP, STAGE_MUX);
+    }
+    av_bprintf(&buf, "]}");
+
+    if (av_bprint_is_complete(&buf))
+        send_stats("stages", buf.str);
+    av_bprint_finalize(&buf, NULL);
+}
+
+/* send_probe_stats publishes how long opening each input file took as
+ * Module.stats.probe, times are in microseconds.
+ */
+static void send_probe_stats(void)
+{
+    AVBPrint buf;
+    int i;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&buf, "{\"inputs\":[");
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        av_bprintf(&buf, "%s{\"file\":%d,\"format\":\"%s\",\"fast_probe\":%s,"
+                   "\"header_probe\":%s,"
+                   "\"open\":%"PRId64",\"find_stream_info\":%"PRId64"}",
+                   i ? "," : "", i, f->ctx->iformat->name,
+                   f->fast_probe ? "true" : "false",
+                   f->header_probe ? "true" : "false",
+                   f->open_time, f->find_stream_info_time);
+    }
+    av_bprintf(&buf, "]}");
+
+    if (av_bprint_is_complete(&buf))
+        send_stats("probe", buf.str);
+    av_bprint_finalize(&buf, NULL);
+}
+
+/* send_filter_stats publishes the filters of all filtergraphs, with the
+ * formats and frame counts of their links, as Module.stats.filters.
+ */
+static void send_filter_stats(void)
+{
+    AVBPrint buf;
+    int i;
+
+    if (!nb_filtergraphs)
+        return;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&buf, "{\"graphs\":[");
+    for (i = 0; i < nb_filtergraphs; i++) {
+        if (i)
+            av_bprintf(&buf, ",");
+        filtergraph_bprint_profile(&buf, filtergraphs[i]);
+    }
+    av_bprintf(&buf, "]}");
+
+    if (av_bprint_is_complete(&buf))
+        send_stats("filters", buf.str);
+    av_bprint_finalize(&buf, NULL);
+}
+
+/* send_muxing_queue_stats publishes the occupancy of the queues buffering
+ * packets until each output file is initialized as Module.stats.muxing_queue,
+ * sizes are in bytes.
+ */
+static void send_muxing_queue_stats(void)
+{
+    AVBPrint buf;
+    int i;
+
+    if (!nb_output_files)
+        return;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&buf, "{\"outputs\":[");
+    for (i = 0; i < nb_output_files; i++) {
+        if (i)
+            av_bprintf(&buf, ",");
+        of_bprint_muxing_queue(&buf, output_files[i]);
+    }
+    av_bprintf(&buf, "]}");
+
+    if (av_bprint_is_complete(&buf))
+        send_stats("muxing_queue", buf.str);
+    av_bprint_finalize(&buf, NULL);
+}
+
+/* send_resource_stats publishes resource usage of the exec as
+ * Module.stats.resources, times are in microseconds and sizes in bytes.
+ */
+static void send_resource_stats(void)
+{
+    BenchmarkTimeStamps t = get_benchmark_time_stamps();
+    char json[512];
+
+    sample_resources();
+    if (!start_time.real_usec)
+        start_time = t;
+    snprintf(json, sizeof(json),
+             "{\"busy_time\":%"PRId64",\"rtime\":%"PRId64","
+             "\"heap_size\":%zu,\"sbrk_high_water\":%"PRId64","
+             "\"memfs_bytes\":%.0f,\"pool_threads\":%d}",
+             t.busy_usec - start_time.busy_usec,
+             t.real_usec - start_time.real_usec,
+             emscripten_get_heap_size(), sbrk_high_water,
+             memfs_used_bytes(), pool_threads_used);
+    send_stats("resources", json);
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     AVBPrint buf, buf_script;
     OutputStream *ost;
-    AVFormatContext *oc;
     int64_t total_size;
     AVCodecContext *enc;
     int vid, i;
@@ -1544,11 +1943,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     t = (cur_time-timer_start) / 1000000.0;
 
 
-    oc = output_files[0]->ctx;
-
-    total_size = avio_size(oc->pb);
-    if (total_size <= 0) // FIXME improve avio_size() so it works with non seekable output too
-        total_size = avio_tell(oc->pb);
+    /* a mux thread may be writing the file */
+    total_size = of_filesize(output_files[0]);
 
     vid = 0;
     av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
@@ -1650,6 +2046,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         duration = file_duration;
       }
     }
+    sample_resources();
+    send_stage_stats();
+    send_muxing_queue_stats();
     send_progress((double)pts_abs / (double)duration, (double)pts_abs);
 
     secs = FFABS(pts) / AV_TIME_BASE;
@@ -1808,6 +2207,9 @@ static void flush_encoders(void)
 
         if (enc->codec_type != AVMEDIA_TYPE_VIDEO && enc->codec_type != AVMEDIA_TYPE_AUDIO)
             continue;
+        /* the encoder was never opened, see do_js_out() */
+        if (of->js_frames)
+            continue;
 
         ret = encode_frame(of, ost, NULL);
         if (ret != AVERROR_EOF)
@@ -1835,24 +2237,17 @@ static int check_output_constraints(InputStream *ist, OutputStream *ost)
     return 1;
 }
 
-static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *pkt)
+/* Return 1 when pkt of ist is to be copied to ost, 0 when it is dropped
+ * because it comes before the start or after the end of the output. */
+static int streamcopy_check(InputStream *ist, OutputStream *ost, const AVPacket *pkt)
 {
     OutputFile *of = output_files[ost->file_index];
     InputFile   *f = input_files [ist->file_index];
     int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
-    int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->mux_timebase);
-    AVPacket *opkt = ost->pkt;
-
-    av_packet_unref(opkt);
-    // EOF: flush output bitstream filters.
-    if (!pkt) {
-        output_packet(of, opkt, ost, 1);
-        return;
-    }
 
     if (!ost->streamcopy_started && !(pkt->flags & AV_PKT_FLAG_KEY) &&
         !ost->copy_initial_nonkeyframes)
-        return;
+        return 0;
 
     if (!ost->streamcopy_started && !ost->copy_prior_start) {
         int64_t comp_start = start_time;
@@ -1861,13 +2256,13 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
         if (pkt->pts == AV_NOPTS_VALUE ?
             ist->pts < comp_start :
             pkt->pts < av_rescale_q(comp_start, AV_TIME_BASE_Q, ist->st->time_base))
-            return;
+            return 0;
     }
 
     if (of->recording_time != INT64_MAX &&
         ist->pts >= of->recording_time + start_time) {
         close_output_stream(ost);
-        return;
+        return 0;
     }
 
     if (f->recording_time != INT64_MAX) {
@@ -1878,32 +2273,39 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
         }
         if (ist->pts >= f->recording_time + start_time) {
             close_output_stream(ost);
-            return;
+            return 0;
         }
     }
+    return 1;
+}
 
-    if (av_packet_ref(opkt, pkt) < 0)
-        exit_program(1);
+/* Rescale the timestamps of opkt, a packet of ist, in place from the input
+ * stream time base to the muxing time base of ost, then send it. */
+void streamcopy_output(InputStream *ist, OutputStream *ost, AVPacket *opkt)
+{
+    OutputFile *of = output_files[ost->file_index];
+    int64_t start_time = (of->start_time == AV_NOPTS_VALUE) ? 0 : of->start_time;
+    int64_t ost_tb_start_time = av_rescale_q(start_time, AV_TIME_BASE_Q, ost->mux_timebase);
 
-    if (pkt->pts != AV_NOPTS_VALUE)
-        opkt->pts = av_rescale_q(pkt->pts, ist->st->time_base, ost->mux_timebase) - ost_tb_start_time;
+    if (opkt->pts != AV_NOPTS_VALUE)
+        opkt->pts = av_rescale_q(opkt->pts, ist->st->time_base, ost->mux_timebase) - ost_tb_start_time;
 
-    if (pkt->dts == AV_NOPTS_VALUE) {
+    if (opkt->dts == AV_NOPTS_VALUE) {
         opkt->dts = av_rescale_q(ist->dts, AV_TIME_BASE_Q, ost->mux_timebase);
     } else if (ost->st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-        int duration = av_get_audio_frame_duration(ist->dec_ctx, pkt->size);
+        int duration = av_get_audio_frame_duration(ist->dec_ctx, opkt->size);
         if(!duration)
             duration = ist->dec_ctx->frame_size;
-        opkt->dts = av_rescale_delta(ist->st->time_base, pkt->dts,
+        opkt->dts = av_rescale_delta(ist->st->time_base, opkt->dts,
                                     (AVRational){1, ist->dec_ctx->sample_rate}, duration,
                                     &ist->filter_in_rescale_delta_last, ost->mux_timebase);
         /* dts will be set immediately afterwards to what pts is now */
         opkt->pts = opkt->dts - ost_tb_start_time;
     } else
-        opkt->dts = av_rescale_q(pkt->dts, ist->st->time_base, ost->mux_timebase);
+        opkt->dts = av_rescale_q(opkt->dts, ist->st->time_base, ost->mux_timebase);
     opkt->dts -= ost_tb_start_time;
 
-    opkt->duration = av_rescale_q(pkt->duration, ist->st->time_base, ost->mux_timebase);
+    opkt->duration = av_rescale_q(opkt->duration, ist->st->time_base, ost->mux_timebase);
 
     ost->sync_opts += opkt->duration;
 
@@ -1912,6 +2314,27 @@ static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *p
     ost->streamcopy_started = 1;
 }
 
+static void do_streamcopy(InputStream *ist, OutputStream *ost, const AVPacket *pkt)
+{
+    OutputFile *of = output_files[ost->file_index];
+    AVPacket *opkt = ost->pkt;
+
+    av_packet_unref(opkt);
+    // EOF: flush output bitstream filters.
+    if (!pkt) {
+        output_packet(of, opkt, ost, 1);
+        return;
+    }
+
+    if (!streamcopy_check(ist, ost, pkt))
+        return;
+
+    if (av_packet_ref(opkt, pkt) < 0)
+        exit_program(1);
+
+    streamcopy_output(ist, ost, opkt);
+}
+
 int guess_input_channel_layout(InputStream *ist)
 {
     AVCodecContext *dec = ist->dec_ctx;
@@ -2096,11 +2519,19 @@ static int decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, AVPacke
 
 static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
 {
+    /* decode_audio() rescales the timestamps to the sample rate */
+    AVRational tb = ist->dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO ?
+                    (AVRational){ 1, decoded_frame->sample_rate } : ist->st->time_base;
     int i, ret;
 
     av_assert1(ist->nb_filters > 0); /* ensure ret is initialized */
     for (i = 0; i < ist->nb_filters; i++) {
+        int64_t timer = av_gettime_relative();
         ret = ifilter_send_frame(ist->filters[i], decoded_frame, i < ist->nb_filters - 1);
+        ist->filters[i]->graph->process_time +=
+            stage_timer_update(ist->stage_timers, STAGE_FILTER_SEND,
+                               ist->file_index, ist->st->index, timer, 1,
+                               decoded_frame->pts, tb) - timer;
         if (ret == AVERROR_EOF)
             ret = 0; /* ignore */
         if (ret < 0) {
@@ -2119,9 +2550,15 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     AVCodecContext *avctx = ist->dec_ctx;
     int ret, err = 0;
     AVRational decoded_frame_tb;
+    int64_t timer;
 
     update_benchmark(NULL);
+    timer = av_gettime_relative();
     ret = decode(avctx, decoded_frame, got_output, pkt);
+    stage_timer_update(ist->stage_timers, STAGE_DECODE,
+                       ist->file_index, ist->st->index, timer, 1,
+                       *got_output ? decoded_frame->pts : AV_NOPTS_VALUE,
+                       ist->st->time_base);
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2179,6 +2616,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     int i, ret = 0, err = 0;
     int64_t best_effort_timestamp;
     int64_t dts = AV_NOPTS_VALUE;
+    int64_t timer;
 
     // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
     // reason. This seems like a semi-critical bug. Don't trigger EOF, and
@@ -2203,7 +2641,12 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     }
 
     update_benchmark(NULL);
+    timer = av_gettime_relative();
     ret = decode(ist->dec_ctx, decoded_frame, got_output, pkt);
+    stage_timer_update(ist->stage_timers, STAGE_DECODE,
+                       ist->file_index, ist->st->index, timer, 1,
+                       *got_output ? decoded_frame->pts : AV_NOPTS_VALUE,
+                       ist->st->time_base);
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -3155,6 +3598,16 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
         if (ret < 0)
             return ret;
 
+        /* frames are sent to JS, only the stream parameters are needed by
+         * the null muxer */
+        if (output_files[ost->file_index]->js_frames) {
+            ret = avcodec_parameters_from_context(ost->st->codecpar, ost->enc_ctx);
+            if (ret < 0)
+                return ret;
+            ost->st->time_base = ost->enc_ctx->time_base;
+            goto initialized;
+        }
+
         if ((ist = get_input_stream(ost)))
             dec = ist->dec_ctx;
         if (dec && dec->subtitle_header) {
@@ -3276,6 +3729,7 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
     if (ret < 0)
         return ret;
 
+initialized:
     ost->initialized = 1;
 
     ret = of_check_init(output_files[ost->file_index]);
@@ -3481,64 +3935,6 @@ static int transcode_init(void)
     return 0;
 }
 
-/* Return 1 if there remain streams where more output is wanted, 0 otherwise. */
-static int need_output(void)
-{
-    int i;
-
-    for (i = 0; i < nb_output_streams; i++) {
-        OutputStream *ost    = output_streams[i];
-        OutputFile *of       = output_files[ost->file_index];
-        AVFormatContext *os  = output_files[ost->file_index]->ctx;
-
-        if (ost->finished ||
-            (os->pb && avio_tell(os->pb) >= of->limit_filesize))
-            continue;
-        if (ost->frame_number >= ost->max_frames) {
-            int j;
-            for (j = 0; j < of->ctx->nb_streams; j++)
-                close_output_stream(output_streams[of->ost_index + j]);
-            continue;
-        }
-
-        return 1;
-    }
-
-    return 0;
-}
-
-/**
- * Select the output stream to process.
- *
- * @return  selected output stream, or NULL if none available
- */
-static OutputStream *choose_output(void)
-{
-    int i;
-    int64_t opts_min = INT64_MAX;
-    OutputStream *ost_min = NULL;
-
-    for (i = 0; i < nb_output_streams; i++) {
-        OutputStream *ost = output_streams[i];
-        int64_t opts = ost->last_mux_dts == AV_NOPTS_VALUE ? INT64_MIN :
-                       av_rescale_q(ost->last_mux_dts, ost->st->time_base,
-                                    AV_TIME_BASE_Q);
-        if (ost->last_mux_dts == AV_NOPTS_VALUE)
-            av_log(NULL, AV_LOG_DEBUG,
-                "cur_dts is invalid st:%d (%d) [init:%d i_done:%d finish:%d] (this is harmless if it occurs once at the start per stream)\n",
-                ost->st->index, ost->st->id, ost->initialized, ost->inputs_done, ost->finished);
-
-        if (!ost->initialized && !ost->inputs_done)
-            return ost->unavailable ? NULL : ost;
-
-        if (!ost->finished && opts < opts_min) {
-            opts_min = opts;
-            ost_min  = ost->unavailable ? NULL : ost;
-        }
-    }
-    return ost_min;
-}
-
 static void set_tty_echo(int on)
 {
 #if HAVE_TERMIOS_H
@@ -3672,10 +4068,23 @@ static void *input_thread(void *arg)
     InputFile *f = arg;
     AVPacket *pkt = f->pkt, *queue_pkt;
     unsigned flags = f->non_blocking ? AV_THREAD_MESSAGE_NONBLOCK : 0;
-    int ret = 0;
+    int file_index = f->nb_streams ? input_streams[f->ist_index]->file_index : -1;
+    int64_t start, end, pts;
+    int stream_index, ret = 0;
+
+    if (trace_enabled) {
+        char name[64];
+        snprintf(name, sizeof(name), "input: %s", f->ctx->url);
+        trace_thread_name(name);
+    }
 
     while (1) {
+        start = av_gettime_relative();
         ret = av_read_frame(f->ctx, pkt);
+        end = av_gettime_relative();
+        if (trace_enabled && ret >= 0)
+            trace_event(TRACE_READ, file_index, pkt->stream_index, start, end,
+                        pkt->pts, f->ctx->streams[pkt->stream_index]->time_base);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -3692,6 +4101,9 @@ static void *input_thread(void *arg)
             break;
         }
         av_packet_move_ref(queue_pkt, pkt);
+        stream_index = queue_pkt->stream_index;
+        pts          = queue_pkt->pts;
+        start = av_gettime_relative();
         ret = av_thread_message_queue_send(f->in_thread_queue, &queue_pkt, flags);
         if (flags && ret == AVERROR(EAGAIN)) {
             flags = 0;
@@ -3701,6 +4113,10 @@ static void *input_thread(void *arg)
                    "thread_queue_size option (current value: %d)\n",
                    f->thread_queue_size);
         }
+        if (trace_enabled)
+            trace_event(TRACE_QUEUE_SEND, file_index, stream_index,
+                        start, av_gettime_relative(),
+                        pts, f->ctx->streams[stream_index]->time_base);
         if (ret < 0) {
             if (ret != AVERROR_EOF)
                 av_log(f->ctx, AV_LOG_ERROR,
@@ -3815,22 +4231,12 @@ static int get_input_packet(InputFile *f, AVPacket **pkt)
     return av_read_frame(f->ctx, *pkt);
 }
 
-static int got_eagain(void)
-{
-    int i;
-    for (i = 0; i < nb_output_streams; i++)
-        if (output_streams[i]->unavailable)
-            return 1;
-    return 0;
-}
-
 static void reset_eagain(void)
 {
     int i;
     for (i = 0; i < nb_input_files; i++)
         input_files[i]->eagain = 0;
-    for (i = 0; i < nb_output_streams; i++)
-        output_streams[i]->unavailable = 0;
+    sched_reset_eagain();
 }
 
 // set duration to max(tmp, duration) in a proper time base and return duration's time_base
@@ -3912,6 +4318,29 @@ static int seek_to_start(InputFile *ifile, AVFormatContext *is)
     return ret;
 }
 
+/* add the stream-global side data to the first packet */
+static void add_stream_side_data(InputStream *ist, AVPacket *pkt)
+{
+    int i;
+
+    for (i = 0; i < ist->st->nb_side_data; i++) {
+        AVPacketSideData *src_sd = &ist->st->side_data[i];
+        uint8_t *dst_data;
+
+        if (src_sd->type == AV_PKT_DATA_DISPLAYMATRIX)
+            continue;
+
+        if (av_packet_get_side_data(pkt, src_sd->type, NULL))
+            continue;
+
+        dst_data = av_packet_new_side_data(pkt, src_sd->type, src_sd->size);
+        if (!dst_data)
+            exit_program(1);
+
+        memcpy(dst_data, src_sd->data, src_sd->size);
+    }
+}
+
 /*
  * Return
  * - 0 -- one packet was read and processed
@@ -3929,9 +4358,12 @@ static int process_input(int file_index)
     int64_t duration;
     int64_t pkt_dts;
     int disable_discontinuity_correction = copy_ts;
+    int64_t demux_start, demux_end;
 
     is  = ifile->ctx;
+    demux_start = av_gettime_relative();
     ret = get_input_packet(ifile, &pkt);
+    demux_end = av_gettime_relative();
 
     if (ret == AVERROR(EAGAIN)) {
         ifile->eagain = 1;
@@ -4014,6 +4446,10 @@ static int process_input(int file_index)
 
     ist->data_size += pkt->size;
     ist->nb_packets++;
+    stage_timer_add(ist->stage_timers, STAGE_DEMUX, ist->file_index,
+                    ist->st->index, demux_start, demux_end, 1,
+                    pkt->pts, ist->st->time_base);
+    seek_index_add(ifile->seek_index, pkt);
 
     if (ist->discard)
         goto discard_packet;
@@ -4073,25 +4509,8 @@ static int process_input(int file_index)
         }
     }
 
-    /* add the stream-global side data to the first packet */
-    if (ist->nb_packets == 1) {
-        for (i = 0; i < ist->st->nb_side_data; i++) {
-            AVPacketSideData *src_sd = &ist->st->side_data[i];
-            uint8_t *dst_data;
-
-            if (src_sd->type == AV_PKT_DATA_DISPLAYMATRIX)
-                continue;
-
-            if (av_packet_get_side_data(pkt, src_sd->type, NULL))
-                continue;
-
-            dst_data = av_packet_new_side_data(pkt, src_sd->type, src_sd->size);
-            if (!dst_data)
-                exit_program(1);
-
-            memcpy(dst_data, src_sd->data, src_sd->size);
-        }
-    }
+    if (ist->nb_packets == 1)
+        add_stream_side_data(ist, pkt);
 
     if (pkt->dts != AV_NOPTS_VALUE)
         pkt->dts += av_rescale_q(ifile->ts_offset, AV_TIME_BASE_Q, ist->st->time_base);
@@ -4251,7 +4670,7 @@ static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
 
     if (!*best_ist)
         for (i = 0; i < graph->nb_outputs; i++)
-            graph->outputs[i]->ost->unavailable = 1;
+            sched_set_unavailable(graph->outputs[i]->ost);
 
     return 0;
 }
@@ -4267,9 +4686,9 @@ static int transcode_step(void)
     InputStream  *ist = NULL;
     int ret;
 
-    ost = choose_output();
+    ost = sched_choose_output();
     if (!ost) {
-        if (got_eagain()) {
+        if (sched_got_eagain()) {
             reset_eagain();
             av_usleep(10000);
             return 0;
@@ -4338,7 +4757,7 @@ static int transcode_step(void)
     ret = process_input(ist->file_index);
     if (ret == AVERROR(EAGAIN)) {
         if (input_files[ist->file_index]->eagain)
-            ost->unavailable = 1;
+            sched_set_unavailable(ost);
         return 0;
     }
 
@@ -4358,6 +4777,208 @@ EM_JS(int, is_timeout, (int64_t diff), {
     }
 });
 
+/* Return 1 when every output stream is a stream copy of the only input,
+ * whose timestamps need no discontinuity or wrap correction, so packets can
+ * go straight from the demuxer to the muxers with remux(). */
+static int remux_fast_path_ok(void)
+{
+    InputFile *f;
+    int i;
+
+    if (nb_input_files != 1 || nb_filtergraphs || !nb_output_streams ||
+        copy_ts || debug_ts || do_pkt_dump)
+        return 0;
+
+    f = input_files[0];
+    if (f->readrate || f->rate_emu || f->loop ||
+        (f->ctx->iformat->flags & AVFMT_TS_DISCONT))
+        return 0;
+#if HAVE_THREADS
+    if (f->thread_queue_size)
+        return 0;
+#endif
+
+    for (i = 0; i < f->nb_streams; i++) {
+        InputStream *ist = input_streams[f->ist_index + i];
+
+        if (ist->discard)
+            continue;
+        if (ist->decoding_needed || ist->ts_scale != 1.0 ||
+            ist->st->pts_wrap_bits < 64)
+            return 0;
+    }
+
+    for (i = 0; i < nb_output_streams; i++)
+        if (!output_streams[i]->stream_copy)
+            return 0;
+    return 1;
+}
+
+/* packets read between two calls of print_report() in remux() */
+#define REMUX_REPORT_INTERVAL 64
+
+/*
+ * Main loop of transcode() when remux_fast_path_ok(). Each packet read is
+ * sent to the output streams copying its input stream without choosing an
+ * output stream first or predicting timestamps in process_input_packet(),
+ * and is moved to the last of them instead of being referenced, so nothing
+ * is allocated per packet besides what the demuxer allocates.
+ */
+static int remux(int64_t timer_start)
+{
+    InputFile *ifile = input_files[0];
+    AVPacket *pkt = ifile->pkt;
+    OutputStream **routes;
+    int *first;
+    int i, j, k, ret = 0;
+    int64_t nb_read = 0;
+    int64_t demux_start, demux_end;
+
+    /* output streams grouped by input stream, those of input stream i are
+     * routes[first[i]] to routes[first[i + 1] - 1] */
+    routes = av_malloc_array(nb_output_streams, sizeof(*routes));
+    first  = av_calloc(ifile->nb_streams + 1, sizeof(*first));
+    if (!routes || !first) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (i = j = 0; i < ifile->nb_streams; i++) {
+        first[i] = j;
+        for (k = 0; k < nb_output_streams; k++) {
+            OutputStream *ost = output_streams[k];
+
+            if (ost->source_index != ifile->ist_index + i)
+                continue;
+            if (output_files[ost->file_index]->smart_cut)
+                ost->smart_cut = smart_cut_alloc(input_streams[ost->source_index], ost);
+            routes[j++] = ost;
+        }
+    }
+    first[i] = j;
+
+    av_log(NULL, AV_LOG_VERBOSE, "All output streams are stream copies, remuxing.\n");
+
+    while (!received_sigterm) {
+        InputStream *ist;
+        int64_t offset;
+        int index;
+
+        if (!(nb_read++ % REMUX_REPORT_INTERVAL)) {
+            int64_t cur_time = av_gettime_relative();
+
+            if (is_timeout((cur_time - timer_start) / 1000) == 1)
+                exit_program(1);
+            if (stdin_interaction)
+                if (check_keyboard_interaction(cur_time) < 0)
+                    break;
+            print_report(0, timer_start, cur_time);
+        }
+
+        if (!sched_need_output()) {
+            av_log(NULL, AV_LOG_VERBOSE, "No more output streams to write to, finishing.\n");
+            break;
+        }
+
+        demux_start = av_gettime_relative();
+        ret = av_read_frame(ifile->ctx, pkt);
+        demux_end = av_gettime_relative();
+        if (ret == AVERROR(EAGAIN)) {
+            av_usleep(10000);
+            continue;
+        }
+        if (ret < 0) {
+            if (ret != AVERROR_EOF) {
+                print_error(ifile->ctx->url, ret);
+                if (exit_on_error)
+                    exit_program(1);
+            }
+            for (i = 0; i < ifile->nb_streams; i++) {
+                ist = input_streams[ifile->ist_index + i];
+                for (j = first[i]; j < first[i + 1]; j++)
+                    if (routes[j]->smart_cut)
+                        smart_cut_send(routes[j]->smart_cut, NULL);
+                if (ist->processing_needed)
+                    process_input_packet(ist, NULL, 0);
+                for (j = first[i]; j < first[i + 1]; j++)
+                    finish_output_stream(routes[j]);
+            }
+            ifile->eof_reached = 1;
+            ret = 0;
+            break;
+        }
+
+        index = pkt->stream_index;
+        if (index >= ifile->nb_streams) {
+            report_new_stream(0, pkt);
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        ist = input_streams[ifile->ist_index + index];
+        ist->data_size += pkt->size;
+        ist->nb_packets++;
+        stage_timer_add(ist->stage_timers, STAGE_DEMUX, ist->file_index,
+                        ist->st->index, demux_start, demux_end, 1,
+                        pkt->pts, ist->st->time_base);
+        seek_index_add(ifile->seek_index, pkt);
+
+        if (ist->discard) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        if (pkt->flags & AV_PKT_FLAG_CORRUPT) {
+            av_log(NULL, exit_on_error ? AV_LOG_FATAL : AV_LOG_WARNING,
+                   "%s: corrupt input packet in stream %d\n", ifile->ctx->url, index);
+            if (exit_on_error)
+                exit_program(1);
+        }
+
+        if (ist->nb_packets == 1)
+            add_stream_side_data(ist, pkt);
+
+        offset = av_rescale_q(ifile->ts_offset, AV_TIME_BASE_Q, ist->st->time_base);
+        if (pkt->dts != AV_NOPTS_VALUE)
+            pkt->dts += offset;
+        if (pkt->pts != AV_NOPTS_VALUE)
+            pkt->pts += offset;
+
+        /* what process_input_packet() gives to do_streamcopy() */
+        if (pkt->dts != AV_NOPTS_VALUE)
+            ist->dts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
+        else
+            ist->dts += av_rescale_q(pkt->duration, ist->st->time_base, AV_TIME_BASE_Q);
+        ist->pts = ist->dts;
+
+        for (j = first[index]; j < first[index + 1]; j++) {
+            OutputStream *ost = routes[j];
+
+            /* smart cut handles the start and the end of the cut itself */
+            if (ost->smart_cut ? (ost->finished & MUXER_FINISHED) :
+                !check_output_constraints(ist, ost) ||
+                !streamcopy_check(ist, ost, pkt))
+                continue;
+
+            av_packet_unref(ost->pkt);
+            if (j == first[index + 1] - 1)
+                av_packet_move_ref(ost->pkt, pkt);
+            else if (av_packet_ref(ost->pkt, pkt) < 0)
+                exit_program(1);
+
+            if (ost->smart_cut)
+                smart_cut_send(ost->smart_cut, ost->pkt);
+            else
+                streamcopy_output(ist, ost, ost->pkt);
+        }
+        av_packet_unref(pkt);
+    }
+
+end:
+    av_free(routes);
+    av_free(first);
+    return ret;
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -4369,8 +4990,12 @@ static int transcode(void)
     InputStream *ist;
     int64_t timer_start;
     int64_t total_packets_written = 0;
+    int remuxing;
 
     ret = transcode_init();
+    if (ret < 0)
+        goto fail;
+    ret = sched_init();
     if (ret < 0)
         goto fail;
 
@@ -4385,7 +5010,15 @@ static int transcode(void)
         goto fail;
 #endif
 
-    while (!received_sigterm) {
+    remuxing = remux_fast_path_ok();
+    if (remuxing && (ret = remux(timer_start)) < 0)
+        goto fail;
+    for (i = 0; i < nb_output_files && !remuxing; i++)
+        if (output_files[i]->smart_cut)
+            av_log(NULL, AV_LOG_WARNING, "Output #%d: -smart_cut needs all output "
+                   "streams to be stream copies of a single input, ignored\n", i);
+
+    while (!remuxing && !received_sigterm) {
         int64_t cur_time= av_gettime_relative();
 
         if (is_timeout((cur_time - timer_start) / 1000) == 1) exit_program(1);
@@ -4396,7 +5029,7 @@ static int transcode(void)
                 break;
 
         /* check if there's any stream where output is still needed */
-        if (!need_output()) {
+        if (!sched_need_output()) {
             av_log(NULL, AV_LOG_VERBOSE, "No more output streams to write to, finishing.\n");
             break;
         }
@@ -4511,7 +5144,10 @@ static int transcode(void)
 static BenchmarkTimeStamps get_benchmark_time_stamps(void)
 {
     BenchmarkTimeStamps time_stamps = { av_gettime_relative() };
-#if HAVE_GETRUSAGE
+#if defined(__EMSCRIPTEN__)
+    /* getrusage() reports nothing in wasm, busy_usec is reported instead */
+    time_stamps.user_usec = time_stamps.sys_usec = 0;
+#elif HAVE_GETRUSAGE
     struct rusage rusage;
 
     getrusage(RUSAGE_SELF, &rusage);
@@ -4531,12 +5167,17 @@ static BenchmarkTimeStamps get_benchmark_time_stamps(void)
 #else
     time_stamps.user_usec = time_stamps.sys_usec = 0;
 #endif
+    time_stamps.busy_usec = stage_busy_time;
     return time_stamps;
 }
 
 static int64_t getmaxrss(void)
 {
-#if HAVE_GETRUSAGE && HAVE_STRUCT_RUSAGE_RU_MAXRSS
+#if defined(__EMSCRIPTEN__)
+    /* the highest program break is the closest thing to RSS in wasm */
+    sample_resources();
+    return sbrk_high_water;
+#elif HAVE_GETRUSAGE && HAVE_STRUCT_RUSAGE_RU_MAXRSS
     struct rusage rusage;
     getrusage(RUSAGE_SELF, &rusage);
     return (int64_t)rusage.ru_maxrss * 1024;
@@ -4587,6 +5228,11 @@ void init_globals() {
   ffmpeg_exited = 0;
   main_return_code = 0;
   copy_ts_first_pts = AV_NOPTS_VALUE;
+
+  start_time = (BenchmarkTimeStamps){ 0 };
+  stage_busy_time = 0;
+  sbrk_high_water = 0;
+  pool_threads_used = 0;
 }
 
 /* ffmpeg() is simply a rename of main(), but it makes things easier to
@@ -4624,6 +5270,8 @@ int ffmpeg(int argc, char **argv)
     ret = ffmpeg_parse_options(argc, argv);
     if (ret < 0)
         exit_program(1);
+    if (nb_input_files)
+        send_probe_stats();
 
     if (nb_output_files <= 0 && nb_input_files == 0) {
         show_usage();
@@ -4642,10 +5290,22 @@ int ffmpeg(int argc, char **argv)
             want_sdp = 0;
     }
 
-    current_time = ti = get_benchmark_time_stamps();
+    if (trace_filename)
+        trace_init();
+    current_time = ti = start_time = get_benchmark_time_stamps();
     if (transcode() < 0)
         exit_program(1);
     if (do_benchmark) {
+#if defined(__EMSCRIPTEN__)
+        /* getrusage() reports nothing in wasm, print the busy time instead */
+        int64_t busy, rtime;
+        current_time = get_benchmark_time_stamps();
+        busy  = current_time.busy_usec - ti.busy_usec;
+        rtime = current_time.real_usec - ti.real_usec;
+        av_log(NULL, AV_LOG_INFO,
+               "bench: busy=%0.3fs rtime=%0.3fs\n",
+               busy / 1000000.0, rtime / 1000000.0);
+#else
         int64_t utime, stime, rtime;
         current_time = get_benchmark_time_stamps();
         utime = current_time.user_usec - ti.user_usec;
@@ -4654,6 +5314,7 @@ int ffmpeg(int argc, char **argv)
         av_log(NULL, AV_LOG_INFO,
                "bench: utime=%0.3fs stime=%0.3fs rtime=%0.3fs\n",
                utime / 1000000.0, stime / 1000000.0, rtime / 1000000.0);
+#endif
     }
     av_log(NULL, AV_LOG_DEBUG, "%"PRIu64" frames successfully decoded, %"PRIu64" decoding errors\n",
            decode_error_stat[0], decode_error_stat[1]);
@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <signal.h>
@@ -36,6 +37,7 @@
 #include "libavfilter/avfilter.h"
 
 #include "libavutil/avutil.h"
+#include "libavutil/bprint.h"
 #include "libavutil/dict.h"
 #include "libavutil/eval.h"
 #include "libavutil/fifo.h"
@@ -44,6 +46,7 @@
 #include "libavutil/rational.h"
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
 
 #include "libswresample/swresample.h"
 
@@ -119,6 +122,8 @@ typedef struct OptionsContext {
     int accurate_seek;
     int thread_queue_size;
     int input_sync_ref;
+    int fast_probe;
+    const char *seek_index;
 
     SpecifierOpt *ts_scale;
     int        nb_ts_scale;
@@ -149,10 +154,18 @@ typedef struct OptionsContext {
     int64_t recording_time;
     int64_t stop_time;
     uint64_t limit_filesize;
+    int64_t mux_queue_size;
+    const char *mux_spill_dir;
+    int reserve_moov;
+    int smart_cut;
+    int mux_thread_queue_size;
     float mux_preload;
     float mux_max_delay;
     int shortest;
     int bitexact;
+    int js_frames;
+    const char *ladder;
+    float ladder_gop;
 
     int video_disable;
     int audio_disable;
@@ -296,6 +309,8 @@ typedef struct FilterGraph {
     // true when the filtergraph contains only meta filters
     // that do not modify the frame data
     int is_meta;
+    // time spent pushing frames into and pulling frames out of the graph
+    int64_t process_time;
 
     InputFilter   **inputs;
     int          nb_inputs;
@@ -303,6 +318,133 @@ typedef struct FilterGraph {
     int         nb_outputs;
 } FilterGraph;
 
+/* pipeline stages timed by StageTimer, see InputStream and OutputStream */
+enum StageTimerID {
+    STAGE_DEMUX,        ///< get_input_packet()
+    STAGE_DECODE,       ///< decoding in decode_audio() / decode_video()
+    STAGE_FILTER_SEND,  ///< ifilter_send_frame()
+    STAGE_FILTER_REAP,  ///< av_buffersink_get_frame_flags() in reap_filters()
+    STAGE_ENCODE,       ///< encoding in encode_frame()
+    STAGE_MUX,          ///< av_interleaved_write_frame() in of_write_packet()
+    STAGE_NB,
+};
+
+/* entries of the sample tables of a mov track, counted for -reserve_moov */
+typedef struct MoovCounts {
+    int64_t samples;
+    int64_t bytes;
+    int64_t keyframes;
+    int64_t stts_entries;   ///< changes of the sample duration
+    int64_t ctts_entries;   ///< changes of pts - dts
+    int     has_ctts;       ///< a sample has pts != dts
+    int64_t last_dts;
+    int64_t last_delta;
+    int64_t last_cts;
+} MoovCounts;
+
+typedef struct StageTimer {
+    int64_t  time;   ///< cumulative time in microseconds
+    uint64_t count;  ///< number of calls
+} StageTimer;
+
+/* events recorded by -trace_file besides the stages of StageTimerID */
+enum TraceEventType {
+    TRACE_READ = STAGE_NB,  ///< av_read_frame() in input_thread()
+    TRACE_QUEUE_SEND,       ///< sending a packet from input_thread(), stalls when the queue is full
+    TRACE_NB,
+};
+
+/* ffmpeg_trace.c */
+extern int trace_enabled;
+
+void trace_init(void);
+void trace_thread_name(const char *name);
+/**
+ * Record an event of stream file_index:stream_index between start and end,
+ * pts (in time_base) is the timestamp of the packet or frame handled, or
+ * AV_NOPTS_VALUE if there is none.
+ */
+void trace_event(int type, int file_index, int stream_index,
+                 int64_t start, int64_t end, int64_t pts, AVRational time_base);
+void trace_uninit(const char *filename);
+
+/* ffmpeg_seekindex.c */
+typedef struct SeekIndex SeekIndex;
+
+/**
+ * Load the keyframe index sidecar at path into the index of ic.
+ *
+ * @return NULL when the input is not a file or already has an index
+ */
+SeekIndex *seek_index_open(AVFormatContext *ic, const char *filename,
+                           const char *path);
+void seek_index_add(SeekIndex *si, const AVPacket *pkt);
+/**
+ * Save the sidecar if new keyframes were added, and free si.
+ */
+void seek_index_close(SeekIndex **si, AVFormatContext *ic);
+
+/* ffmpeg_sched.c */
+int sched_init(void);
+void sched_uninit(void);
+/**
+ * Move ost in the schedule after its last_mux_dts changed.
+ */
+void sched_update(OutputStream *ost);
+/**
+ * Close the output file of ost at the next sched_need_output(), to be called
+ * when ost->frame_number reaches ost->max_frames.
+ */
+void sched_max_frames(OutputStream *ost);
+void sched_set_unavailable(OutputStream *ost);
+int sched_got_eagain(void);
+void sched_reset_eagain(void);
+/* Return 1 if there remain streams where more output is wanted, 0 otherwise. */
+int sched_need_output(void);
+/**
+ * Select the output stream to process.
+ *
+ * @return  selected output stream, or NULL if none available
+ */
+OutputStream *sched_choose_output(void);
+
+/* wall time spent in all stages, reported as busy time by -benchmark and
+ * stats.resources as getrusage() is not available in wasm */
+extern int64_t stage_busy_time;
+
+/**
+ * Add the time between start and end and calls to timers[id] of stream
+ * file_index:stream_index, the stage is also traced when -trace_file is set
+ * with pts, the timestamp in time_base of the packet or frame it produced.
+ */
+static inline void stage_timer_add(StageTimer *timers, enum StageTimerID id,
+                                   int file_index, int stream_index,
+                                   int64_t start, int64_t end, int calls,
+                                   int64_t pts, AVRational time_base)
+{
+    timers[id].time  += end - start;
+    timers[id].count += calls;
+    stage_busy_time  += end - start;
+    if (trace_enabled)
+        trace_event(id, file_index, stream_index, start, end, pts, time_base);
+}
+
+/**
+ * Add the time elapsed since start, see stage_timer_add().
+ *
+ * @return current time, to be used as start of the next measurement
+ */
+static inline int64_t stage_timer_update(StageTimer *timers, enum StageTimerID id,
+                                         int file_index, int stream_index,
+                                         int64_t start, int calls,
+                                         int64_t pts, AVRational time_base)
+{
+    int64_t now = av_gettime_relative();
+    stage_timer_add(timers, id, file_index, stream_index, start, now, calls,
+                    pts, time_base);
+    return now;
+}
+
 typedef struct InputStream {
     int file_index;
     AVStream *st;
@@ -394,6 +536,8 @@ typedef struct InputStream {
     // number of frames/samples retrieved from the decoder
     uint64_t frames_decoded;
     uint64_t samples_decoded;
+    // time spent in demux, decode and filter send stages
+    StageTimer stage_timers[STAGE_NB];
 
     int64_t *dts_buffer;
     int nb_dts_buffer;
@@ -424,6 +568,13 @@ typedef struct InputFile {
     float readrate;
     int accurate_seek;
 
+    int fast_probe;                 /* stream info was found with the limits of fast probe */
+    int header_probe;               /* stream info was taken from the header only */
+    int64_t open_time;              /* microseconds in avformat_open_input() */
+    int64_t find_stream_info_time;  /* microseconds in avformat_find_stream_info() */
+    struct SeekIndex *seek_index;   /* keyframes saved to / loaded from -seek_index */
+    AVIOContext *js_pb;             /* custom I/O of a js: input, see open_js_input() */
+
     AVPacket *pkt;
 
 #if HAVE_THREADS
@@ -531,6 +682,8 @@ typedef struct OutputStream {
     char *apad;
     OSTFinished finished;        /* no more packets should be written for this stream */
     int unavailable;                     /* true if the steram is unavailable (possibly temporarily) */
+    int sched_index;                     /* position in the schedule heap, -1 when not in it */
+    int64_t sched_dts;                   /* last_mux_dts in AV_TIME_BASE_Q, the schedule key */
     int stream_copy;
 
     // init_output_stream() has been called for this stream
@@ -542,6 +695,7 @@ typedef struct OutputStream {
 
     const char *attachment_filename;
     int streamcopy_started;
+    struct SmartCut *smart_cut;  /* boundary GOPs of the -smart_cut, NULL if not used */
     int copy_initial_nonkeyframes;
     int copy_prior_start;
     char *disposition;
@@ -558,23 +712,16 @@ typedef struct OutputStream {
     uint64_t samples_encoded;
     // number of packets received from the encoder
     uint64_t packets_encoded;
+    // time spent in filter reap, encode and mux stages
+    StageTimer stage_timers[STAGE_NB];
+    // sample table entries written, only counted with a reserved moov
+    MoovCounts moov;
 
     /* packet quality factor */
     int quality;
 
-    int max_muxing_queue_size;
-
-    /* the packets are buffered here until the muxer is ready to be initialized */
-    AVFifo *muxing_queue;
-
-    /*
-     * The size of the AVPackets' buffers in queue.
-     * Updated when a packet is either pushed or pulled from the queue.
-     */
-    size_t muxing_queue_data_size;
-
-    /* Threshold after which max_muxing_queue_size will be in effect */
-    size_t muxing_queue_data_threshold;
+    /* number of packets of this stream in the muxing queue of its file */
+    int64_t muxing_queue_packets;
 
     /* packet picture type */
     int pict_type;
@@ -583,6 +730,27 @@ typedef struct OutputStream {
     int64_t error[4];
 } OutputStream;
 
+/*
+ * Packets buffered in arrival order until the muxer is ready to be
+ * initialized. Once max_size bytes are held in memory, the following packets
+ * are appended to a temporary file in spill_dir instead, and are read back
+ * after the ones in memory.
+ */
+typedef struct MuxQueue {
+    AVFifo *fifo;               /* AVPacket* held in memory */
+    size_t size;                /* bytes held in memory */
+    size_t max_size;            /* -mux_queue_size */
+    size_t peak_size;
+
+    const char *spill_dir;      /* -mux_spill_dir */
+    char *spill_path;
+    AVIOContext *spill;
+    int64_t spill_packets;      /* packets written to the spill file */
+    int64_t spill_bytes;
+
+    int64_t nb_packets;         /* packets queued in total */
+} MuxQueue;
+
 typedef struct OutputFile {
     int index;
 
@@ -596,6 +764,28 @@ typedef struct OutputFile {
     uint64_t limit_filesize; /* filesize limit expressed in bytes */
 
     int shortest;
+    int js_frames;           /* filtered frames are sent to JS instead of being encoded */
+
+    MuxQueue muxing_queue;
+
+    int reserve_moov;           /* -reserve_moov */
+    int64_t moov_reserved;      /* bytes reserved for moov before mdat, 0 if none */
+    int64_t moov_reserved_pos;  /* position of the reservation, -1 if not checked */
+
+    int smart_cut;              /* -smart_cut */
+
+    /* bytes written to the file, published by the thread writing it, see
+     * of_filesize() */
+    atomic_int_fast64_t filesize;
+
+#if HAVE_THREADS
+    AVThreadMessageQueue *mux_thread_queue;
+    pthread_t mux_thread;       /* thread writing packets to this file */
+    int mux_thread_queue_size;  /* maximum number of queued packets, 0 to mux in the main thread */
+    /* STAGE_MUX time of each stream of the file, only touched by the mux
+     * thread and added to the stage timers of the streams once it stops */
+    StageTimer *mux_thread_timers;
+#endif
 
     int header_written;
 } OutputFile;
@@ -614,6 +804,7 @@ extern FilterGraph **filtergraphs;
 extern int        nb_filtergraphs;
 
 extern char *vstats_filename;
+extern char *trace_filename;
 extern char *sdp_filename;
 
 extern float audio_drift_threshold;
@@ -681,8 +872,13 @@ void sub2video_update(InputStream *ist, int64_t heartbeat_pts, AVSubtitle *sub);
 
 int ifilter_parameters_from_frame(InputFilter *ifilter, const AVFrame *frame);
 
+/* print the filters, link formats and frame counts of fg as JSON */
+void filtergraph_bprint_profile(AVBPrint *buf, FilterGraph *fg);
+
 int ffmpeg_parse_options(int argc, char **argv);
 
+int require_side_modules(const char *names);
+
 int videotoolbox_init(AVCodecContext *s);
 int qsv_init(AVCodecContext *s);
 
@@ -700,8 +896,34 @@ int hwaccel_decode_init(AVCodecContext *avctx);
 int of_check_init(OutputFile *of);
 int of_write_trailer(OutputFile *of);
 void of_close(OutputFile **pof);
+/* bytes written to of so far, safe to call while its mux thread runs */
+int64_t of_filesize(OutputFile *of);
 
 void of_write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost,
                      int unqueue);
 
+/* append the muxing queue stats of of as a JSON object */
+void of_bprint_muxing_queue(AVBPrint *buf, OutputFile *of);
+
+void close_output_stream(OutputStream *ost);
+/* send opkt, a packet of ist with its input timestamps, to the stream copy ost */
+void streamcopy_output(InputStream *ist, OutputStream *ost, AVPacket *opkt);
+
+/* ffmpeg_smartcut.c */
+typedef struct SmartCut SmartCut;
+
+/**
+ * Set up -smart_cut for ost, a stream copy of ist.
+ *
+ * @return NULL when ist is not a video stream, there is no cut or the codec
+ *         is not supported, ost is then copied from a keyframe
+ */
+SmartCut *smart_cut_alloc(InputStream *ist, OutputStream *ost);
+/**
+ * Send a packet of ist with the input ts offset applied, taking its data,
+ * or NULL at the end of the input.
+ */
+void smart_cut_send(SmartCut *sc, AVPacket *pkt);
+void smart_cut_free(SmartCut **sc);
+
 #endif /* FFTOOLS_FFMPEG_H */
@@ -990,6 +990,107 @@ static int graph_is_meta(AVFilterGraph *graph)
     return 1;
 }
 
+/* auto: inserted by libavfilter during format negotiation,
+ * ffmpeg: inserted by ffmpeg (buffers, trim, format_out, ...),
+ * user: parsed from the filtergraph description */
+static const char *filter_origin(const AVFilterContext *f)
+{
+    if (av_strstart(f->name, "auto_", NULL))
+        return "auto";
+    if (av_strstart(f->name, "Parsed_", NULL))
+        return "user";
+    return "ffmpeg";
+}
+
+static void describe_link(char *buf, size_t size, const AVFilterLink *link)
+{
+    char layout[64] = "";
+
+    switch (link->type) {
+    case AVMEDIA_TYPE_VIDEO:
+        snprintf(buf, size, "%s %dx%d",
+                 av_x_if_null(av_get_pix_fmt_name(link->format), "none"),
+                 link->w, link->h);
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        av_channel_layout_describe(&link->ch_layout, layout, sizeof(layout));
+        snprintf(buf, size, "%s %dHz %s",
+                 av_x_if_null(av_get_sample_fmt_name(link->format), "none"),
+                 link->sample_rate, layout);
+        break;
+    default:
+        snprintf(buf, size, "%s", av_x_if_null(av_get_media_type_string(link->type), "unknown"));
+    }
+}
+
+/* log the conversion filters inserted by libavfilter, they are easy to miss
+ * and can be expensive (ex. a yuv420p -> rgb24 -> yuv420p round-trip) */
+static void log_conversion_filters(FilterGraph *fg)
+{
+    for (unsigned i = 0; i < fg->graph->nb_filters; i++) {
+        const AVFilterContext *f = fg->graph->filters[i];
+        char in[128], out[128];
+
+        if (strcmp(filter_origin(f), "auto") || !f->nb_inputs || !f->nb_outputs)
+            continue;
+        describe_link(in,  sizeof(in),  f->inputs[0]);
+        describe_link(out, sizeof(out), f->outputs[0]);
+        av_log(NULL, AV_LOG_VERBOSE, "Filtergraph %d: %s converts %s -> %s\n",
+               fg->index, f->name, in, out);
+    }
+}
+
+static void bprint_json_string(AVBPrint *buf, const char *str)
+{
+    av_bprint_chars(buf, '"', 1);
+    for (; str && *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(buf, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(buf, "\\u%04x", *str);
+        else
+            av_bprint_chars(buf, *str, 1);
+    }
+    av_bprint_chars(buf, '"', 1);
+}
+
+static void bprint_links(AVBPrint *buf, AVFilterLink **links, unsigned nb_links,
+                         int input)
+{
+    av_bprintf(buf, "[");
+    for (unsigned i = 0; i < nb_links; i++) {
+        const AVFilterLink *link = links[i];
+        char desc[128];
+
+        describe_link(desc, sizeof(desc), link);
+        av_bprintf(buf, "%s{\"format\":", i ? "," : "");
+        bprint_json_string(buf, desc);
+        av_bprintf(buf, ",\"frames\":%"PRId64"}",
+                   input ? link->frame_count_out : link->frame_count_in);
+    }
+    av_bprintf(buf, "]");
+}
+
+void filtergraph_bprint_profile(AVBPrint *buf, FilterGraph *fg)
+{
+    av_bprintf(buf, "{\"index\":%d,\"description\":", fg->index);
+    bprint_json_string(buf, fg->graph_desc);
+    av_bprintf(buf, ",\"time\":%"PRId64",\"filters\":[", fg->process_time);
+    for (unsigned i = 0; fg->graph && i < fg->graph->nb_filters; i++) {
+        const AVFilterContext *f = fg->graph->filters[i];
+
+        av_bprintf(buf, "%s{\"name\":", i ? "," : "");
+        bprint_json_string(buf, f->name);
+        av_bprintf(buf, ",\"filter\":\"%s\",\"origin\":\"%s\",\"inputs\":",
+                   f->filter->name, filter_origin(f));
+        bprint_links(buf, f->inputs, f->nb_inputs, 1);
+        av_bprintf(buf, ",\"outputs\":");
+        bprint_links(buf, f->outputs, f->nb_outputs, 0);
+        av_bprintf(buf, "}");
+    }
+    av_bprintf(buf, "]}");
+}
+
 int configure_filtergraph(FilterGraph *fg)
 {
     AVFilterInOut *inputs, *outputs, *cur;
@@ -1040,6 +1141,8 @@ int configure_filtergraph(FilterGraph *fg)
         fg->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    /* filters are initialized while parsing, their libraries must be loaded before */
+    require_side_modules(graph_desc);
     if ((ret = avfilter_graph_parse2(fg->graph, graph_desc, &inputs, &outputs)) < 0)
         goto fail;
 
@@ -1091,6 +1194,7 @@ int configure_filtergraph(FilterGraph *fg)
         goto fail;
 
     fg->is_meta = graph_is_meta(fg->graph);
+    log_conversion_filters(fg);
 
     /* limit the lists of allowed formats to the ones selected, to
      * make sure they stay the same if the filtergraph is reconfigured later */
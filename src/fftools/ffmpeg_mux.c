@@ -18,13 +18,17 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "ffmpeg.h"
 
+#include "libavutil/avstring.h"
 #include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
 #include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
 #include "libavutil/timestamp.h"
 
 #include "libavcodec/packet.h"
@@ -41,11 +45,388 @@ static void close_all_output_streams(OutputStream *ost, OSTFinished this_stream,
     }
 }
 
+/*
+ * A packet in the spill file of a muxing queue is written as: u32 size,
+ * u32 stream index, u32 flags, i64 pts, dts, duration, pos, the data,
+ * u32 number of side data, and for each side data: u32 type, u32 size and
+ * the data. All values are little-endian.
+ */
+static void spill_write(AVIOContext *pb, const AVPacket *pkt)
+{
+    int i;
+
+    avio_wl32(pb, pkt->size);
+    avio_wl32(pb, pkt->stream_index);
+    avio_wl32(pb, pkt->flags);
+    avio_wl64(pb, pkt->pts);
+    avio_wl64(pb, pkt->dts);
+    avio_wl64(pb, pkt->duration);
+    avio_wl64(pb, pkt->pos);
+    avio_write(pb, pkt->data, pkt->size);
+    avio_wl32(pb, pkt->side_data_elems);
+    for (i = 0; i < pkt->side_data_elems; i++) {
+        avio_wl32(pb, pkt->side_data[i].type);
+        avio_wl32(pb, pkt->side_data[i].size);
+        avio_write(pb, pkt->side_data[i].data, pkt->side_data[i].size);
+    }
+}
+
+static int spill_read(AVIOContext *pb, AVPacket *pkt)
+{
+    int i, ret, size, nb_side_data;
+
+    size = avio_rl32(pb);
+    if (avio_feof(pb) || size < 0)
+        return AVERROR_INVALIDDATA;
+    if ((ret = av_new_packet(pkt, size)) < 0)
+        return ret;
+    pkt->stream_index = avio_rl32(pb);
+    pkt->flags        = avio_rl32(pb);
+    pkt->pts          = avio_rl64(pb);
+    pkt->dts          = avio_rl64(pb);
+    pkt->duration     = avio_rl64(pb);
+    pkt->pos          = avio_rl64(pb);
+    if (avio_read(pb, pkt->data, size) != size)
+        return AVERROR_INVALIDDATA;
+
+    nb_side_data = avio_rl32(pb);
+    for (i = 0; i < nb_side_data; i++) {
+        enum AVPacketSideDataType type = avio_rl32(pb);
+        uint8_t *data;
+
+        size = avio_rl32(pb);
+        if (avio_feof(pb) || size < 0)
+            return AVERROR_INVALIDDATA;
+        data = av_packet_new_side_data(pkt, type, size);
+        if (!data)
+            return AVERROR(ENOMEM);
+        if (avio_read(pb, data, size) != size)
+            return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+static void spill_close(MuxQueue *q)
+{
+    avio_closep(&q->spill);
+    if (q->spill_path) {
+        unlink(q->spill_path);
+        av_freep(&q->spill_path);
+    }
+}
+
+static int muxing_queue_push(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    MuxQueue *q = &of->muxing_queue;
+    size_t size = sizeof(*pkt) + pkt->size;
+    AVPacket *tmp_pkt;
+    int ret;
+
+    pkt->stream_index = ost->index;
+
+    /* once spilling, all the following packets are spilled to keep them in order */
+    if (!q->spill && q->size + size > q->max_size) {
+        q->spill_path = av_asprintf("%s/ffmpeg-mux-%d-%08x.spill", q->spill_dir,
+                                    of->index, av_get_random_seed());
+        if (!q->spill_path)
+            return AVERROR(ENOMEM);
+        ret = avio_open(&q->spill, q->spill_path, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot open %s to spill the muxing "
+                   "queue of output file #%d: %s\n", q->spill_path, of->index,
+                   av_err2str(ret));
+            return ret;
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "Muxing queue of output file #%d holds "
+               "%zu bytes, spilling the following packets to %s\n",
+               of->index, q->size, q->spill_path);
+    }
+
+    if (q->spill) {
+        spill_write(q->spill, pkt);
+        if (q->spill->error < 0)
+            return q->spill->error;
+        q->spill_packets++;
+        q->spill_bytes += pkt->size;
+        av_packet_unref(pkt);
+    } else {
+        ret = av_packet_make_refcounted(pkt);
+        if (ret < 0)
+            return ret;
+        tmp_pkt = av_packet_alloc();
+        if (!tmp_pkt)
+            return AVERROR(ENOMEM);
+        av_packet_move_ref(tmp_pkt, pkt);
+        ret = av_fifo_write(q->fifo, &tmp_pkt, 1);
+        if (ret < 0) {
+            av_packet_free(&tmp_pkt);
+            return ret;
+        }
+        q->size     += size;
+        q->peak_size = FFMAX(q->peak_size, q->size);
+    }
+
+    ost->muxing_queue_packets++;
+    q->nb_packets++;
+    return 0;
+}
+
+/* write the queued packets in the order they were queued */
+static int muxing_queue_flush(OutputFile *of)
+{
+    MuxQueue *q = &of->muxing_queue;
+    OutputStream *ost;
+    AVPacket *pkt;
+    int64_t i;
+    int ret;
+
+    while (av_fifo_read(q->fifo, &pkt, 1) >= 0) {
+        ost = output_streams[of->ost_index + pkt->stream_index];
+        ost->muxing_queue_packets--;
+        q->size -= sizeof(*pkt) + pkt->size;
+        of_write_packet(of, pkt, ost, 1);
+        av_packet_free(&pkt);
+    }
+    if (!q->spill)
+        return 0;
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    ret = avio_closep(&q->spill);
+    if (ret >= 0)
+        ret = avio_open(&q->spill, q->spill_path, AVIO_FLAG_READ);
+    for (i = 0; ret >= 0 && i < q->spill_packets; i++) {
+        ret = spill_read(q->spill, pkt);
+        if (ret >= 0 && pkt->stream_index >= of->ctx->nb_streams)
+            ret = AVERROR_INVALIDDATA;
+        if (ret < 0)
+            break;
+        ost = output_streams[of->ost_index + pkt->stream_index];
+        ost->muxing_queue_packets--;
+        of_write_packet(of, pkt, ost, 1);
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error reading the muxing queue of output "
+               "file #%d from %s: %s\n", of->index, q->spill_path, av_err2str(ret));
+    spill_close(q);
+    return ret;
+}
+
+static void muxing_queue_free(MuxQueue *q)
+{
+    AVPacket *pkt;
+
+    if (q->fifo) {
+        while (av_fifo_read(q->fifo, &pkt, 1) >= 0)
+            av_packet_free(&pkt);
+        av_fifo_freep2(&q->fifo);
+    }
+    spill_close(q);
+}
+
+void of_bprint_muxing_queue(AVBPrint *buf, OutputFile *of)
+{
+    const MuxQueue *q = &of->muxing_queue;
+    int64_t queued = q->fifo ? av_fifo_can_read(q->fifo) : 0;
+
+    if (q->spill)
+        queued += q->spill_packets;
+    av_bprintf(buf, "{\"file\":%d,\"packets\":%"PRId64",\"queued\":%"PRId64","
+               "\"bytes\":%zu,\"peak_bytes\":%zu,\"spilled_packets\":%"PRId64","
+               "\"spilled_bytes\":%"PRId64"}",
+               of->index, q->nb_packets, queued, q->size, q->peak_size,
+               q->spill_packets, q->spill_bytes);
+}
+
+/*
+ * Publish the position of the AVIOContext of of after a write, so the main
+ * thread reads the size of the file (-fs, progress report) without touching
+ * the AVIOContext while a mux thread writes it.
+ */
+static void update_filesize(OutputFile *of)
+{
+    if (of->ctx->pb)
+        atomic_store(&of->filesize, avio_tell(of->ctx->pb));
+}
+
+int64_t of_filesize(OutputFile *of)
+{
+    return atomic_load(&of->filesize);
+}
+
+#if HAVE_THREADS
+/*
+ * With -mux_thread_queue_size, once the header of an output file is written,
+ * av_interleaved_write_frame() and the writes of its AVIOContext run in a
+ * thread of the file, so the main loop does not stall on the muxer of one
+ * output while others wait for packets. Packets are prepared (timestamps,
+ * -frames, stats) in the main thread as before, then handed over by
+ * reference through a bounded queue, which keeps their order within the
+ * file. Finishing streams, and so -shortest, stays in the main thread.
+ *
+ * The mux time is kept in of->mux_thread_timers rather than the stage timers
+ * of the streams, which are shared with the main thread, so it shows in the
+ * stage stats once the file is finished.
+ *
+ * In the wasm build the filesystem is MEMFS, implemented in JS on the thread
+ * running main(): write() and seek() of the mux thread are proxied to it and
+ * only run when the main thread waits (for a packet, a queue, a lock). So
+ * the thread takes the interleaving, the formatting of the packets and the
+ * buffering of the AVIOContext off the main loop, but not the copies into
+ * MEMFS, which stay serialized with the main thread.
+ */
+static void *mux_thread(void *arg)
+{
+    OutputFile *of = arg;
+    AVPacket *pkt;
+    int64_t timer, now, pts;
+    int ret;
+
+    if (trace_enabled) {
+        char name[64];
+        snprintf(name, sizeof(name), "mux: %s", of->ctx->url);
+        trace_thread_name(name);
+    }
+
+    while (av_thread_message_queue_recv(of->mux_thread_queue, &pkt, 0) >= 0) {
+        OutputStream *ost = output_streams[of->ost_index + pkt->stream_index];
+        StageTimer *mux_timer = &of->mux_thread_timers[pkt->stream_index];
+
+        /* the packet is blank once written */
+        pts   = pkt->pts;
+        timer = av_gettime_relative();
+        ret = av_interleaved_write_frame(of->ctx, pkt);
+        now = av_gettime_relative();
+        mux_timer->time += now - timer;
+        mux_timer->count++;
+        update_filesize(of);
+        if (trace_enabled)
+            trace_event(STAGE_MUX, ost->file_index, ost->index, timer, now,
+                        pts, ost->st->time_base);
+        av_packet_free(&pkt);
+        if (ret < 0) {
+            print_error("av_interleaved_write_frame()", ret);
+            /* the main thread gets the error from its next send */
+            av_thread_message_queue_set_err_send(of->mux_thread_queue, ret);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int mux_thread_start(OutputFile *of)
+{
+    int ret;
+
+    if (of->mux_thread_queue_size < 0)
+        of->mux_thread_queue_size = nb_output_files > 1 ? 32 : 0;
+    if (!of->mux_thread_queue_size)
+        return 0;
+
+    of->mux_thread_timers = av_calloc(of->ctx->nb_streams,
+                                      sizeof(*of->mux_thread_timers));
+    if (!of->mux_thread_timers)
+        return AVERROR(ENOMEM);
+
+    ret = av_thread_message_queue_alloc(&of->mux_thread_queue,
+                                        of->mux_thread_queue_size, sizeof(AVPacket*));
+    if (ret < 0) {
+        av_freep(&of->mux_thread_timers);
+        return ret;
+    }
+
+    if ((ret = pthread_create(&of->mux_thread, NULL, mux_thread, of))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        av_thread_message_queue_free(&of->mux_thread_queue);
+        av_freep(&of->mux_thread_timers);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+/* the packet is moved to the queue, pkt is blank when this returns */
+static int mux_thread_send(OutputFile *of, AVPacket *pkt)
+{
+    AVPacket *queue_pkt;
+    int ret;
+
+    ret = av_packet_make_refcounted(pkt);
+    if (ret < 0)
+        return ret;
+    queue_pkt = av_packet_alloc();
+    if (!queue_pkt)
+        return AVERROR(ENOMEM);
+    av_packet_move_ref(queue_pkt, pkt);
+
+    ret = av_thread_message_queue_send(of->mux_thread_queue, &queue_pkt, 0);
+    if (ret < 0)
+        av_packet_free(&queue_pkt);
+    return ret;
+}
+
+/* wait for the queued packets to be written, and join the thread */
+static void mux_thread_stop(OutputFile *of)
+{
+    AVPacket *pkt;
+
+    if (!of->mux_thread_queue)
+        return;
+
+    av_thread_message_queue_set_err_recv(of->mux_thread_queue, AVERROR_EOF);
+    pthread_join(of->mux_thread, NULL);
+    /* left when the thread stopped on an error */
+    while (av_thread_message_queue_recv(of->mux_thread_queue, &pkt,
+                                        AV_THREAD_MESSAGE_NONBLOCK) >= 0)
+        av_packet_free(&pkt);
+    av_thread_message_queue_free(&of->mux_thread_queue);
+
+    /* the thread is joined, its timers can be merged */
+    for (int i = 0; i < of->ctx->nb_streams; i++) {
+        OutputStream *ost = output_streams[of->ost_index + i];
+        StageTimer *mux_timer = &of->mux_thread_timers[i];
+
+        ost->stage_timers[STAGE_MUX].time  += mux_timer->time;
+        ost->stage_timers[STAGE_MUX].count += mux_timer->count;
+        stage_busy_time += mux_timer->time;
+    }
+    av_freep(&of->mux_thread_timers);
+}
+#endif
+
+/* count the sample table entries of pkt, written to a file with -reserve_moov */
+static void moov_count(MoovCounts *c, const AVPacket *pkt)
+{
+    int64_t cts = pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE ?
+                  pkt->pts - pkt->dts : 0;
+
+    if (c->samples) {
+        int64_t delta = pkt->dts != AV_NOPTS_VALUE && c->last_dts != AV_NOPTS_VALUE ?
+                        pkt->dts - c->last_dts : INT64_MIN;
+        c->stts_entries += c->samples == 1 || delta != c->last_delta ||
+                           delta == INT64_MIN;
+        c->ctts_entries += cts != c->last_cts;
+        c->last_delta    = delta;
+    } else
+        c->ctts_entries = 1;
+    c->has_ctts  |= cts != 0;
+    c->keyframes += !!(pkt->flags & AV_PKT_FLAG_KEY);
+    c->bytes     += pkt->size;
+    c->last_dts   = pkt->dts;
+    c->last_cts   = cts;
+    c->samples++;
+}
+
 void of_write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost,
                      int unqueue)
 {
     AVFormatContext *s = of->ctx;
     AVStream *st = ost->st;
+    int64_t timer;
     int ret;
 
     /*
@@ -62,37 +443,19 @@ void of_write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost,
             return;
         }
         ost->frame_number++;
+        if (ost->frame_number >= ost->max_frames)
+            sched_max_frames(ost);
     }
 
     if (!of->header_written) {
-        AVPacket *tmp_pkt;
         /* the muxer is not initialized yet, buffer the packet */
-        if (!av_fifo_can_write(ost->muxing_queue)) {
-            size_t cur_size = av_fifo_can_read(ost->muxing_queue);
-            unsigned int are_we_over_size =
-                (ost->muxing_queue_data_size + pkt->size) > ost->muxing_queue_data_threshold;
-            size_t limit    = are_we_over_size ? ost->max_muxing_queue_size : SIZE_MAX;
-            size_t new_size = FFMIN(2 * cur_size, limit);
-
-            if (new_size <= cur_size) {
-                av_log(NULL, AV_LOG_ERROR,
-                       "Too many packets buffered for output stream %d:%d.\n",
-                       ost->file_index, ost->st->index);
-                exit_program(1);
-            }
-            ret = av_fifo_grow2(ost->muxing_queue, new_size - cur_size);
-            if (ret < 0)
-                exit_program(1);
-        }
-        ret = av_packet_make_refcounted(pkt);
-        if (ret < 0)
-            exit_program(1);
-        tmp_pkt = av_packet_alloc();
-        if (!tmp_pkt)
+        ret = muxing_queue_push(of, ost, pkt);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error buffering a packet for output stream %d:%d: %s\n",
+                   ost->file_index, ost->st->index, av_err2str(ret));
             exit_program(1);
-        av_packet_move_ref(tmp_pkt, pkt);
-        ost->muxing_queue_data_size += tmp_pkt->size;
-        av_fifo_write(ost->muxing_queue, &tmp_pkt, 1);
+        }
         return;
     }
 
@@ -148,9 +511,12 @@ void of_write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost,
         }
     }
     ost->last_mux_dts = pkt->dts;
+    sched_update(ost);
 
     ost->data_size += pkt->size;
     ost->packets_written++;
+    if (of->moov_reserved)
+        moov_count(&ost->moov, pkt);
 
     pkt->stream_index = ost->index;
 
@@ -165,9 +531,29 @@ void of_write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost,
               );
     }
 
-    ret = av_interleaved_write_frame(s, pkt);
+#if HAVE_THREADS
+    if (of->mux_thread_queue) {
+        ret = mux_thread_send(of, pkt);
+        if (ret < 0 && ret != AVERROR_EOF)
+            av_log(NULL, AV_LOG_ERROR, "Unable to send a packet of output stream "
+                   "%d:%d to the mux thread: %s\n",
+                   ost->file_index, ost->st->index, av_err2str(ret));
+    } else
+#endif
+    {
+        int64_t pts = pkt->pts;
+
+        timer = av_gettime_relative();
+        ret = av_interleaved_write_frame(s, pkt);
+        update_filesize(of);
+        stage_timer_update(ost->stage_timers, STAGE_MUX,
+                           ost->file_index, ost->index, timer, 1,
+                           pts, ost->st->time_base);
+        if (ret < 0)
+            print_error("av_interleaved_write_frame()", ret);
+    }
     if (ret < 0) {
-        print_error("av_interleaved_write_frame()", ret);
+        av_packet_unref(pkt);
         main_return_code = 1;
         close_all_output_streams(ost, MUXER_FINISHED | ENCODER_FINISHED, ENCODER_FINISHED);
     }
@@ -226,6 +612,273 @@ fail:
     return ret;
 }
 
+/*
+ * -reserve_moov: with -movflags +faststart, instead of writing moov after
+ * mdat and moving the whole mdat in a second pass of the trailer (which
+ * needs about twice the size of the output in MEMFS), the size of moov is
+ * estimated from the duration and the packet rate of each stream, and
+ * reserved before mdat with the moov_size option of the muxer, so moov is
+ * written in place. The unused part of the reservation stays in the output
+ * as a free atom.
+ *
+ * The estimate costs the sample tables the muxer writes: stsz for every
+ * sample, ctts only with B-frames, stss only for keyframes and stsc / co64
+ * per chunk, assuming a constant sample duration (stts) and keyframe
+ * interval. The entries of the packets actually written are counted, and
+ * when they may not fit in the reservation (ex. variable frame rate) the
+ * trailer falls back to the usual second pass.
+ */
+
+/* sizes of the atoms of a track and of a file besides the sample tables */
+#define MOOV_BYTES_PER_TRACK  4096
+#define MOOV_BYTES_PER_FILE   16384
+/* the muxer starts a new chunk past 1 MiB */
+#define MOV_CHUNK_SIZE        (1 << 20)
+
+static int64_t mov_flag(void *priv, const char *name)
+{
+    const AVOption *o = av_opt_find(priv, name, "movflags", 0, 0);
+    return o ? o->default_val.i64 : 0;
+}
+
+static int64_t dict_size(const AVDictionary *m)
+{
+    const AVDictionaryEntry *e = NULL;
+    int64_t size = 0;
+
+    while ((e = av_dict_get(m, "", e, AV_DICT_IGNORE_SUFFIX)))
+        size += strlen(e->key) + strlen(e->value) + 32;
+    return size;
+}
+
+/* duration of an input file in AV_TIME_BASE, or AV_NOPTS_VALUE if unknown */
+static int64_t input_duration(const InputFile *f)
+{
+    int64_t duration = f->ctx->duration;
+
+    if (duration == AV_NOPTS_VALUE || duration <= 0 || f->loop < 0)
+        return AV_NOPTS_VALUE;
+    duration *= f->loop + 1;
+    if (f->start_time != AV_NOPTS_VALUE && f->start_time > 0)
+        duration = FFMAX(duration - f->start_time, 0);
+    return FFMIN(duration, f->recording_time);
+}
+
+/* estimate the sample table entries of ost from its duration */
+static int estimate_moov_counts(const OutputFile *of, const OutputStream *ost,
+                                MoovCounts *c)
+{
+    const AVCodecParameters *par = ost->st->codecpar;
+    int64_t duration = of->recording_time;
+    double rate, seconds;
+    int i;
+
+    if (ost->source_index >= 0) {
+        int64_t d = input_duration(input_files[input_streams[ost->source_index]->file_index]);
+        if (d != AV_NOPTS_VALUE)
+            duration = FFMIN(duration, d);
+    } else {
+        int64_t max = AV_NOPTS_VALUE;
+        for (i = 0; i < nb_input_files; i++) {
+            int64_t d = input_duration(input_files[i]);
+            if (d == AV_NOPTS_VALUE) {
+                max = AV_NOPTS_VALUE;
+                break;
+            }
+            max = FFMAX(max, d);
+        }
+        if (nb_input_files && max != AV_NOPTS_VALUE)
+            duration = FFMIN(duration, max);
+    }
+    if (duration == INT64_MAX)
+        return -1;
+    seconds = duration / (double)AV_TIME_BASE;
+
+    switch (par->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        rate = ost->st->avg_frame_rate.num ? av_q2d(ost->st->avg_frame_rate) :
+               ost->frame_rate.num         ? av_q2d(ost->frame_rate)         : 60;
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        rate = par->sample_rate / (double)(par->frame_size > 0 ? par->frame_size : 512);
+        break;
+    default:
+        rate = 10;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->samples      = seconds * rate * 9 / 8 + 16;
+    c->bytes        = par->bit_rate > 0 ? seconds * par->bit_rate / 8 * 9 / 8 :
+                      INT64_MAX;
+    c->stts_entries = 1;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+        int gop = ost->encoding_needed && ost->enc_ctx->gop_size > 0 ?
+                  ost->enc_ctx->gop_size : FFMAX(rate / 2, 1);
+
+        c->has_ctts     = par->video_delay > 0;
+        c->ctts_entries = c->samples;
+        c->keyframes    = c->samples / gop + 1;
+    } else
+        c->keyframes    = c->samples;
+    return 0;
+}
+
+/*
+ * Upper bound of the size of the sample tables of a track with the entries
+ * of c. Chunks of the track are separated by samples of the other tracks
+ * (other_samples), or split by the muxer when they reach MOV_CHUNK_SIZE.
+ */
+static int64_t moov_tables_size(const MoovCounts *c, enum AVMediaType type,
+                                int64_t other_samples)
+{
+    int64_t chunks = FFMIN(c->samples,
+                           other_samples + 2 * (c->bytes / MOV_CHUNK_SIZE) + 2);
+    int64_t size   = 4  * c->samples             /* stsz */
+                   + 8  * (c->stts_entries + 2)  /* stts */
+                   + 20 * chunks;                /* stsc, co64 */
+
+    if (c->has_ctts)
+        size += 8 * (c->ctts_entries + 2);       /* ctts */
+    if (c->keyframes < c->samples)
+        size += 4 * c->keyframes;                /* stss */
+    if (type == AVMEDIA_TYPE_VIDEO)
+        size += c->samples + 4 * c->keyframes;   /* sdtp, stps */
+    return size;
+}
+
+/* upper bound of the size of moov, from the packets written if estimate is 0 */
+static int64_t moov_size_bound(OutputFile *of, int estimate)
+{
+    AVFormatContext *s = of->ctx;
+    int64_t size = MOOV_BYTES_PER_FILE + dict_size(s->metadata) + s->nb_chapters * 256;
+    int64_t samples = 0;
+    MoovCounts c;
+    int i;
+
+    /* the counts are computed twice, first for the samples of all tracks */
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *ost = output_streams[of->ost_index + i];
+
+        if (estimate && estimate_moov_counts(of, ost, &c) < 0)
+            return -1;
+        samples += estimate ? c.samples : ost->moov.samples;
+    }
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *ost = output_streams[of->ost_index + i];
+
+        if (estimate)
+            estimate_moov_counts(of, ost, &c);
+        else
+            c = ost->moov;
+        size += MOOV_BYTES_PER_TRACK + ost->st->codecpar->extradata_size +
+                dict_size(ost->st->metadata) +
+                moov_tables_size(&c, ost->st->codecpar->codec_type,
+                                 samples - c.samples);
+    }
+    return size;
+}
+
+/* called before avformat_write_header(), replace faststart by a reservation */
+static void reserve_moov_init(OutputFile *of)
+{
+    AVFormatContext *s = of->ctx;
+    const char *proto = avio_find_protocol_name(s->url);
+    const AVDictionaryEntry *e;
+    int64_t flags, size;
+
+    if (!s->priv_data || !mov_flag(s->priv_data, "faststart") ||
+        av_dict_get(of->opts, "moov_size", NULL, 0) ||
+        !s->pb || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL) ||
+        !proto || strcmp(proto, "file"))
+        return;
+
+    /* -movflags is only applied by avformat_write_header(), apply it now */
+    e = av_dict_get(of->opts, "movflags", NULL, 0);
+    if (!e || av_opt_set(s->priv_data, "movflags", e->value, 0) < 0)
+        return;
+    av_dict_set(&of->opts, "movflags", NULL, 0);
+    if (av_opt_get_int(s->priv_data, "movflags", 0, &flags) < 0 ||
+        !(flags & mov_flag(s->priv_data, "faststart")) ||
+        flags & (mov_flag(s->priv_data, "empty_moov") |
+                 mov_flag(s->priv_data, "frag_keyframe") |
+                 mov_flag(s->priv_data, "frag_custom") |
+                 mov_flag(s->priv_data, "frag_every_frame") |
+                 mov_flag(s->priv_data, "delay_moov")))
+        return;
+
+    size = moov_size_bound(of, 1);
+    if (size < 0 || size > INT_MAX) {
+        av_log(NULL, AV_LOG_VERBOSE, "Duration of output file #%d is unknown, "
+               "moov is moved after mdat is written\n", of->index);
+        return;
+    }
+    if (av_opt_set(s->priv_data, "movflags", "-faststart", 0) < 0 ||
+        av_opt_set_int(s->priv_data, "moov_size", size, 0) < 0)
+        return;
+    of->moov_reserved = size;
+    of->moov_reserved_pos = -1;
+    av_log(NULL, AV_LOG_VERBOSE, "Reserving %"PRId64" bytes for moov of "
+           "output file #%d\n", size, of->index);
+}
+
+/*
+ * Called after avformat_write_header(), label the reservation (zeroed until
+ * moov is written) as a free atom, so the output stays valid if moov is
+ * written elsewhere by the fallback. The layout is checked rather than
+ * assumed: ftyp, the reservation, then mdat (or wide).
+ */
+static void reserve_moov_mark(OutputFile *of)
+{
+    AVIOContext *pb = of->ctx->pb, *read_pb;
+    int64_t end = avio_tell(pb), pos;
+    uint8_t buf[8];
+    uint32_t tag;
+    int ok;
+
+    avio_flush(pb);
+    if (avio_open(&read_pb, of->ctx->url, AVIO_FLAG_READ) < 0)
+        goto fail;
+    pos = avio_rb32(read_pb);
+    ok  = avio_rl32(read_pb) == MKTAG('f', 't', 'y', 'p') &&
+          avio_seek(read_pb, pos, SEEK_SET) == pos &&
+          avio_read(read_pb, buf, sizeof(buf)) == sizeof(buf) && !AV_RN64(buf) &&
+          avio_seek(read_pb, pos + of->moov_reserved + 4, SEEK_SET) >= 0;
+    tag = avio_rl32(read_pb);
+    avio_closep(&read_pb);
+    if (!ok || (tag != MKTAG('m', 'd', 'a', 't') && tag != MKTAG('w', 'i', 'd', 'e')))
+        goto fail;
+
+    avio_seek(pb, pos, SEEK_SET);
+    avio_wb32(pb, of->moov_reserved);
+    avio_wl32(pb, MKTAG('f', 'r', 'e', 'e'));
+    avio_seek(pb, end, SEEK_SET);
+    of->moov_reserved_pos = pos;
+    return;
+
+fail:
+    av_log(NULL, AV_LOG_WARNING, "Unexpected layout of output file #%d, "
+           "moov must fit in the %"PRId64" bytes reserved\n",
+           of->index, of->moov_reserved);
+}
+
+/* called before av_write_trailer(), fall back to faststart on overflow */
+static void reserve_moov_check(OutputFile *of)
+{
+    void *priv = of->ctx->priv_data;
+    int64_t size = moov_size_bound(of, 0);
+
+    if (size <= of->moov_reserved || of->moov_reserved_pos < 0)
+        return;
+
+    av_log(NULL, AV_LOG_WARNING, "moov of output file #%d may not fit in the "
+           "%"PRId64" bytes reserved, it is moved in a second pass\n",
+           of->index, of->moov_reserved);
+    if (av_opt_set_int(priv, "moov_size", 0, 0) < 0 ||
+        av_opt_set(priv, "movflags", "+faststart", 0) < 0)
+        av_log(NULL, AV_LOG_ERROR, "Cannot enable faststart of output file #%d\n",
+               of->index);
+}
+
 /* open the muxer when all the streams are initialized */
 int of_check_init(OutputFile *of)
 {
@@ -237,6 +890,9 @@ int of_check_init(OutputFile *of)
             return 0;
     }
 
+    if (of->reserve_moov)
+        reserve_moov_init(of);
+
     ret = avformat_write_header(of->ctx, &of->opts);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR,
@@ -247,6 +903,16 @@ int of_check_init(OutputFile *of)
     }
     //assert_avoptions(of->opts);
     of->header_written = 1;
+    update_filesize(of);
+
+    if (of->moov_reserved)
+        reserve_moov_mark(of);
+
+#if HAVE_THREADS
+    ret = mux_thread_start(of);
+    if (ret < 0)
+        return ret;
+#endif
 
     av_dump_format(of->ctx, of->index, of->ctx->url, 1);
     nb_output_dumped++;
@@ -259,23 +925,15 @@ int of_check_init(OutputFile *of)
         }
     }
 
-    /* flush the muxing queues */
+    /* try to improve muxing time_base (only possible if nothing has been written yet) */
     for (i = 0; i < of->ctx->nb_streams; i++) {
         OutputStream *ost = output_streams[of->ost_index + i];
-        AVPacket *pkt;
-
-        /* try to improve muxing time_base (only possible if nothing has been written yet) */
-        if (!av_fifo_can_read(ost->muxing_queue))
+        if (!ost->muxing_queue_packets)
             ost->mux_timebase = ost->st->time_base;
-
-        while (av_fifo_read(ost->muxing_queue, &pkt, 1) >= 0) {
-            ost->muxing_queue_data_size -= pkt->size;
-            of_write_packet(of, pkt, ost, 1);
-            av_packet_free(&pkt);
-        }
     }
 
-    return 0;
+    /* flush the muxing queue */
+    return muxing_queue_flush(of);
 }
 
 int of_write_trailer(OutputFile *of)
@@ -290,12 +948,25 @@ int of_write_trailer(OutputFile *of)
         return AVERROR(EINVAL);
     }
 
+#if HAVE_THREADS
+    mux_thread_stop(of);
+#endif
+
+    if (of->moov_reserved)
+        reserve_moov_check(of);
+
     ret = av_write_trailer(of->ctx);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Error writing trailer of %s: %s\n", of->ctx->url, av_err2str(ret));
         return ret;
     }
 
+    /* the trailer may have moved back into the file (moov of mp4) */
+    if (of->ctx->pb) {
+        int64_t size = avio_size(of->ctx->pb);
+        atomic_store(&of->filesize, FFMAX(size, avio_tell(of->ctx->pb)));
+    }
+
     return 0;
 }
 
@@ -307,6 +978,11 @@ void of_close(OutputFile **pof)
     if (!of)
         return;
 
+#if HAVE_THREADS
+    mux_thread_stop(of);
+#endif
+    muxing_queue_free(&of->muxing_queue);
+
     s = of->ctx;
     if (s && s->oformat && !(s->oformat->flags & AVFMT_NOFILE))
         avio_closep(&s->pb);
@@ -20,6 +20,7 @@
 
 #include "config.h"
 
+#include <stdarg.h>
 #include <stdint.h>
 
 #if HAVE_SYS_RESOURCE_H
@@ -27,6 +28,10 @@
 #include <sys/resource.h>
 #endif
 
+#if defined(__EMSCRIPTEN__)
+#include <emscripten.h>
+#endif
+
 #include "ffmpeg.h"
 #include "fopen_utf8.h"
 #include "cmdutils.h"
@@ -44,6 +49,7 @@
 #include "libavutil/avutil.h"
 #include "libavutil/bprint.h"
 #include "libavutil/channel_layout.h"
+#include "libavutil/eval.h"
 #include "libavutil/getenv_utf8.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/fifo.h"
@@ -100,8 +106,6 @@ static const char *const opt_name_fix_sub_duration[]          = {"fix_sub_durati
 static const char *const opt_name_canvas_sizes[]              = {"canvas_size", NULL};
 static const char *const opt_name_pass[]                      = {"pass", NULL};
 static const char *const opt_name_passlogfiles[]              = {"passlogfile", NULL};
-static const char *const opt_name_max_muxing_queue_size[]     = {"max_muxing_queue_size", NULL};
-static const char *const opt_name_muxing_queue_data_threshold[] = {"muxing_queue_data_threshold", NULL};
 static const char *const opt_name_guess_layout_max[]          = {"guess_layout_max", NULL};
 static const char *const opt_name_apad[]                      = {"apad", NULL};
 static const char *const opt_name_discard[]                   = {"discard", NULL};
@@ -150,6 +154,7 @@ static const char *const opt_name_bits_per_raw_sample[]       = {"bits_per_raw_s
 HWDevice *filter_hw_device;
 
 char *vstats_filename;
+char *trace_filename;
 char *sdp_filename;
 
 float audio_drift_threshold = 0.1;
@@ -189,6 +194,8 @@ static int ignore_unknown_streams = 0;
 static int copy_unknown_streams = 0;
 static int recast_media = 0;
 static int find_stream_info = 1;
+/* every output is -c copy, set before the inputs are opened */
+static int remux_only = 0;
 
 static void uninit_options(OptionsContext *o)
 {
@@ -232,10 +239,15 @@ static void init_options(OptionsContext *o)
     o->start_time_eof = AV_NOPTS_VALUE;
     o->recording_time = INT64_MAX;
     o->limit_filesize = UINT64_MAX;
+    o->mux_queue_size = 50 * 1024 * 1024;
+    o->mux_spill_dir  = "/tmp";
     o->chapters_input_file = INT_MAX;
     o->accurate_seek  = 1;
     o->thread_queue_size = -1;
+    o->mux_thread_queue_size = -1;
     o->input_sync_ref = -1;
+    o->fast_probe     = 1;
+    o->ladder_gop     = 2;
 }
 
 static int show_hwaccels(void *optctx, const char *opt, const char *arg)
@@ -821,6 +833,7 @@ static const AVCodec *find_codec_or_die(const char *name, enum AVMediaType type,
     const char *codec_string = encoder ? "encoder" : "decoder";
     const AVCodec *codec;
 
+    require_side_modules(name);
     codec = encoder ?
         avcodec_find_encoder_by_name(name) :
         avcodec_find_decoder_by_name(name);
@@ -1145,6 +1158,167 @@ static void dump_attachment(AVStream *st, const char *filename)
     avio_close(out);
 }
 
+/* size of the AVIOContext buffer of a js: input */
+#define JS_INPUT_BUFFER_SIZE (64 * 1024)
+
+/* Inputs named js:NAME are read with Module.readInput(), which blocks until
+ * data is pushed from JS or the input is closed (0, end of file). The call
+ * is proxied to the main runtime thread, input threads of ffmpeg-core-mt
+ * have no access to the reader. */
+static int read_js_input(void *opaque, uint8_t *buf, int size)
+{
+    int ret = MAIN_THREAD_EM_ASM_INT({
+        return Module.readInput(UTF8ToString($0), $1, $2);
+    }, opaque, buf, size);
+
+    return ret > 0 ? ret : ret == 0 ? AVERROR_EOF : AVERROR(EIO);
+}
+
+static AVIOContext *open_js_input(const char *name)
+{
+    uint8_t *buf = av_malloc(JS_INPUT_BUFFER_SIZE);
+    char *opaque = av_strdup(name);
+    AVIOContext *pb = NULL;
+
+    if (buf && opaque)
+        pb = avio_alloc_context(buf, JS_INPUT_BUFFER_SIZE, 0, opaque,
+                                read_js_input, NULL, NULL);
+    if (!pb) {
+        av_free(buf);
+        av_free(opaque);
+    }
+    return pb;
+}
+
+/* Limits of avformat_find_stream_info() when the header describes every
+ * stream, only the first packets are read to get what needs a decoded frame
+ * (pixel / sample format) and the start time. */
+#define FAST_PROBE_SIZE     (1 << 20)
+#define FAST_PROBE_DURATION (AV_TIME_BASE / 2)
+
+/* demuxers whose header describes all streams */
+static const char *const fast_probe_formats[] = { "mov", "matroska", NULL };
+
+/* Return the first parameter of st which is not given by the header, or NULL
+ * when the header is enough to set up the stream. */
+static const char *stream_missing_param(const AVStream *st)
+{
+    const AVCodecParameters *par = st->codecpar;
+
+    if (par->codec_id == AV_CODEC_ID_NONE)
+        return "codec";
+
+    switch (par->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (!par->width || !par->height)
+            return "size";
+        if (!st->avg_frame_rate.num && !(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+            return "frame rate";
+        break;
+    case AVMEDIA_TYPE_AUDIO:
+        if (!par->sample_rate)
+            return "sample rate";
+        if (!par->ch_layout.nb_channels)
+            return "channel layout";
+        break;
+    default:
+        break;
+    }
+    return NULL;
+}
+
+/* Lower the limits of avformat_find_stream_info() when every stream is
+ * complete in the header, so it stops after the first packets instead of
+ * analyzing seconds of every stream. Files with an incomplete stream keep
+ * the default limits, which only apply to the streams still missing
+ * parameters. Return 1 when the limits were lowered. */
+static int setup_fast_probe(AVFormatContext *ic, const char *filename)
+{
+    const char *missing;
+    int i, j;
+
+    for (i = 0; fast_probe_formats[i]; i++)
+        if (av_match_name(fast_probe_formats[i], ic->iformat->name))
+            break;
+    if (!fast_probe_formats[i])
+        return 0;
+
+    for (j = 0; j < ic->nb_streams; j++) {
+        if ((missing = stream_missing_param(ic->streams[j]))) {
+            av_log(NULL, AV_LOG_VERBOSE, "%s: stream #%d has no %s in the header, "
+                   "probing with default limits\n", filename, j, missing);
+            return 0;
+        }
+    }
+
+    ic->probesize            = FFMIN(ic->probesize, FAST_PROBE_SIZE);
+    ic->max_analyze_duration = FAST_PROBE_DURATION;
+    ic->fps_probe_size       = 0;
+    return 1;
+}
+
+/* When every output is -c copy nothing is decoded, so the pixel / sample
+ * formats found by decoding the first frames are not needed. The MP4 header
+ * gives everything else, and the start time of the streams which have an
+ * edit list, so avformat_find_stream_info() is skipped entirely.
+ * Return 1 when the stream info is taken from the header only. */
+static int setup_header_probe(AVFormatContext *ic)
+{
+    int64_t start_time = INT64_MAX, duration = 0;
+    int i;
+
+    if (!av_match_name("mov", ic->iformat->name) || !ic->nb_streams)
+        return 0;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        const AVStream *st = ic->streams[i];
+
+        if (stream_missing_param(st))
+            return 0;
+        if (st->start_time != AV_NOPTS_VALUE)
+            start_time = FFMIN(start_time, av_rescale_q(st->start_time, st->time_base,
+                                                       AV_TIME_BASE_Q));
+        if (st->duration != AV_NOPTS_VALUE)
+            duration = FFMAX(duration, av_rescale_q(st->duration, st->time_base,
+                                                    AV_TIME_BASE_Q));
+    }
+    /* without a start time the timestamps could not be shifted to 0 */
+    if (start_time == INT64_MAX)
+        return 0;
+
+    if (ic->start_time == AV_NOPTS_VALUE)
+        ic->start_time = start_time;
+    if (ic->duration == AV_NOPTS_VALUE && duration)
+        ic->duration = duration;
+    return 1;
+}
+
+/* Return 1 when every output file has -c copy and no other codec, so the
+ * inputs are only remuxed. */
+static int outputs_copy_only(const OptionGroupList *l)
+{
+    int i, j;
+
+    for (i = 0; i < l->nb_groups; i++) {
+        const OptionGroup *g = &l->groups[i];
+        int copy = 0;
+
+        for (j = 0; j < g->nb_opts; j++) {
+            const Option *o = &g->opts[j];
+
+            if (!av_match_name(o->opt->name, "c,codec,vcodec,acodec,scodec,dcodec"))
+                continue;
+            if (strcmp(o->val, "copy"))
+                return 0;
+            if (!strcmp(o->key, "c") || !strcmp(o->key, "codec"))
+                copy = 1;
+        }
+        if (!copy)
+            return 0;
+    }
+    return l->nb_groups > 0;
+}
+
 static int open_input_file(OptionsContext *o, const char *filename)
 {
     InputFile *f;
@@ -1159,6 +1333,11 @@ static int open_input_file(OptionsContext *o, const char *filename)
     char *subtitle_codec_name = NULL;
     char *    data_codec_name = NULL;
     int scan_all_pmts_set = 0;
+    int fast_probe = 0, header_probe = 0;
+    int64_t open_time, find_stream_info_time = 0;
+    SeekIndex *seek_index = NULL;
+    AVIOContext *js_pb = NULL;
+    const char *js_name;
 
     if (o->stop_time != INT64_MAX && o->recording_time != INT64_MAX) {
         o->stop_time = INT64_MAX;
@@ -1256,12 +1435,28 @@ static int open_input_file(OptionsContext *o, const char *filename)
         ic->flags |= AVFMT_FLAG_BITEXACT;
     ic->interrupt_callback = int_cb;
 
+    if (av_strstart(filename, "js:", &js_name)) {
+        js_pb = open_js_input(js_name);
+        if (!js_pb) {
+            print_error(filename, AVERROR(ENOMEM));
+            exit_program(1);
+        }
+        ic->pb = js_pb;
+    }
+
     if (!av_dict_get(o->g->format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
         av_dict_set(&o->g->format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
+    /* limits given by the user always win over fast probe */
+    if (av_dict_get(o->g->format_opts, "probesize", NULL, 0) ||
+        av_dict_get(o->g->format_opts, "analyzeduration", NULL, 0) ||
+        av_dict_get(o->g->format_opts, "fpsprobesize", NULL, 0))
+        o->fast_probe = 0;
     /* open the input file with generic avformat function */
+    open_time = av_gettime_relative();
     err = avformat_open_input(&ic, filename, file_iformat, &o->g->format_opts);
+    open_time = av_gettime_relative() - open_time;
     if (err < 0) {
         print_error(filename, err);
         if (err == AVERROR_PROTOCOL_NOT_FOUND)
@@ -1277,13 +1472,25 @@ static int open_input_file(OptionsContext *o, const char *filename)
     for (i = 0; i < ic->nb_streams; i++)
         choose_decoder(o, ic, ic->streams[i]);
 
-    if (find_stream_info) {
+    if (find_stream_info && remux_only && o->fast_probe && setup_header_probe(ic)) {
+        header_probe = 1;
+        av_log(NULL, AV_LOG_VERBOSE, "%s: stream info taken from the header, "
+               "all outputs are stream copies\n", filename);
+    } else if (find_stream_info) {
         AVDictionary **opts = setup_find_stream_info_opts(ic, o->g->codec_opts);
         int orig_nb_streams = ic->nb_streams;
 
+        if (o->fast_probe)
+            fast_probe = setup_fast_probe(ic, filename);
+
         /* If not enough info to get the stream parameters, we decode the
            first frames to get it. (used in mpeg case for example) */
+        find_stream_info_time = av_gettime_relative();
         ret = avformat_find_stream_info(ic, opts);
+        find_stream_info_time = av_gettime_relative() - find_stream_info_time;
+        av_log(NULL, AV_LOG_VERBOSE, "%s: stream info found in %.1fms%s\n",
+               filename, find_stream_info_time / 1000.0,
+               fast_probe ? " (fast probe)" : "");
 
         for (i = 0; i < orig_nb_streams; i++)
             av_dict_free(&opts[i]);
@@ -1317,6 +1524,9 @@ static int open_input_file(OptionsContext *o, const char *filename)
         } else
             av_log(NULL, AV_LOG_WARNING, "Cannot use -sseof, duration of %s not known\n", filename);
     }
+    if (o->seek_index)
+        seek_index = seek_index_open(ic, filename, o->seek_index);
+
     timestamp = (o->start_time == AV_NOPTS_VALUE) ? 0 : o->start_time;
     /* add the stream start time */
     if (!o->seek_timestamp && ic->start_time != AV_NOPTS_VALUE)
@@ -1364,6 +1574,12 @@ static int open_input_file(OptionsContext *o, const char *filename)
     f->nb_streams = ic->nb_streams;
     f->rate_emu   = o->rate_emu;
     f->accurate_seek = o->accurate_seek;
+    f->fast_probe = fast_probe;
+    f->header_probe = header_probe;
+    f->open_time = open_time;
+    f->find_stream_info_time = find_stream_info_time;
+    f->seek_index = seek_index;
+    f->js_pb = js_pb;
     f->loop = o->loop;
     f->duration = 0;
     f->time_base = (AVRational){ 1, 1 };
@@ -1502,6 +1718,7 @@ static int choose_encoder(OptionsContext *o, AVFormatContext *s, OutputStream *o
                        avcodec_get_name(ost->st->codecpar->codec_id));
                 return AVERROR_ENCODER_NOT_FOUND;
             }
+            require_side_modules(ost->enc->name);
         } else if (!strcmp(codec_name, "copy"))
             ost->stream_copy = 1;
         else {
@@ -1675,14 +1892,6 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
     MATCH_PER_STREAM_OPT(disposition, str, ost->disposition, oc, st);
     ost->disposition = av_strdup(ost->disposition);
 
-    ost->max_muxing_queue_size = 128;
-    MATCH_PER_STREAM_OPT(max_muxing_queue_size, i, ost->max_muxing_queue_size, oc, st);
-
-    ost->muxing_queue_data_size = 0;
-
-    ost->muxing_queue_data_threshold = 50*1024*1024;
-    MATCH_PER_STREAM_OPT(muxing_queue_data_threshold, i, ost->muxing_queue_data_threshold, oc, st);
-
     MATCH_PER_STREAM_OPT(bits_per_raw_sample, i, ost->bits_per_raw_sample,
                          oc, st);
 
@@ -1703,10 +1912,6 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
     }
     ost->last_mux_dts = AV_NOPTS_VALUE;
 
-    ost->muxing_queue = av_fifo_alloc2(8, sizeof(AVPacket*), 0);
-    if (!ost->muxing_queue)
-        exit_program(1);
-
     MATCH_PER_STREAM_OPT(copy_initial_nonkeyframes, i,
                          ost->copy_initial_nonkeyframes, oc, st);
 
@@ -2409,6 +2614,155 @@ static void set_channel_layout(OutputFilter *f, OutputStream *ost)
     av_channel_layout_default(&f->ch_layout, ost->enc_ctx->ch_layout.nb_channels);
 }
 
+typedef struct LadderRung {
+    int width, height;
+    double bitrate;
+} LadderRung;
+
+static int cmp_rung(const void *a, const void *b)
+{
+    const LadderRung *ra = a, *rb = b;
+    /* largest first, each rung is scaled from the one before */
+    return FFDIFFSIGN(rb->height, ra->height);
+}
+
+static void set_ladder_opt(AVDictionary **dict, const char *key, const char *fmt, ...)
+{
+    char val[256];
+    va_list vl;
+
+    va_start(vl, fmt);
+    vsnprintf(val, sizeof(val), fmt, vl);
+    va_end(vl);
+    /* options given on the command line win */
+    av_dict_set(dict, key, val, AV_DICT_DONT_OVERWRITE);
+}
+
+/*
+ * -ladder WxH:bitrate,...: the first video stream of the first input is
+ * decoded once, then scaled by a cascade of scalers where each rung is
+ * scaled from the rung above (1080p -> 720p -> 480p) instead of every rung
+ * from the source. The graph is a complex filtergraph whose outputs are
+ * mapped to the video streams of this output in order, with the first
+ * audio stream of the input. Keyframes are forced every -ladder_gop
+ * seconds in all rungs, so HLS (one variant per rung, %v in the output
+ * name) and DASH segments are aligned.
+ */
+static void setup_ladder(OptionsContext *o, const char *filename)
+{
+    const AVOutputFormat *ofmt = av_guess_format(o->format, filename, NULL);
+    FilterGraph *fg;
+    LadderRung *rungs = NULL;
+    AVBPrint bp;
+    char *list, *token, *saveptr = NULL;
+    char key[32], label[64];
+    int nb_rungs = 0, has_audio = 0, i;
+
+    if (!nb_input_files) {
+        av_log(NULL, AV_LOG_FATAL, "-ladder requires an input file\n");
+        exit_program(1);
+    }
+
+    list = av_strdup(o->ladder);
+    if (!list)
+        exit_program(1);
+    for (token = av_strtok(list, ",", &saveptr); token;
+         token = av_strtok(NULL, ",", &saveptr)) {
+        LadderRung *r;
+        char *bitrate, *end;
+
+        GROW_ARRAY(rungs, nb_rungs);
+        r = &rungs[nb_rungs - 1];
+        bitrate = strchr(token, ':');
+        if (!bitrate || sscanf(token, "%dx%d", &r->width, &r->height) != 2 ||
+            r->height <= 0 || (r->width <= 0 && r->width != -2) ||
+            (r->bitrate = av_strtod(bitrate + 1, &end)) <= 0 || *end) {
+            av_log(NULL, AV_LOG_FATAL, "Invalid -ladder rung '%s', expected "
+                   "WxH:bitrate (ex. 1280x720:2800k, -2 for W keeps the "
+                   "aspect ratio)\n", token);
+            exit_program(1);
+        }
+    }
+    av_free(list);
+    if (!nb_rungs) {
+        av_log(NULL, AV_LOG_FATAL, "-ladder has no rung\n");
+        exit_program(1);
+    }
+    qsort(rungs, nb_rungs, sizeof(*rungs), cmp_rung);
+
+    /* [0:v:0]scale=1920:1080,split[r0][n0];[n0]scale=1280:720,split[r1][n1];... */
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "[0:v:0]");
+    for (i = 0; i < nb_rungs; i++) {
+        av_bprintf(&bp, "scale=%d:%d", rungs[i].width, rungs[i].height);
+        if (i < nb_rungs - 1)
+            av_bprintf(&bp, ",split[ladder%d_%d][ladder%d_next%d];[ladder%d_next%d]",
+                       nb_output_files, i, nb_output_files, i, nb_output_files, i);
+        else
+            av_bprintf(&bp, "[ladder%d_%d]", nb_output_files, i);
+    }
+    fg = ALLOC_ARRAY_ELEM(filtergraphs, nb_filtergraphs);
+    fg->index = nb_filtergraphs - 1;
+    if (av_bprint_finalize(&bp, &fg->graph_desc) < 0 ||
+        init_complex_filtergraph(fg) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Error initializing the -ladder filtergraph\n");
+        exit_program(1);
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "-ladder filtergraph: %s\n", fg->graph_desc);
+
+    for (i = 0; i < nb_rungs; i++) {
+        snprintf(label, sizeof(label), "[ladder%d_%d]", nb_output_files, i);
+        opt_map(o, "map", label);
+
+        /* capped VBR, as usual for ABR renditions */
+        snprintf(key, sizeof(key), "b:v:%d", i);
+        set_ladder_opt(&o->g->codec_opts, key, "%.0f", rungs[i].bitrate);
+        snprintf(key, sizeof(key), "maxrate:v:%d", i);
+        set_ladder_opt(&o->g->codec_opts, key, "%.0f", rungs[i].bitrate);
+        snprintf(key, sizeof(key), "bufsize:v:%d", i);
+        set_ladder_opt(&o->g->codec_opts, key, "%.0f", 2 * rungs[i].bitrate);
+    }
+    for (i = 0; i < input_files[0]->ctx->nb_streams; i++)
+        if (input_files[0]->ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            has_audio = 1;
+    if (has_audio)
+        opt_map(o, "map", "0:a:0");
+
+    /* keyframes only at segment boundaries, at the same frames in all rungs */
+    if (!o->nb_forced_key_frames) {
+        char expr[64];
+        snprintf(expr, sizeof(expr), "expr:gte(t,n_forced*%g)", o->ladder_gop);
+        parse_option(o, "force_key_frames:v", expr, options);
+    }
+    set_ladder_opt(&o->g->codec_opts, "sc_threshold", "0");
+
+    if (ofmt && !strcmp(ofmt->name, "hls")) {
+        if (!strstr(filename, "%v")) {
+            av_log(NULL, AV_LOG_FATAL, "%s: an HLS output of -ladder needs %%v "
+                   "in its name, replaced by the rung index\n", filename);
+            exit_program(1);
+        }
+        av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+        if (has_audio)
+            av_bprintf(&bp, "a:0,agroup:audio");
+        for (i = 0; i < nb_rungs; i++)
+            av_bprintf(&bp, "%sv:%d%s", bp.len ? " " : "", i,
+                       has_audio ? ",agroup:audio" : "");
+        set_ladder_opt(&o->g->format_opts, "var_stream_map", "%s", bp.str);
+        av_bprint_finalize(&bp, NULL);
+        set_ladder_opt(&o->g->format_opts, "master_pl_name", "master.m3u8");
+        set_ladder_opt(&o->g->format_opts, "hls_time", "%g", o->ladder_gop);
+    } else if (ofmt && !strcmp(ofmt->name, "dash")) {
+        set_ladder_opt(&o->g->format_opts, "adaptation_sets", "%s",
+                       has_audio ? "id=0,streams=v id=1,streams=a" : "id=0,streams=v");
+        set_ladder_opt(&o->g->format_opts, "seg_duration", "%g", o->ladder_gop);
+    }
+
+    av_log(NULL, AV_LOG_INFO, "%s: %d renditions from one decode and %d scalers\n",
+           filename, nb_rungs, nb_rungs);
+    av_free(rungs);
+}
+
 static int open_output_file(OptionsContext *o, const char *filename)
 {
     AVFormatContext *oc;
@@ -2434,6 +2788,9 @@ static int open_output_file(OptionsContext *o, const char *filename)
         }
     }
 
+    if (o->ladder)
+        setup_ladder(o, filename);
+
     of = ALLOC_ARRAY_ELEM(output_files, nb_output_files);
 
     of->index          = nb_output_files - 1;
@@ -2442,11 +2799,27 @@ static int open_output_file(OptionsContext *o, const char *filename)
     of->start_time     = o->start_time;
     of->limit_filesize = o->limit_filesize;
     of->shortest       = o->shortest;
+    of->js_frames      = o->js_frames;
+    of->reserve_moov   = o->reserve_moov;
+    of->smart_cut      = o->smart_cut;
+    atomic_init(&of->filesize, 0);
+#if HAVE_THREADS
+    of->mux_thread_queue_size = o->mux_thread_queue_size;
+#endif
+    of->muxing_queue.max_size  = o->mux_queue_size;
+    of->muxing_queue.spill_dir = o->mux_spill_dir;
+    of->muxing_queue.fifo = av_fifo_alloc2(8, sizeof(AVPacket*), AV_FIFO_FLAG_AUTO_GROW);
+    if (!of->muxing_queue.fifo)
+        exit_program(1);
     av_dict_copy(&of->opts, o->g->format_opts, 0);
 
     if (!strcmp(filename, "-"))
         filename = "pipe:";
 
+    /* frames never reach the muxer, null only keeps the usual output setup */
+    if (o->js_frames)
+        o->format = "null";
+
     err = avformat_alloc_output_context2(&oc, NULL, o->format, filename);
     if (!oc) {
         print_error(filename, err);
@@ -2764,6 +3137,13 @@ loop_end:
     for (i = of->ost_index; i < nb_output_streams; i++) {
         OutputStream *ost = output_streams[i];
 
+        if (of->js_frames && !ost->encoding_needed) {
+            av_log(NULL, AV_LOG_ERROR, "-js_frames requires decoding, it cannot "
+                   "be used with streamcopy (output stream #%d:%d)\n",
+                   of->index, ost->index);
+            exit_program(1);
+        }
+
         if (ost->encoding_needed && ost->source_index >= 0) {
             InputStream *ist = input_streams[ost->source_index];
             ist->decoding_needed |= DECODING_FOR_OST;
@@ -2785,7 +3165,8 @@ loop_end:
             ist->processing_needed = 1;
         }
 
-        /* set the filter output constraints */
+        /* set the filter output constraints, frames sent to JS are only
+         * constrained by the user (ex. -pix_fmt), not by the null encoders */
         if (ost->filter) {
             OutputFilter *f = ost->filter;
             switch (ost->enc_ctx->codec_type) {
@@ -2795,24 +3176,24 @@ loop_end:
                 f->height     = ost->enc_ctx->height;
                 if (ost->enc_ctx->pix_fmt != AV_PIX_FMT_NONE) {
                     f->format = ost->enc_ctx->pix_fmt;
-                } else {
+                } else if (!of->js_frames) {
                     f->formats = ost->enc->pix_fmts;
                 }
                 break;
             case AVMEDIA_TYPE_AUDIO:
                 if (ost->enc_ctx->sample_fmt != AV_SAMPLE_FMT_NONE) {
                     f->format = ost->enc_ctx->sample_fmt;
-                } else {
+                } else if (!of->js_frames) {
                     f->formats = ost->enc->sample_fmts;
                 }
                 if (ost->enc_ctx->sample_rate) {
                     f->sample_rate = ost->enc_ctx->sample_rate;
-                } else {
+                } else if (!of->js_frames) {
                     f->sample_rates = ost->enc->supported_samplerates;
                 }
                 if (ost->enc_ctx->ch_layout.nb_channels) {
                     set_channel_layout(f, ost);
-                } else if (ost->enc->ch_layouts) {
+                } else if (ost->enc->ch_layouts && !of->js_frames) {
                     f->ch_layouts = ost->enc->ch_layouts;
                 }
                 break;
@@ -3573,6 +3954,8 @@ int ffmpeg_parse_options(int argc, char **argv)
     /* configure terminal and setup signal handlers */
     term_init();
 
+    remux_only = outputs_copy_only(&octx.groups[GROUP_OUTFILE]);
+
     /* open input files */
     ret = open_files(&octx.groups[GROUP_INFILE], "input", open_input_file);
     if (ret < 0) {
@@ -3718,6 +4101,8 @@ const OptionDef options[] = {
         "add timings for benchmarking" },
     { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
       "add timings for each task" },
+    { "trace_file",     HAS_ARG | OPT_STRING | OPT_EXPERT,           { &trace_filename },
+      "write a Chrome trace of pipeline events to file", "filename" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
@@ -3829,8 +4214,25 @@ const OptionDef options[] = {
     { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
                                                                      { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "mux_thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT,
+                                                                     { .off = OFFSET(mux_thread_queue_size) },
+        "set the maximum number of queued packets of the mux thread, 0 to mux in the main thread "
+        "(writes to MEMFS still run in the main thread)" },
     { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
+    { "seek_index",     HAS_ARG | OPT_STRING | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                     { .off = OFFSET(seek_index) },
+        "load and save the keyframes of the input in a sidecar file", "filename" },
+    { "js_frames",      OPT_BOOL | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(js_frames) },
+        "send filtered frames to the JS frame handler instead of encoding them" },
+    { "ladder",         HAS_ARG | OPT_STRING | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT,
+                                                                     { .off = OFFSET(ladder) },
+        "encode renditions of the first input video decoded once, scaled in cascade", "WxH:bitrate,..." },
+    { "ladder_gop",     HAS_ARG | OPT_FLOAT | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT,
+                                                                     { .off = OFFSET(ladder_gop) },
+        "seconds between keyframes aligned across -ladder renditions", "seconds" },
+    { "fast_probe",     OPT_BOOL | OPT_OFFSET | OPT_EXPERT | OPT_INPUT, { .off = OFFSET(fast_probe) },
+        "only read the first packets to find stream info when the header describes all streams" },
     { "bits_per_raw_sample", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_SPEC | OPT_OUTPUT,
         { .off = OFFSET(bits_per_raw_sample) },
         "set the number of bits per raw sample", "number" },
@@ -4009,9 +4411,21 @@ const OptionDef options[] = {
         "set options from indicated preset file", "filename" },
 
     { "max_muxing_queue_size", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(max_muxing_queue_size) },
-        "maximum number of packets that can be buffered while waiting for all streams to initialize", "packets" },
+        "deprecated, the muxing queue is bounded by -mux_queue_size", "packets" },
     { "muxing_queue_data_threshold", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(muxing_queue_data_threshold) },
-        "set the threshold after which max_muxing_queue_size is taken into account", "bytes" },
+        "deprecated, the muxing queue is bounded by -mux_queue_size", "bytes" },
+    { "mux_queue_size", HAS_ARG | OPT_INT64 | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(mux_queue_size) },
+        "maximum size of the packets held in memory while waiting for all streams to initialize, "
+        "the following ones are spilled to a temporary file", "bytes" },
+    { "reserve_moov", OPT_BOOL | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(reserve_moov) },
+        "with -movflags +faststart, reserve the estimated size of moov before mdat "
+        "instead of moving mdat in the trailer, the unused part of the reservation "
+        "(usually a fraction of the size of moov) is left as a free atom" },
+    { "smart_cut", OPT_BOOL | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(smart_cut) },
+        "with -c copy and -ss / -t / -to, encode again only the video frames between the cut "
+        "and the nearest keyframes" },
+    { "mux_spill_dir", HAS_ARG | OPT_STRING | OPT_OFFSET | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(mux_spill_dir) },
+        "directory of the temporary file of the muxing queue", "path" },
 
     /* data codec support */
     { "dcodec", HAS_ARG | OPT_DATA | OPT_PERFILE | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT, { .func_arg = opt_data_codec },
@@ -0,0 +1,267 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Output stream scheduling for transcode_step().
+ *
+ * Each step processes the unfinished output stream with the smallest dts
+ * sent to the muxer. Instead of scanning all output streams several times
+ * per step, which dominates jobs with tens of outputs (ABR ladders, one
+ * output per audio track, ...), the streams are kept in a binary min-heap
+ * updated by of_write_packet(), so a step costs O(log n):
+ *
+ * - finished flags are set in many places, so finished streams are only
+ *   dropped from the heap when they reach its top;
+ * - initialized, inputs_done and finished never go back to 0, so the first
+ *   stream to initialize and the first stream still needing output are
+ *   found with cursors which only move forward;
+ * - streams marked unavailable and streams which reached -frames are kept
+ *   in lists, cleared by sched_reset_eagain() and sched_need_output().
+ */
+
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+
+typedef struct Scheduler {
+    OutputStream **heap;        ///< unfinished streams, smallest dts first
+    int nb_heap;
+
+    int next_init;              ///< first stream which may be uninitialized
+    int next_live;              ///< first stream which may still need output
+
+    OutputStream **unavailable; ///< streams marked unavailable since the last reset
+    int nb_unavailable;
+
+    OutputStream **max_frames;  ///< streams which reached -frames
+    int nb_max_frames;
+    uint8_t *max_frames_seen;   ///< indexed like output_streams
+} Scheduler;
+
+static Scheduler sched;
+
+static int64_t stream_dts(const OutputStream *ost)
+{
+    return ost->last_mux_dts == AV_NOPTS_VALUE ? INT64_MIN :
+           av_rescale_q(ost->last_mux_dts, ost->st->time_base, AV_TIME_BASE_Q);
+}
+
+/* ties go to the first stream in output_streams, as in a linear scan */
+static int before(const OutputStream *a, const OutputStream *b)
+{
+    if (a->sched_dts != b->sched_dts)
+        return a->sched_dts < b->sched_dts;
+    if (a->file_index != b->file_index)
+        return a->file_index < b->file_index;
+    return a->index < b->index;
+}
+
+static void heap_swap(int i, int j)
+{
+    OutputStream *tmp = sched.heap[i];
+
+    sched.heap[i] = sched.heap[j];
+    sched.heap[j] = tmp;
+    sched.heap[i]->sched_index = i;
+    sched.heap[j]->sched_index = j;
+}
+
+static void sift_up(int i)
+{
+    while (i > 0 && before(sched.heap[i], sched.heap[(i - 1) / 2])) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(int i)
+{
+    while (1) {
+        int min = i, child = 2 * i + 1;
+
+        if (child < sched.nb_heap && before(sched.heap[child], sched.heap[min]))
+            min = child;
+        if (child + 1 < sched.nb_heap && before(sched.heap[child + 1], sched.heap[min]))
+            min = child + 1;
+        if (min == i)
+            return;
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+static void heap_pop(void)
+{
+    sched.heap[0]->sched_index = -1;
+    if (--sched.nb_heap) {
+        sched.heap[0] = sched.heap[sched.nb_heap];
+        sched.heap[0]->sched_index = 0;
+        sift_down(0);
+    }
+}
+
+static int over_filesize(const OutputStream *ost)
+{
+    OutputFile *of = output_files[ost->file_index];
+
+    return of_filesize(of) >= of->limit_filesize;
+}
+
+int sched_init(void)
+{
+    int i;
+
+    sched_uninit();
+
+    sched.heap            = av_malloc_array(nb_output_streams + 1, sizeof(*sched.heap));
+    sched.unavailable     = av_malloc_array(nb_output_streams + 1, sizeof(*sched.unavailable));
+    sched.max_frames      = av_malloc_array(nb_output_streams + 1, sizeof(*sched.max_frames));
+    sched.max_frames_seen = av_mallocz(nb_output_streams + 1);
+    if (!sched.heap || !sched.unavailable || !sched.max_frames ||
+        !sched.max_frames_seen) {
+        sched_uninit();
+        return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        ost->unavailable = 0;
+        ost->sched_index = -1;
+        if (ost->frame_number >= ost->max_frames)
+            sched_max_frames(ost);
+        if (ost->finished)
+            continue;
+
+        ost->sched_dts   = stream_dts(ost);
+        ost->sched_index = sched.nb_heap;
+        sched.heap[sched.nb_heap++] = ost;
+        sift_up(ost->sched_index);
+    }
+    return 0;
+}
+
+void sched_uninit(void)
+{
+    av_freep(&sched.heap);
+    av_freep(&sched.unavailable);
+    av_freep(&sched.max_frames);
+    av_freep(&sched.max_frames_seen);
+    memset(&sched, 0, sizeof(sched));
+}
+
+void sched_update(OutputStream *ost)
+{
+    if (!sched.heap || ost->sched_index < 0)
+        return;
+
+    ost->sched_dts = stream_dts(ost);
+    sift_up(ost->sched_index);
+    sift_down(ost->sched_index);
+}
+
+void sched_max_frames(OutputStream *ost)
+{
+    int i;
+
+    if (!sched.max_frames)
+        return;
+
+    i = output_files[ost->file_index]->ost_index + ost->index;
+    if (!sched.max_frames_seen[i]) {
+        sched.max_frames_seen[i] = 1;
+        sched.max_frames[sched.nb_max_frames++] = ost;
+    }
+}
+
+void sched_set_unavailable(OutputStream *ost)
+{
+    if (ost->unavailable)
+        return;
+    ost->unavailable = 1;
+    if (sched.unavailable)
+        sched.unavailable[sched.nb_unavailable++] = ost;
+}
+
+int sched_got_eagain(void)
+{
+    return sched.nb_unavailable > 0;
+}
+
+void sched_reset_eagain(void)
+{
+    int i;
+
+    for (i = 0; i < sched.nb_unavailable; i++)
+        sched.unavailable[i]->unavailable = 0;
+    sched.nb_unavailable = 0;
+}
+
+int sched_need_output(void)
+{
+    int i, j;
+
+    /* a stream which reached -frames ends its whole output file */
+    for (i = 0; i < sched.nb_max_frames; i++) {
+        OutputStream *ost = sched.max_frames[i];
+        OutputFile    *of = output_files[ost->file_index];
+
+        if (ost->finished || over_filesize(ost))
+            continue;
+        for (j = 0; j < of->ctx->nb_streams; j++)
+            close_output_stream(output_streams[of->ost_index + j]);
+    }
+    sched.nb_max_frames = 0;
+
+    for (; sched.next_live < nb_output_streams; sched.next_live++) {
+        OutputStream *ost = output_streams[sched.next_live];
+
+        if (!ost->finished && !over_filesize(ost))
+            return 1;
+    }
+    return 0;
+}
+
+OutputStream *sched_choose_output(void)
+{
+    OutputStream *ost;
+
+    /* uninitialized streams come first, in order */
+    for (; sched.next_init < nb_output_streams; sched.next_init++) {
+        ost = output_streams[sched.next_init];
+        if (!ost->initialized && !ost->inputs_done)
+            return ost->unavailable ? NULL : ost;
+    }
+
+    while (sched.nb_heap && sched.heap[0]->finished)
+        heap_pop();
+    if (!sched.nb_heap || sched.heap[0]->sched_dts == INT64_MAX)
+        return NULL;
+
+    ost = sched.heap[0];
+    if (ost->last_mux_dts == AV_NOPTS_VALUE)
+        av_log(NULL, AV_LOG_DEBUG,
+            "cur_dts is invalid st:%d (%d) [init:%d i_done:%d finish:%d] (this is harmless if it occurs once at the start per stream)\n",
+            ost->st->index, ost->st->id, ost->initialized, ost->inputs_done, ost->finished);
+
+    return ost->unavailable ? NULL : ost;
+}
@@ -0,0 +1,299 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Keyframe index sidecar enabled with -seek_index.
+ *
+ * Keyframes read from an input without an index in its header (MPEG-TS,
+ * raw streams, Matroska without cues, ...) are saved to a sidecar file, and
+ * added to the index of libavformat the next time the same input is opened,
+ * so -ss and -stream_loop seek straight to the right byte offset instead of
+ * scanning the file.
+ *
+ * The sidecar is keyed by the size of the input and a CRC of its first and
+ * last bytes, rather than by mtime, which changes each time a file is
+ * written again to MEMFS. All values are little-endian:
+ *
+ *   "FFSI", u32 version, u64 input size, u32 input crc,
+ *   u32 number of streams, u32 number of entries
+ *   for each stream:  u32 codec id, u32 time base num, u32 time base den
+ *   for each entry:   u32 stream index, i64 timestamp, i64 position
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "libavformat/avio.h"
+#include "libavutil/avstring.h"
+#include "libavutil/crc.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+
+#define SEEK_INDEX_VERSION 1
+/* bytes read at the start and at the end of the input for its key */
+#define SEEK_INDEX_KEY_SIZE (64 * 1024)
+
+typedef struct SeekIndexEntry {
+    int64_t timestamp;
+    int64_t pos;
+    int     stream_index;
+} SeekIndexEntry;
+
+struct SeekIndex {
+    char *path;
+    int64_t size;
+    uint32_t crc;
+
+    SeekIndexEntry *entries;
+    int nb_entries;
+    int nb_entries_allocated;
+    int nb_loaded;               ///< number of entries read from the sidecar
+};
+
+static int input_key(const char *filename, int64_t *size, uint32_t *crc)
+{
+    const AVCRC *table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    AVIOContext *pb;
+    uint8_t *buf;
+    int ret, len;
+
+    buf = av_malloc(SEEK_INDEX_KEY_SIZE);
+    if (!buf)
+        return AVERROR(ENOMEM);
+    ret = avio_open(&pb, filename, AVIO_FLAG_READ);
+    if (ret < 0)
+        goto end;
+
+    *size = avio_size(pb);
+    *crc  = UINT32_MAX;
+    len   = avio_read(pb, buf, SEEK_INDEX_KEY_SIZE);
+    if (len > 0)
+        *crc = av_crc(table, *crc, buf, len);
+    if (*size > 2 * SEEK_INDEX_KEY_SIZE &&
+        avio_seek(pb, *size - SEEK_INDEX_KEY_SIZE, SEEK_SET) >= 0) {
+        len = avio_read(pb, buf, SEEK_INDEX_KEY_SIZE);
+        if (len > 0)
+            *crc = av_crc(table, *crc, buf, len);
+    }
+    ret = *size < 0 ? *size : 0;
+    avio_closep(&pb);
+
+end:
+    av_free(buf);
+    return ret;
+}
+
+static int add_entry(SeekIndex *si, int stream_index, int64_t timestamp, int64_t pos)
+{
+    SeekIndexEntry *e;
+
+    if (si->nb_entries == si->nb_entries_allocated) {
+        int nb = FFMAX(256, si->nb_entries_allocated * 2);
+        int ret = av_reallocp_array(&si->entries, nb, sizeof(*si->entries));
+        if (ret < 0) {
+            si->nb_entries = si->nb_entries_allocated = si->nb_loaded = 0;
+            return ret;
+        }
+        si->nb_entries_allocated = nb;
+    }
+    e = &si->entries[si->nb_entries++];
+    e->stream_index = stream_index;
+    e->timestamp    = timestamp;
+    e->pos          = pos;
+    return 0;
+}
+
+static int load(SeekIndex *si, AVFormatContext *ic)
+{
+    AVIOContext *pb;
+    int i, nb_streams, nb_entries, ret;
+
+    ret = avio_open(&pb, si->path, AVIO_FLAG_READ);
+    if (ret < 0)
+        return ret == AVERROR(ENOENT) ? 0 : ret;
+
+    ret = AVERROR_INVALIDDATA;
+    if (avio_rl32(pb) != MKTAG('F', 'F', 'S', 'I') ||
+        avio_rl32(pb) != SEEK_INDEX_VERSION)
+        goto end;
+
+    /* the sidecar of another input, or of an older version of this one */
+    ret = 0;
+    if (avio_rl64(pb) != si->size || avio_rl32(pb) != si->crc)
+        goto end;
+
+    ret = AVERROR_INVALIDDATA;
+    nb_streams = avio_rl32(pb);
+    nb_entries = avio_rl32(pb);
+    if (nb_streams != ic->nb_streams || nb_entries < 0)
+        goto end;
+    for (i = 0; i < nb_streams; i++) {
+        const AVStream *st = ic->streams[i];
+        if (avio_rl32(pb) != st->codecpar->codec_id ||
+            avio_rl32(pb) != st->time_base.num ||
+            avio_rl32(pb) != st->time_base.den)
+            goto end;
+    }
+
+    for (i = 0; i < nb_entries && !avio_feof(pb); i++) {
+        int stream_index  = avio_rl32(pb);
+        int64_t timestamp = avio_rl64(pb);
+        int64_t pos       = avio_rl64(pb);
+
+        if (stream_index >= nb_streams)
+            goto end;
+        if ((ret = add_entry(si, stream_index, timestamp, pos)) < 0)
+            goto end;
+        av_add_index_entry(ic->streams[stream_index], pos, timestamp,
+                           0, 0, AVINDEX_KEYFRAME);
+    }
+    si->nb_loaded = si->nb_entries;
+    ret = 0;
+
+end:
+    avio_closep(&pb);
+    return ret;
+}
+
+SeekIndex *seek_index_open(AVFormatContext *ic, const char *filename,
+                           const char *path)
+{
+    const char *proto = avio_find_protocol_name(filename);
+    SeekIndex *si;
+    int i, ret;
+
+    if (!proto || strcmp(proto, "file"))
+        return NULL;
+
+    /* the header already gives an index, ex. MP4 or Matroska with cues */
+    for (i = 0; i < ic->nb_streams; i++)
+        if (!avformat_index_get_entries_count(ic->streams[i]))
+            break;
+    if (ic->nb_streams && i == ic->nb_streams) {
+        av_log(NULL, AV_LOG_VERBOSE, "%s: the input has an index, "
+               "%s is not used\n", filename, path);
+        return NULL;
+    }
+
+    si = av_mallocz(sizeof(*si));
+    if (!si)
+        return NULL;
+    si->path = av_strdup(path);
+    if (!si->path)
+        goto fail;
+
+    if ((ret = input_key(filename, &si->size, &si->crc)) < 0 ||
+        (ret = load(si, ic)) < 0) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot load seek index %s: %s\n",
+               path, av_err2str(ret));
+        if (!si->size)
+            goto fail;
+        si->nb_entries = si->nb_loaded = 0;
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "%s: %d keyframes loaded from %s\n",
+           filename, si->nb_loaded, path);
+    return si;
+
+fail:
+    seek_index_close(&si, NULL);
+    return NULL;
+}
+
+void seek_index_add(SeekIndex *si, const AVPacket *pkt)
+{
+    int64_t timestamp = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+
+    if (!si || !(pkt->flags & AV_PKT_FLAG_KEY) || pkt->pos < 0 ||
+        timestamp == AV_NOPTS_VALUE)
+        return;
+    add_entry(si, pkt->stream_index, timestamp, pkt->pos);
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const SeekIndexEntry *ea = a, *eb = b;
+
+    if (ea->stream_index != eb->stream_index)
+        return ea->stream_index - eb->stream_index;
+    return FFDIFFSIGN(ea->pos, eb->pos);
+}
+
+static void save(SeekIndex *si, AVFormatContext *ic)
+{
+    AVIOContext *pb;
+    int i, j, ret;
+
+    /* sort by stream and position, and drop keyframes read again */
+    qsort(si->entries, si->nb_entries, sizeof(*si->entries), cmp_entry);
+    for (i = j = 0; i < si->nb_entries; i++) {
+        if (j && !cmp_entry(&si->entries[j - 1], &si->entries[i]))
+            continue;
+        si->entries[j++] = si->entries[i];
+    }
+    si->nb_entries = j;
+    if (si->nb_entries <= si->nb_loaded)
+        return;
+
+    ret = avio_open(&pb, si->path, AVIO_FLAG_WRITE);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot save seek index %s: %s\n",
+               si->path, av_err2str(ret));
+        return;
+    }
+
+    avio_wl32(pb, MKTAG('F', 'F', 'S', 'I'));
+    avio_wl32(pb, SEEK_INDEX_VERSION);
+    avio_wl64(pb, si->size);
+    avio_wl32(pb, si->crc);
+    avio_wl32(pb, ic->nb_streams);
+    avio_wl32(pb, si->nb_entries);
+    for (i = 0; i < ic->nb_streams; i++) {
+        const AVStream *st = ic->streams[i];
+        avio_wl32(pb, st->codecpar->codec_id);
+        avio_wl32(pb, st->time_base.num);
+        avio_wl32(pb, st->time_base.den);
+    }
+    for (i = 0; i < si->nb_entries; i++) {
+        avio_wl32(pb, si->entries[i].stream_index);
+        avio_wl64(pb, si->entries[i].timestamp);
+        avio_wl64(pb, si->entries[i].pos);
+    }
+
+    ret = avio_closep(&pb);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_WARNING, "Error closing seek index %s: %s\n",
+               si->path, av_err2str(ret));
+    else
+        av_log(NULL, AV_LOG_VERBOSE, "%d keyframes saved to %s\n",
+               si->nb_entries, si->path);
+}
+
+void seek_index_close(SeekIndex **psi, AVFormatContext *ic)
+{
+    SeekIndex *si = *psi;
+
+    if (!si)
+        return;
+    if (ic && si->nb_entries)
+        save(si, ic);
+    av_freep(&si->entries);
+    av_freep(&si->path);
+    av_freep(psi);
+}
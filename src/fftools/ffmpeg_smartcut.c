@@ -0,0 +1,681 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Smart cut enabled with -smart_cut.
+ *
+ * A stream copy can only start on a keyframe, so with -c copy the frames
+ * between the -ss position and the next keyframe are lost, and the frames
+ * past the -t / -to position which precede the last copied packets in
+ * decoding order are kept. With -smart_cut, remux() sends the packets of
+ * each video stream here, where they are held one GOP at a time: a GOP
+ * inside the cut is copied, a GOP crossing the start or the end of the cut
+ * is decoded and only its frames inside the cut are encoded again.
+ *
+ * The encoder is set up like the input stream (codec, size, pixel format,
+ * profile, level, colors), without reordering. The output header keeps the
+ * extradata of the input, so for H.264 and HEVC with length-prefixed NAL
+ * units (avcC / hvcC), the encoder is opened with global headers and its
+ * parameter sets are compared with those of the input:
+ *  - the same: the encoded frames are decoded with the output header;
+ *  - different, and the output allows parameter sets in-band (not an avc1 /
+ *    hvc1 entry of mov / mp4, ex. -tag:v avc3 or matroska): they are put in
+ *    the encoded keyframe, and those of the input are put back in the first
+ *    copied keyframe which follows;
+ *  - otherwise the stream is cut as with -c copy, from a keyframe.
+ * The encoded packets are converted from Annex B to length-prefixed NAL
+ * units. The dts of the encoded packets are those of a stream with the
+ * reorder delay of the input, so they stay below the dts of the copied
+ * packets which follow.
+ *
+ * Open GOPs are not handled: the leading frames of a GOP referencing the
+ * previous one cannot be decoded when that GOP is encoded again.
+ */
+
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/log.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+#include "libavutil/timestamp.h"
+
+/* returned when the stream is cut as with -c copy from then on */
+#define SMART_CUT_COPY FFERRTAG('S','C','C','P')
+
+struct SmartCut {
+    InputStream  *ist;
+    OutputStream *ost;
+
+    int64_t start;              ///< start of the cut in the stream time base
+    int64_t end;                ///< end of the cut in the stream time base, INT64_MAX if none
+
+    AVPacket **gop;             ///< packets of the current GOP in decoding order
+    int nb_gop;
+    int nb_gop_allocated;
+
+    AVCodecContext *dec;
+    AVCodecContext *enc;        ///< opened for each GOP encoded again
+    AVFrame  *frame;
+    AVPacket *enc_pkt;
+
+    int nal_length_size;        ///< of the input NAL units, 0 if they are not length-prefixed
+    uint8_t *param_sets;        ///< parameter sets of the input as length-prefixed NAL units
+    int param_sets_size;
+    int restore_param_sets;     ///< add param_sets to the next copied keyframe
+    uint8_t *enc_param_sets;    ///< parameter sets of the encoder if they differ from param_sets
+    int enc_param_sets_size;
+    int copy_only;              ///< the encoded frames cannot be decoded with the output header
+
+    int64_t last_dts;           ///< last dts sent, in the stream time base
+    int nb_encoded[2];          ///< frames encoded at the start and at the end of the cut
+    int done;
+};
+
+static int append_param_set(SmartCut *sc, const uint8_t *nal, int size)
+{
+    int i, ret;
+
+    ret = av_reallocp(&sc->param_sets, sc->param_sets_size + sc->nal_length_size + size);
+    if (ret < 0) {
+        sc->param_sets_size = 0;
+        return ret;
+    }
+    for (i = 0; i < sc->nal_length_size; i++)
+        sc->param_sets[sc->param_sets_size++] = size >> (8 * (sc->nal_length_size - 1 - i));
+    memcpy(sc->param_sets + sc->param_sets_size, nal, size);
+    sc->param_sets_size += size;
+    return 0;
+}
+
+/* append the nb NAL units of an avcC / hvcC array at *p, each one preceded
+ * by its 16-bit size */
+static int append_param_set_array(SmartCut *sc, const uint8_t **p,
+                                  const uint8_t *end, int nb)
+{
+    int ret;
+
+    while (nb--) {
+        int size;
+
+        if (end - *p < 2 || end - *p - 2 < (size = AV_RB16(*p)))
+            return AVERROR_INVALIDDATA;
+        if ((ret = append_param_set(sc, *p + 2, size)) < 0)
+            return ret;
+        *p += 2 + size;
+    }
+    return 0;
+}
+
+/* Read the NAL unit length size and the parameter sets of an avcC / hvcC
+ * extradata. */
+static int parse_extradata(SmartCut *sc, const AVCodecParameters *par)
+{
+    const uint8_t *p = par->extradata, *end = p + par->extradata_size;
+    int i, ret;
+
+    if (par->codec_id == AV_CODEC_ID_H264) {
+        if (end - p < 7)
+            return AVERROR_INVALIDDATA;
+        sc->nal_length_size = (p[4] & 3) + 1;
+        p += 5;
+        /* SPS, then PPS */
+        for (i = 0; i < 2; i++) {
+            int nb;
+
+            if (p >= end)
+                return AVERROR_INVALIDDATA;
+            nb = *p++ & (i ? 0xff : 0x1f);
+            if ((ret = append_param_set_array(sc, &p, end, nb)) < 0)
+                return ret;
+        }
+    } else {
+        int nb_arrays;
+
+        if (end - p < 23)
+            return AVERROR_INVALIDDATA;
+        sc->nal_length_size = (p[21] & 3) + 1;
+        nb_arrays = p[22];
+        p += 23;
+        for (i = 0; i < nb_arrays; i++) {
+            int nb;
+
+            if (end - p < 3)
+                return AVERROR_INVALIDDATA;
+            nb = AV_RB16(p + 1);
+            p += 3;
+            if ((ret = append_param_set_array(sc, &p, end, nb)) < 0)
+                return ret;
+        }
+    }
+    return sc->nal_length_size == 3 ? AVERROR_PATCHWELCOME : 0;
+}
+
+static int open_decoder(SmartCut *sc)
+{
+    const AVStream *st = sc->ist->st;
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    int ret;
+
+    if (!codec)
+        return AVERROR_DECODER_NOT_FOUND;
+    require_side_modules(codec->name);
+    sc->dec = avcodec_alloc_context3(codec);
+    if (!sc->dec)
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_to_context(sc->dec, st->codecpar)) < 0)
+        return ret;
+    sc->dec->pkt_timebase = st->time_base;
+    return avcodec_open2(sc->dec, codec, NULL);
+}
+
+static int to_length_prefixed(SmartCut *sc, AVPacket *pkt);
+
+/* Read the Annex B global header of the encoder as length-prefixed NAL
+ * units in enc_param_sets. */
+static int read_encoder_param_sets(SmartCut *sc)
+{
+    const AVCodecContext *enc = sc->enc;
+    AVPacket *pkt;
+    int ret;
+
+    av_freep(&sc->enc_param_sets);
+    sc->enc_param_sets_size = 0;
+    if (!enc->extradata_size)
+        return 0;
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    if ((ret = av_new_packet(pkt, enc->extradata_size)) >= 0) {
+        memcpy(pkt->data, enc->extradata, enc->extradata_size);
+        ret = to_length_prefixed(sc, pkt);
+    }
+    if (ret >= 0 && !(sc->enc_param_sets = av_memdup(pkt->data, pkt->size)))
+        ret = AVERROR(ENOMEM);
+    if (ret >= 0)
+        sc->enc_param_sets_size = pkt->size;
+    av_packet_free(&pkt);
+    return ret;
+}
+
+/* Whether the output allows parameter sets in-band which differ from those
+ * of its header: not in an avc1 / hvc1 sample entry of mov / mp4, where
+ * avc1 is also the default tag of H.264. */
+static int in_band_param_sets(const SmartCut *sc)
+{
+    const OutputFile *of = output_files[sc->ost->file_index];
+    uint32_t tag = sc->ost->st->codecpar->codec_tag;
+
+    if (!tag)
+        return !av_match_name(of->format->name, "mov,mp4,3gp,3g2,psp,ipod,ismv,f4v");
+    return tag != MKTAG('a','v','c','1') && tag != MKTAG('h','v','c','1');
+}
+
+/* Open an encoder matching the input stream for the GOP being encoded
+ * again, with the first decoded frame of the GOP. */
+static int open_encoder(SmartCut *sc, const AVFrame *frame)
+{
+    const AVStream *st = sc->ist->st;
+    const AVCodecParameters *par = st->codecpar;
+    const AVCodec *codec = avcodec_find_encoder(par->codec_id);
+    AVCodecContext *enc;
+    int ret;
+
+    if (!codec)
+        return AVERROR_ENCODER_NOT_FOUND;
+    /* ex. libvpx-vp9 when vp9 is cut, loaded only once a GOP needs it */
+    require_side_modules(codec->name);
+    enc = sc->enc = avcodec_alloc_context3(codec);
+    if (!enc)
+        return AVERROR(ENOMEM);
+
+    enc->width               = frame->width;
+    enc->height              = frame->height;
+    enc->pix_fmt             = frame->format;
+    enc->sample_aspect_ratio = frame->sample_aspect_ratio.num ?
+                               frame->sample_aspect_ratio : par->sample_aspect_ratio;
+    enc->color_range         = par->color_range;
+    enc->color_primaries     = par->color_primaries;
+    enc->color_trc           = par->color_trc;
+    enc->colorspace          = par->color_space;
+    enc->chroma_sample_location = par->chroma_location;
+    enc->profile             = par->profile;
+    enc->level               = par->level;
+    enc->time_base           = st->time_base;
+    enc->framerate           = st->avg_frame_rate;
+    if (par->bit_rate > 0)
+        enc->bit_rate        = par->bit_rate;
+    /* no reordering, and a single keyframe as the GOP is never longer */
+    enc->max_b_frames        = 0;
+    enc->gop_size            = FFMAX(sc->nb_gop, 1);
+    if (sc->nal_length_size)
+        enc->flags          |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    if ((ret = avcodec_open2(enc, codec, NULL)) < 0 || !sc->nal_length_size)
+        return ret;
+
+    if ((ret = read_encoder_param_sets(sc)) < 0)
+        return ret;
+    if (sc->enc_param_sets_size == sc->param_sets_size &&
+        !memcmp(sc->enc_param_sets, sc->param_sets, sc->param_sets_size)) {
+        av_freep(&sc->enc_param_sets);
+        sc->enc_param_sets_size = 0;
+        return 0;
+    }
+    if (in_band_param_sets(sc))
+        return 0;
+
+    av_log(NULL, AV_LOG_WARNING, "Smart cut: the parameter sets of the %s encoder "
+           "differ from those of stream #%d:%d and its codec tag does not allow "
+           "them in-band (ex. -tag:v %s), it is copied from a keyframe\n",
+           codec->name, sc->ost->file_index, sc->ost->index,
+           par->codec_id == AV_CODEC_ID_H264 ? "avc3" : "hev1");
+    sc->copy_only = 1;
+    return SMART_CUT_COPY;
+}
+
+/* Return the position after the next 00 00 01 start code in [p, end), or end. */
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end)
+{
+    for (; end - p >= 3; p++)
+        if (!p[0] && !p[1] && p[2] == 1)
+            return p + 3;
+    return end;
+}
+
+static void replace_data(AVPacket *pkt, AVBufferRef *buf, int size)
+{
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_buffer_unref(&pkt->buf);
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+}
+
+/* Convert the Annex B NAL units of an encoded packet to length-prefixed ones. */
+static int to_length_prefixed(SmartCut *sc, AVPacket *pkt)
+{
+    const uint8_t *end = pkt->data + pkt->size;
+    AVBufferRef *buf = NULL;
+    uint8_t *dst = NULL;
+    int pass, i, size = 0;
+
+    for (pass = 0; pass < 2; pass++) {
+        const uint8_t *nal, *next;
+
+        for (nal = find_start_code(pkt->data, end); nal < end; nal = next) {
+            const uint8_t *nal_end;
+            int len;
+
+            next    = find_start_code(nal, end);
+            nal_end = next < end ? next - 3 : end;
+            /* the leading zero of a 4-byte start code */
+            while (nal_end > nal && !nal_end[-1])
+                nal_end--;
+            len = nal_end - nal;
+
+            if (!pass) {
+                size += sc->nal_length_size + len;
+                continue;
+            }
+            for (i = 0; i < sc->nal_length_size; i++)
+                *dst++ = len >> (8 * (sc->nal_length_size - 1 - i));
+            memcpy(dst, nal, len);
+            dst += len;
+        }
+
+        if (!pass) {
+            buf = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!buf)
+                return AVERROR(ENOMEM);
+            dst = buf->data;
+        }
+    }
+
+    replace_data(pkt, buf, size);
+    return 0;
+}
+
+static int prepend_param_sets(AVPacket *pkt, const uint8_t *param_sets,
+                              int param_sets_size)
+{
+    int size = param_sets_size + pkt->size;
+    AVBufferRef *buf = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+
+    if (!buf)
+        return AVERROR(ENOMEM);
+    memcpy(buf->data, param_sets, param_sets_size);
+    memcpy(buf->data + param_sets_size, pkt->data, pkt->size);
+    replace_data(pkt, buf, size);
+    return 0;
+}
+
+static void copy_packet(SmartCut *sc, AVPacket *pkt)
+{
+    if (sc->restore_param_sets && (pkt->flags & AV_PKT_FLAG_KEY)) {
+        if (prepend_param_sets(pkt, sc->param_sets, sc->param_sets_size) < 0)
+            exit_program(1);
+        sc->restore_param_sets = 0;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE)
+        sc->last_dts = pkt->dts;
+    streamcopy_output(sc->ist, sc->ost, pkt);
+}
+
+static void write_encoded(SmartCut *sc, AVPacket *pkt, int64_t delay)
+{
+    if (sc->nal_length_size && to_length_prefixed(sc, pkt) < 0)
+        exit_program(1);
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        /* in-band parameter sets of the encoder, or back to those of the
+         * header after an earlier GOP */
+        if (sc->enc_param_sets_size) {
+            if (prepend_param_sets(pkt, sc->enc_param_sets, sc->enc_param_sets_size) < 0)
+                exit_program(1);
+        } else if (sc->restore_param_sets) {
+            if (prepend_param_sets(pkt, sc->param_sets, sc->param_sets_size) < 0)
+                exit_program(1);
+            sc->restore_param_sets = 0;
+        }
+    }
+
+    /* dts as if the frames were reordered like the input */
+    pkt->dts = pkt->pts - delay;
+    if (sc->last_dts != AV_NOPTS_VALUE && pkt->dts <= sc->last_dts)
+        pkt->dts = sc->last_dts + 1;
+    pkt->pts = FFMAX(pkt->pts, pkt->dts);
+    if (!pkt->duration && sc->ist->st->avg_frame_rate.num)
+        pkt->duration = av_rescale_q(1, av_inv_q(sc->ist->st->avg_frame_rate),
+                                     sc->ist->st->time_base);
+    sc->last_dts = pkt->dts;
+    streamcopy_output(sc->ist, sc->ost, pkt);
+}
+
+/* Encode frame, NULL to flush the encoder. */
+static int encode_frame(SmartCut *sc, AVFrame *frame, int64_t delay)
+{
+    int ret;
+
+    if (frame && !sc->enc && (ret = open_encoder(sc, frame)) < 0)
+        return ret;
+    if (!sc->enc)
+        return 0;
+
+    if (frame) {
+        frame->pts       = frame->best_effort_timestamp;
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+    }
+    if ((ret = avcodec_send_frame(sc->enc, frame)) < 0)
+        return ret;
+
+    while ((ret = avcodec_receive_packet(sc->enc, sc->enc_pkt)) >= 0)
+        write_encoded(sc, sc->enc_pkt, delay);
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/* Send pkt to the decoder, NULL to flush it, and encode the decoded frames
+ * inside the cut. */
+static int decode_packet(SmartCut *sc, const AVPacket *pkt, int64_t delay, int *nb_encoded)
+{
+    int ret = avcodec_send_packet(sc->dec, pkt);
+
+    /* a broken packet is not fatal, the frames depending on it are lost */
+    if (ret < 0 && ret != AVERROR_EOF)
+        av_log(NULL, AV_LOG_WARNING, "Smart cut: error decoding stream #%d:%d: %s\n",
+               sc->ist->file_index, sc->ist->st->index, av_err2str(ret));
+
+    while ((ret = avcodec_receive_frame(sc->dec, sc->frame)) >= 0) {
+        int64_t pts = sc->frame->best_effort_timestamp;
+
+        if (pts != AV_NOPTS_VALUE && pts >= sc->start && pts < sc->end) {
+            if ((ret = encode_frame(sc, sc->frame, delay)) < 0)
+                return ret;
+            (*nb_encoded)++;
+        }
+        av_frame_unref(sc->frame);
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+/* Encode the frames of the held GOP which are inside the cut. next is the
+ * keyframe which ended the GOP, NULL at the end of the cut. */
+static int encode_gop(SmartCut *sc, const AVPacket *next, int at_start)
+{
+    /* the copied packets following the encoded ones start from next */
+    const AVPacket *key = next ? next : sc->gop[0];
+    int64_t delay = 0;
+    int i, ret = 0, nb_encoded = 0, in_band;
+
+    if (key->pts != AV_NOPTS_VALUE && key->dts != AV_NOPTS_VALUE)
+        delay = FFMAX(key->pts - key->dts, 0);
+
+    for (i = 0; i < sc->nb_gop && ret >= 0; i++)
+        ret = decode_packet(sc, sc->gop[i], delay, &nb_encoded);
+    if (ret >= 0)
+        ret = decode_packet(sc, NULL, delay, &nb_encoded);
+    if (ret >= 0)
+        ret = encode_frame(sc, NULL, delay);
+
+    in_band = sc->enc && sc->enc_param_sets_size > 0;
+    avcodec_flush_buffers(sc->dec);
+    avcodec_free_context(&sc->enc);
+    /* nothing of the GOP was written yet */
+    if (ret == SMART_CUT_COPY)
+        return 0;
+    if (ret < 0)
+        return ret;
+
+    sc->nb_encoded[!at_start] += nb_encoded;
+    if (in_band)
+        sc->restore_param_sets = sc->param_sets_size > 0;
+    return 0;
+}
+
+/* Copy, drop or encode again the held GOP. */
+static void flush_gop(SmartCut *sc, const AVPacket *next)
+{
+    int64_t min_pts = INT64_MAX, max_pts = INT64_MIN;
+    int i, ret;
+
+    for (i = 0; i < sc->nb_gop; i++) {
+        const AVPacket *pkt = sc->gop[i];
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+
+        if (pts == AV_NOPTS_VALUE)
+            continue;
+        min_pts = FFMIN(min_pts, pts);
+        max_pts = FFMAX(max_pts, pts);
+    }
+
+    if (!sc->nb_gop || max_pts < sc->start || min_pts >= sc->end) {
+        /* entirely outside of the cut */
+    } else if (min_pts >= sc->start && max_pts < sc->end) {
+        for (i = 0; i < sc->nb_gop; i++)
+            copy_packet(sc, sc->gop[i]);
+    } else {
+        if (!sc->copy_only && (ret = encode_gop(sc, next, min_pts < sc->start)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Smart cut: error encoding stream #%d:%d again: %s\n",
+                   sc->ist->file_index, sc->ist->st->index, av_err2str(ret));
+            exit_program(1);
+        }
+        /* as with -c copy, the GOP crossing the start is dropped and the
+         * one crossing the end is kept whole */
+        if (sc->copy_only && min_pts >= sc->start)
+            for (i = 0; i < sc->nb_gop; i++)
+                copy_packet(sc, sc->gop[i]);
+    }
+
+    for (i = 0; i < sc->nb_gop; i++)
+        av_packet_unref(sc->gop[i]);
+    sc->nb_gop = 0;
+}
+
+static void hold_packet(SmartCut *sc, AVPacket *pkt)
+{
+    if (sc->nb_gop == sc->nb_gop_allocated) {
+        int i, nb = FFMAX(64, sc->nb_gop_allocated * 2);
+
+        if (av_reallocp_array(&sc->gop, nb, sizeof(*sc->gop)) < 0)
+            exit_program(1);
+        for (i = sc->nb_gop_allocated; i < nb; i++)
+            if (!(sc->gop[i] = av_packet_alloc()))
+                exit_program(1);
+        sc->nb_gop_allocated = nb;
+    }
+    av_packet_move_ref(sc->gop[sc->nb_gop++], pkt);
+}
+
+static void finish(SmartCut *sc)
+{
+    flush_gop(sc, NULL);
+    sc->done = 1;
+    close_output_stream(sc->ost);
+
+    av_log(NULL, AV_LOG_VERBOSE, "Smart cut of stream #%d:%d: %d frames encoded "
+           "again at the start, %d at the end\n", sc->ost->file_index,
+           sc->ost->index, sc->nb_encoded[0], sc->nb_encoded[1]);
+}
+
+void smart_cut_send(SmartCut *sc, AVPacket *pkt)
+{
+    if (sc->done) {
+        if (pkt)
+            av_packet_unref(pkt);
+        return;
+    }
+    if (!pkt) {
+        finish(sc);
+        return;
+    }
+
+    /* the dts are increasing and pts >= dts, no later frame is in the cut */
+    if (pkt->dts != AV_NOPTS_VALUE && pkt->dts >= sc->end) {
+        av_packet_unref(pkt);
+        finish(sc);
+        return;
+    }
+
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+        flush_gop(sc, pkt);
+    else if (!sc->nb_gop) {
+        /* not decodable without the previous keyframe */
+        av_packet_unref(pkt);
+        return;
+    }
+    hold_packet(sc, pkt);
+}
+
+SmartCut *smart_cut_alloc(InputStream *ist, OutputStream *ost)
+{
+    const AVCodecParameters *par = ist->st->codecpar;
+    OutputFile *of = output_files[ost->file_index];
+    InputFile   *f = input_files[ist->file_index];
+    int64_t start = of->start_time == AV_NOPTS_VALUE ? 0 : of->start_time;
+    int64_t end = INT64_MAX;
+    SmartCut *sc;
+    int ret;
+
+    if (par->codec_type != AVMEDIA_TYPE_VIDEO ||
+        (ist->st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        return NULL;
+
+    if (of->recording_time != INT64_MAX)
+        end = start + of->recording_time;
+    /* remux() is never used with -copyts, so the input start is not part of
+     * the timestamps, unlike in streamcopy_check() */
+    if (f->recording_time != INT64_MAX)
+        end = FFMIN(end, f->recording_time);
+    if (!start && f->start_time == AV_NOPTS_VALUE && end == INT64_MAX)
+        return NULL;
+
+    /* the keyframes of other codecs may depend on headers in the extradata,
+     * which the encoded frames would replace */
+    if (par->codec_id != AV_CODEC_ID_H264 && par->codec_id != AV_CODEC_ID_HEVC &&
+        par->codec_id != AV_CODEC_ID_VP8  && par->codec_id != AV_CODEC_ID_VP9) {
+        av_log(NULL, AV_LOG_WARNING, "Smart cut is not supported for %s, "
+               "stream #%d:%d is copied from a keyframe\n",
+               avcodec_get_name(par->codec_id), ost->file_index, ost->index);
+        return NULL;
+    }
+    if (!avcodec_find_encoder(par->codec_id)) {
+        av_log(NULL, AV_LOG_WARNING, "No %s encoder for smart cut, "
+               "stream #%d:%d is copied from a keyframe\n",
+               avcodec_get_name(par->codec_id), ost->file_index, ost->index);
+        return NULL;
+    }
+
+    sc = av_mallocz(sizeof(*sc));
+    if (!sc)
+        return NULL;
+    sc->ist      = ist;
+    sc->ost      = ost;
+    sc->start    = av_rescale_q(start, AV_TIME_BASE_Q, ist->st->time_base);
+    sc->end      = end == INT64_MAX ? INT64_MAX :
+                   av_rescale_q(end, AV_TIME_BASE_Q, ist->st->time_base);
+    sc->last_dts = AV_NOPTS_VALUE;
+
+    sc->frame   = av_frame_alloc();
+    sc->enc_pkt = av_packet_alloc();
+    if (!sc->frame || !sc->enc_pkt) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    if ((par->codec_id == AV_CODEC_ID_H264 || par->codec_id == AV_CODEC_ID_HEVC) &&
+        par->extradata_size && par->extradata[0] == 1 &&
+        (ret = parse_extradata(sc, par)) < 0)
+        goto fail;
+
+    if ((ret = open_decoder(sc)) < 0)
+        goto fail;
+
+    av_log(NULL, AV_LOG_VERBOSE, "Smart cut of stream #%d:%d from %s to %s\n",
+           ost->file_index, ost->index, av_ts2timestr(start, &AV_TIME_BASE_Q),
+           end == INT64_MAX ? "the end" : av_ts2timestr(end, &AV_TIME_BASE_Q));
+    return sc;
+
+fail:
+    av_log(NULL, AV_LOG_WARNING, "Cannot set up smart cut of stream #%d:%d: %s, "
+           "it is copied from a keyframe\n", ost->file_index, ost->index,
+           av_err2str(ret));
+    smart_cut_free(&sc);
+    return NULL;
+}
+
+void smart_cut_free(SmartCut **psc)
+{
+    SmartCut *sc = *psc;
+    int i;
+
+    if (!sc)
+        return;
+    for (i = 0; i < sc->nb_gop_allocated; i++)
+        av_packet_free(&sc->gop[i]);
+    av_freep(&sc->gop);
+    avcodec_free_context(&sc->dec);
+    avcodec_free_context(&sc->enc);
+    av_frame_free(&sc->frame);
+    av_packet_free(&sc->enc_pkt);
+    av_freep(&sc->param_sets);
+    av_freep(&sc->enc_param_sets);
+    av_freep(psc);
+}
@@ -0,0 +1,241 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Pipeline tracing enabled with -trace_file.
+ *
+ * Every thread appends compact binary events to its own buffer, so
+ * recording never takes a lock. Buffers are published in a lock-free list
+ * when a thread records its first event, and are only read by
+ * trace_uninit(), after all threads have been joined, to write the trace
+ * in the Chrome trace event format (loadable in Perfetto or chrome://tracing).
+ *
+ * The args of an event have the pts_time of the packet or frame it handled,
+ * so the stages of one frame can be followed. It is on the timeline of the
+ * stage: the container timestamps when demuxing, the input timeline (after
+ * the -ss / -itsoffset offset) when decoding and the output one afterwards.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct TraceEvent {
+    int64_t start;        ///< microseconds since trace_init()
+    int64_t pts;          ///< microseconds, AV_NOPTS_VALUE if unknown
+    int32_t duration;     ///< microseconds
+    int8_t  type;         ///< StageTimerID or TraceEventType
+    int8_t  file_index;
+    int16_t stream_index;
+} TraceEvent;
+
+typedef struct TraceChunk {
+    struct TraceChunk *next;
+    int nb_events;
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;  ///< next buffer in trace_buffers
+    int tid;
+    char name[64];
+    TraceChunk *first;
+    TraceChunk *last;
+} TraceBuffer;
+
+static const char *const trace_event_names[TRACE_NB] = {
+    [STAGE_DEMUX]       = "demux",
+    [STAGE_DECODE]      = "decode",
+    [STAGE_FILTER_SEND] = "filter_send",
+    [STAGE_FILTER_REAP] = "filter_reap",
+    [STAGE_ENCODE]      = "encode",
+    [STAGE_MUX]         = "mux",
+    [TRACE_READ]        = "read",
+    [TRACE_QUEUE_SEND]  = "queue_send",
+};
+
+int trace_enabled = 0;
+
+static int64_t trace_start;
+static _Atomic(TraceBuffer *) trace_buffers;
+static atomic_int trace_nb_threads;
+/* incremented by trace_init(), so buffers of a previous exec are not reused */
+static atomic_uint trace_generation;
+
+static _Thread_local TraceBuffer *thread_buffer;
+static _Thread_local unsigned thread_generation;
+
+static TraceBuffer *get_thread_buffer(void)
+{
+    unsigned generation = atomic_load(&trace_generation);
+    TraceBuffer *buf;
+
+    if (thread_generation == generation)
+        return thread_buffer;
+
+    buf = av_mallocz(sizeof(*buf));
+    if (!buf)
+        return NULL;
+    buf->tid = atomic_fetch_add(&trace_nb_threads, 1);
+    snprintf(buf->name, sizeof(buf->name), "thread %d", buf->tid);
+
+    buf->next = atomic_load(&trace_buffers);
+    while (!atomic_compare_exchange_weak(&trace_buffers, &buf->next, buf))
+        ;
+
+    thread_buffer     = buf;
+    thread_generation = generation;
+    return buf;
+}
+
+void trace_init(void)
+{
+    trace_start = av_gettime_relative();
+    atomic_store(&trace_buffers, NULL);
+    atomic_store(&trace_nb_threads, 0);
+    atomic_fetch_add(&trace_generation, 1);
+    trace_enabled = 1;
+
+    trace_thread_name("main");
+}
+
+void trace_thread_name(const char *name)
+{
+    TraceBuffer *buf = get_thread_buffer();
+    if (buf)
+        av_strlcpy(buf->name, name, sizeof(buf->name));
+}
+
+void trace_event(int type, int file_index, int stream_index,
+                 int64_t start, int64_t end, int64_t pts, AVRational time_base)
+{
+    TraceBuffer *buf = get_thread_buffer();
+    TraceChunk *chunk;
+    TraceEvent *ev;
+
+    if (!buf)
+        return;
+
+    chunk = buf->last;
+    if (!chunk || chunk->nb_events == TRACE_CHUNK_EVENTS) {
+        chunk = av_malloc(sizeof(*chunk));
+        if (!chunk)
+            return;
+        chunk->next      = NULL;
+        chunk->nb_events = 0;
+        if (buf->last)
+            buf->last->next = chunk;
+        else
+            buf->first = chunk;
+        buf->last = chunk;
+    }
+
+    ev = &chunk->events[chunk->nb_events++];
+    ev->start        = start - trace_start;
+    ev->duration     = end - start;
+    ev->type         = type;
+    ev->file_index   = file_index;
+    ev->stream_index = stream_index;
+    ev->pts          = pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+                       av_rescale_q(pts, time_base, AV_TIME_BASE_Q);
+}
+
+static void write_escaped(FILE *f, const char *str)
+{
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*str >= 0x20)
+            fputc(*str, f);
+    }
+}
+
+static void write_trace(FILE *f, TraceBuffer *buffers)
+{
+    const char *sep = "";
+    TraceBuffer *buf;
+    TraceChunk *chunk;
+    int i;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (buf = buffers; buf; buf = buf->next) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"", sep, buf->tid);
+        write_escaped(f, buf->name);
+        fprintf(f, "\"}}");
+        sep = ",";
+
+        for (chunk = buf->first; chunk; chunk = chunk->next) {
+            for (i = 0; i < chunk->nb_events; i++) {
+                const TraceEvent *ev = &chunk->events[i];
+                fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                        "\"pid\":1,\"tid\":%d,\"ts\":%"PRId64",\"dur\":%d,"
+                        "\"args\":{\"stream\":\"%d:%d\"",
+                        trace_event_names[ev->type],
+                        ev->type < STAGE_NB ? "pipeline" : "input_thread",
+                        buf->tid, ev->start, ev->duration,
+                        ev->file_index, ev->stream_index);
+                if (ev->pts != AV_NOPTS_VALUE)
+                    fprintf(f, ",\"pts_time\":%.6f", ev->pts / (double)AV_TIME_BASE);
+                fprintf(f, "}}");
+            }
+        }
+    }
+    fprintf(f, "\n]}\n");
+}
+
+void trace_uninit(const char *filename)
+{
+    TraceBuffer *buf = atomic_exchange(&trace_buffers, NULL);
+    FILE *f = filename ? fopen(filename, "w") : NULL;
+
+    if (f) {
+        write_trace(f, buf);
+        if (fclose(f))
+            av_log(NULL, AV_LOG_ERROR, "Error closing trace file %s: %s\n",
+                   filename, av_err2str(AVERROR(errno)));
+    } else if (filename) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open trace file %s: %s\n",
+               filename, av_err2str(AVERROR(errno)));
+    }
+
+    while (buf) {
+        TraceBuffer *next = buf->next;
+        TraceChunk *chunk = buf->first;
+        while (chunk) {
+            TraceChunk *next_chunk = chunk->next;
+            av_free(chunk);
+            chunk = next_chunk;
+        }
+        av_free(buf);
+        buf = next;
+    }
+    trace_enabled = 0;
+}
@@ -27,6 +27,7 @@
 #include "libavutil/ffversion.h"
 
 #include <string.h>
+#include <emscripten.h>
 
 #include "libavformat/avformat.h"
 #include "libavformat/version.h"
@@ -90,8 +91,8 @@ typedef struct InputFile {
     int       nb_streams;
 } InputFile;
 
-const char program_name[] = "ffprobe";
-const int program_birth_year = 2007;
+/* program_name and program_birth_year are defined in ffmpeg.c, ffprobe()
+ * is linked into the same core. */
 
 static int do_bitexact = 0;
 static int do_count_frames = 0;
@@ -278,7 +279,8 @@ static struct section sections[] = {
 static const OptionDef *options;
 
 /* FFprobe context */
-static const char *input_filename;
+static const char **input_filenames;
+static int nb_input_filenames;
 static const char *print_input_filename;
 static const AVInputFormat *iformat = NULL;
 static const char *output_filename = NULL;
@@ -448,6 +450,7 @@ typedef struct WriterContext WriterContext;
 
 #define WRITER_FLAG_DISPLAY_OPTIONAL_FIELDS 1
 #define WRITER_FLAG_PUT_PACKETS_AND_FRAMES_IN_SAME_CHAPTER 2
+#define WRITER_FLAG_BINARY 4 ///< the output is not text, and sent to JS as bytes
 
 typedef enum {
     WRITER_STRING_VALIDATION_FAIL,
@@ -469,6 +472,9 @@ typedef struct Writer {
     void (*print_integer)       (WriterContext *wctx, const char *, long long int);
     void (*print_rational)      (WriterContext *wctx, AVRational *q, char *sep);
     void (*print_string)        (WriterContext *wctx, const char *, const char *);
+    /* if set, called instead of printing the fields of a packet / frame */
+    void (*print_packet)        (WriterContext *wctx, const AVPacket *pkt);
+    void (*print_frame)         (WriterContext *wctx, const AVFrame *frame, const AVStream *st);
     int flags;                  ///< a combination or WRITER_FLAG_*
 } Writer;
 
@@ -478,10 +484,12 @@ struct WriterContext {
     const AVClass *class;           ///< class of the writer
     const Writer *writer;           ///< the Writer of which this is an instance
     AVIOContext *avio;              ///< the I/O context used to write
+    AVBPrint output;                ///< output sent to JS, when not written to a file
 
     void (* writer_w8)(WriterContext *wctx, int b);
     void (* writer_put_str)(WriterContext *wctx, const char *str);
     void (* writer_printf)(WriterContext *wctx, const char *fmt, ...);
+    void (* writer_write)(WriterContext *wctx, const uint8_t *buf, int size);
 
     char *name;                     ///< name of this writer instance
     void *priv;                     ///< private data for use by the filter
@@ -565,6 +573,7 @@ static int writer_close(WriterContext **wctx)
         avio_flush((*wctx)->avio);
         ret = avio_close((*wctx)->avio);
     }
+    av_bprint_finalize(&(*wctx)->output, NULL);
     av_freep(wctx);
     return ret;
 }
@@ -596,25 +605,57 @@ static inline void writer_printf_avio(WriterContext *wctx, const char *fmt, ...)
     va_end(ap);
 }
 
-static inline void writer_w8_printf(WriterContext *wctx, int b)
+static inline void writer_write_avio(WriterContext *wctx, const uint8_t *buf, int size)
 {
-    printf("%c", b);
+    avio_write(wctx->avio, buf, size);
 }
 
-static inline void writer_put_str_printf(WriterContext *wctx, const char *str)
+static inline void writer_w8_bprint(WriterContext *wctx, int b)
 {
-    printf("%s", str);
+    av_bprint_chars(&wctx->output, b, 1);
 }
 
-static inline void writer_printf_printf(WriterContext *wctx, const char *fmt, ...)
+static inline void writer_put_str_bprint(WriterContext *wctx, const char *str)
+{
+    av_bprint_append_data(&wctx->output, str, strlen(str));
+}
+
+static inline void writer_printf_bprint(WriterContext *wctx, const char *fmt, ...)
 {
     va_list ap;
 
     va_start(ap, fmt);
-    vprintf(fmt, ap);
+    av_vbprintf(&wctx->output, fmt, ap);
     va_end(ap);
 }
 
+static inline void writer_write_bprint(WriterContext *wctx, const uint8_t *buf, int size)
+{
+    av_bprint_append_data(&wctx->output, buf, size);
+}
+
+/* send_probe_output hands the output of one root section to JS, where it is
+ * appended to Module.probe, as a string or as a Uint8Array when binary.
+ */
+EM_JS(void, send_probe_output, (const char *output, int size, int binary), {
+    Module.receiveProbeOutput(binary ? HEAPU8.slice(output, output + size)
+                                     : UTF8ToString(output, size));
+});
+
+/* Without an output file, the output is kept in memory instead of printed to
+ * stdout, and sent to JS each time a root section is complete. */
+static int writer_flush(WriterContext *wctx)
+{
+    if (wctx->avio)
+        return 0;
+    if (!av_bprint_is_complete(&wctx->output))
+        return AVERROR(ENOMEM);
+    send_probe_output(wctx->output.str, wctx->output.len,
+                      !!(wctx->writer->flags & WRITER_FLAG_BINARY));
+    av_bprint_clear(&wctx->output);
+    return 0;
+}
+
 static int writer_open(WriterContext **wctx, const Writer *writer, const char *args,
                        const struct section *sections, int nb_sections, const char *output)
 {
@@ -688,9 +729,11 @@ static int writer_open(WriterContext **wctx, const Writer *writer, const char *a
     }
 
     if (!output_filename) {
-        (*wctx)->writer_w8 = writer_w8_printf;
-        (*wctx)->writer_put_str = writer_put_str_printf;
-        (*wctx)->writer_printf = writer_printf_printf;
+        av_bprint_init(&(*wctx)->output, 0, AV_BPRINT_SIZE_UNLIMITED);
+        (*wctx)->writer_w8 = writer_w8_bprint;
+        (*wctx)->writer_put_str = writer_put_str_bprint;
+        (*wctx)->writer_printf = writer_printf_bprint;
+        (*wctx)->writer_write = writer_write_bprint;
     } else {
         if ((ret = avio_open(&(*wctx)->avio, output, AVIO_FLAG_WRITE)) < 0) {
             av_log(*wctx, AV_LOG_ERROR,
@@ -700,6 +743,7 @@ static int writer_open(WriterContext **wctx, const Writer *writer, const char *a
         (*wctx)->writer_w8 = writer_w8_avio;
         (*wctx)->writer_put_str = writer_put_str_avio;
         (*wctx)->writer_printf = writer_printf_avio;
+        (*wctx)->writer_write = writer_write_avio;
     }
 
     for (i = 0; i < SECTION_MAX_NB_LEVELS; i++)
@@ -972,6 +1016,7 @@ static void writer_print_integers(WriterContext *wctx, const char *name,
 #define writer_w8(wctx_, b_) (wctx_)->writer_w8(wctx_, b_)
 #define writer_put_str(wctx_, str_) (wctx_)->writer_put_str(wctx_, str_)
 #define writer_printf(wctx_, fmt_, ...) (wctx_)->writer_printf(wctx_, fmt_, __VA_ARGS__)
+#define writer_write(wctx_, buf_, size_) (wctx_)->writer_write(wctx_, buf_, size_)
 
 #define MAX_REGISTERED_WRITERS_NB 64
 
@@ -1873,6 +1918,189 @@ static Writer xml_writer = {
     .priv_class           = &xml_class,
 };
 
+/* Binary columnar output */
+
+/*
+ * Packets and frames are dumped as fixed width little-endian columns, other
+ * sections are ignored. The layout is:
+ *
+ *   "FFPB", u32 version, u32 number of rows, u32 number of columns
+ *   column descriptors, 16 bytes each: char name[12] (NUL padded),
+ *                                      u32 size of a value (8 or 4)
+ *   columns one after another, each holding a signed value per row
+ *
+ * The header is 8 bytes aligned and 64-bit columns come first, so each
+ * column can be wrapped in a typed array without copying. Missing values are
+ * AV_NOPTS_VALUE for timestamps and -1 otherwise, flags are AV_PKT_FLAG_*
+ * and type is 0 for packets and 1 for frames.
+ */
+
+#define BIN_VERSION 1
+
+enum {
+    BIN_COLUMN_PTS,
+    BIN_COLUMN_DTS,
+    BIN_COLUMN_DURATION,
+    BIN_COLUMN_POS,
+    BIN_COLUMN_SIZE,
+    BIN_COLUMN_FLAGS,
+    BIN_COLUMN_STREAM,
+    BIN_COLUMN_TYPE,
+    BIN_NB_COLUMNS
+};
+
+static const struct {
+    const char *name;
+    int size;
+} bin_columns[BIN_NB_COLUMNS] = {
+    [BIN_COLUMN_PTS]      = { "pts",      8 },
+    [BIN_COLUMN_DTS]      = { "dts",      8 },
+    [BIN_COLUMN_DURATION] = { "duration", 8 },
+    [BIN_COLUMN_POS]      = { "pos",      8 },
+    [BIN_COLUMN_SIZE]     = { "size",     4 },
+    [BIN_COLUMN_FLAGS]    = { "flags",    4 },
+    [BIN_COLUMN_STREAM]   = { "stream",   4 },
+    [BIN_COLUMN_TYPE]     = { "type",     4 },
+};
+
+typedef struct BinContext {
+    const AVClass *class;
+    uint8_t *columns[BIN_NB_COLUMNS];
+    unsigned int nb_rows;
+    unsigned int nb_rows_allocated;
+    int error;
+} BinContext;
+
+static const AVOption bin_options[] = {
+    {NULL},
+};
+
+DEFINE_WRITER_CLASS(bin);
+
+static void bin_add_row(WriterContext *wctx, const int64_t *values)
+{
+    BinContext *bin = wctx->priv;
+    int i;
+
+    if (bin->error < 0)
+        return;
+
+    if (bin->nb_rows == bin->nb_rows_allocated) {
+        unsigned int nb_rows = FFMAX(4096, bin->nb_rows_allocated * 2);
+        for (i = 0; i < BIN_NB_COLUMNS; i++) {
+            bin->error = av_reallocp_array(&bin->columns[i], nb_rows, bin_columns[i].size);
+            if (bin->error < 0) {
+                av_log(wctx, AV_LOG_ERROR, "Cannot grow the columns to %u rows\n", nb_rows);
+                for (i = 0; i < BIN_NB_COLUMNS; i++)
+                    av_freep(&bin->columns[i]);
+                bin->nb_rows_allocated = 0;
+                return;
+            }
+        }
+        bin->nb_rows_allocated = nb_rows;
+    }
+
+    for (i = 0; i < BIN_NB_COLUMNS; i++) {
+        uint8_t *p = bin->columns[i] + bin->nb_rows * bin_columns[i].size;
+        if (bin_columns[i].size == 8)
+            AV_WL64(p, values[i]);
+        else
+            AV_WL32(p, values[i]);
+    }
+    bin->nb_rows++;
+}
+
+static void bin_print_packet(WriterContext *wctx, const AVPacket *pkt)
+{
+    int64_t values[BIN_NB_COLUMNS] = {
+        [BIN_COLUMN_PTS]      = pkt->pts,
+        [BIN_COLUMN_DTS]      = pkt->dts,
+        [BIN_COLUMN_DURATION] = pkt->duration ? pkt->duration : AV_NOPTS_VALUE,
+        [BIN_COLUMN_POS]      = pkt->pos,
+        [BIN_COLUMN_SIZE]     = pkt->size,
+        [BIN_COLUMN_FLAGS]    = pkt->flags,
+        [BIN_COLUMN_STREAM]   = pkt->stream_index,
+        [BIN_COLUMN_TYPE]     = 0,
+    };
+    bin_add_row(wctx, values);
+}
+
+static void bin_print_frame(WriterContext *wctx, const AVFrame *frame, const AVStream *st)
+{
+    int64_t values[BIN_NB_COLUMNS] = {
+        [BIN_COLUMN_PTS]      = frame->pts,
+        [BIN_COLUMN_DTS]      = frame->pkt_dts,
+        [BIN_COLUMN_DURATION] = frame->pkt_duration ? frame->pkt_duration : AV_NOPTS_VALUE,
+        [BIN_COLUMN_POS]      = frame->pkt_pos,
+        [BIN_COLUMN_SIZE]     = frame->pkt_size,
+        [BIN_COLUMN_FLAGS]    = frame->key_frame ? AV_PKT_FLAG_KEY : 0,
+        [BIN_COLUMN_STREAM]   = st->index,
+        [BIN_COLUMN_TYPE]     = 1,
+    };
+    bin_add_row(wctx, values);
+}
+
+static void bin_print_section_footer(WriterContext *wctx)
+{
+    BinContext *bin = wctx->priv;
+    uint8_t header[16];
+    int i;
+
+    if (wctx->level)
+        return;
+
+    AV_WL32(header,      MKTAG('F', 'F', 'P', 'B'));
+    AV_WL32(header + 4,  BIN_VERSION);
+    AV_WL32(header + 8,  bin->error < 0 ? 0 : bin->nb_rows);
+    AV_WL32(header + 12, BIN_NB_COLUMNS);
+    writer_write(wctx, header, sizeof(header));
+
+    for (i = 0; i < BIN_NB_COLUMNS; i++) {
+        memset(header, 0, sizeof(header));
+        av_strlcpy((char *)header, bin_columns[i].name, 12);
+        AV_WL32(header + 12, bin_columns[i].size);
+        writer_write(wctx, header, sizeof(header));
+    }
+
+    if (bin->error >= 0)
+        for (i = 0; i < BIN_NB_COLUMNS; i++)
+            writer_write(wctx, bin->columns[i], bin->nb_rows * bin_columns[i].size);
+
+    /* the next input file of a batch starts a new root */
+    bin->nb_rows = 0;
+    bin->error   = 0;
+}
+
+static void bin_print_int(WriterContext *wctx, const char *key, long long int value)
+{
+}
+
+static void bin_print_str(WriterContext *wctx, const char *key, const char *value)
+{
+}
+
+static av_cold void bin_uninit(WriterContext *wctx)
+{
+    BinContext *bin = wctx->priv;
+    int i;
+
+    for (i = 0; i < BIN_NB_COLUMNS; i++)
+        av_freep(&bin->columns[i]);
+}
+
+static const Writer bin_writer = {
+    .name                 = "bin",
+    .priv_size            = sizeof(BinContext),
+    .uninit               = bin_uninit,
+    .print_section_footer = bin_print_section_footer,
+    .print_integer        = bin_print_int,
+    .print_string         = bin_print_str,
+    .print_packet         = bin_print_packet,
+    .print_frame          = bin_print_frame,
+    .flags = WRITER_FLAG_BINARY,
+    .priv_class           = &bin_class,
+};
+
 static void writer_register_all(void)
 {
     static int initialized;
@@ -1888,6 +2116,7 @@ static void writer_register_all(void)
     writer_register(&ini_writer);
     writer_register(&json_writer);
     writer_register(&xml_writer);
+    writer_register(&bin_writer);
 }
 
 #define print_fmt(k, f, ...) do {              \
@@ -2478,6 +2707,11 @@ static void show_packet(WriterContext *w, InputFile *ifile, AVPacket *pkt, int p
     AVBPrint pbuf;
     const char *s;
 
+    if (w->writer->print_packet) {
+        w->writer->print_packet(w, pkt);
+        return;
+    }
+
     av_bprint_init(&pbuf, 1, AV_BPRINT_SIZE_UNLIMITED);
 
     writer_print_section_header(w, SECTION_ID_PACKET);
@@ -2555,6 +2789,11 @@ static void show_frame(WriterContext *w, AVFrame *frame, AVStream *stream,
     const char *s;
     int i;
 
+    if (w->writer->print_frame) {
+        w->writer->print_frame(w, frame, stream);
+        return;
+    }
+
     av_bprint_init(&pbuf, 1, AV_BPRINT_SIZE_UNLIMITED);
 
     writer_print_section_header(w, SECTION_ID_FRAME);
@@ -3696,17 +3935,14 @@ static int opt_show_entries(void *optctx, const char *opt, const char *arg)
     return ret;
 }
 
+/* Several input files are probed one after another in a batch, each with
+ * its own root section. */
 static void opt_input_file(void *optctx, const char *arg)
 {
-    if (input_filename) {
-        av_log(NULL, AV_LOG_ERROR,
-                "Argument '%s' provided as input filename, but '%s' was already specified.\n",
-                arg, input_filename);
-        exit_program(1);
-    }
     if (!strcmp(arg, "-"))
         arg = "pipe:";
-    input_filename = arg;
+    GROW_ARRAY(input_filenames, nb_input_filenames);
+    input_filenames[nb_input_filenames - 1] = arg;
 }
 
 static int opt_input_file_i(void *optctx, const char *opt, const char *arg)
@@ -3740,17 +3976,6 @@ static int opt_print_filename(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
-void show_help_default(const char *opt, const char *arg)
-{
-    av_log_set_callback(log_callback_help);
-    show_usage();
-    show_help_options(options, "Main options:", 0, 0, 0);
-    printf("\n");
-
-    show_help_children(avformat_get_class(), AV_OPT_FLAG_DECODING_PARAM);
-    show_help_children(avcodec_get_class(), AV_OPT_FLAG_DECODING_PARAM);
-}
-
 /**
  * Parse interval specification, according to the format:
  * INTERVAL ::= [START|+START_OFFSET][%[END|+END_OFFSET]]
@@ -4020,13 +4245,77 @@ static inline int check_section_show_entries(int section_id)
             do_show_##varname = 1;                                      \
     } while (0)
 
+/* ffprobe() runs many times in the same core, reset what the previous call
+ * left, including when it was aborted by exit_program(). */
+static void init_globals(void)
+{
+    int i;
+
+    do_bitexact = 0;
+    do_count_frames = 0;
+    do_count_packets = 0;
+    do_show_chapters = 0;
+    do_show_error = 0;
+    do_show_format = 0;
+    do_show_frames = 0;
+    do_show_packets = 0;
+    do_show_programs = 0;
+    do_show_streams = 0;
+    do_show_stream_disposition = 0;
+    do_show_data = 0;
+    do_show_program_version = 0;
+    do_show_library_versions = 0;
+    do_show_pixel_formats = 0;
+    do_show_pixel_format_flags = 0;
+    do_show_pixel_format_components = 0;
+    do_show_log = 0;
+
+    do_show_chapter_tags = 0;
+    do_show_format_tags = 0;
+    do_show_frame_tags = 0;
+    do_show_program_tags = 0;
+    do_show_stream_tags = 0;
+    do_show_packet_tags = 0;
+
+    show_value_unit = 0;
+    use_value_prefix = 0;
+    use_byte_value_binary_prefix = 0;
+    use_value_sexagesimal_format = 0;
+    show_private_data = 1;
+    show_optional_fields = SHOW_OPTIONAL_FIELDS_AUTO;
+    find_stream_info = 1;
+
+    av_freep(&print_format);
+    av_freep(&stream_specifier);
+    av_freep(&show_data_hash);
+    av_freep(&read_intervals);
+    read_intervals_nb = 0;
+    av_hash_freep(&hash);
+
+    av_freep(&input_filenames);
+    nb_input_filenames = 0;
+    print_input_filename = NULL;
+    output_filename = NULL;
+    iformat = NULL;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(sections); i++) {
+        av_dict_free(&(sections[i].entries_to_show));
+        sections[i].show_all_entries = 0;
+    }
+
+    /* installed by -show_log */
+    av_log_set_callback(av_log_default_callback);
+}
+
 int ffprobe(int argc, char **argv)
 {
     const Writer *w;
     WriterContext *wctx;
     char *buf;
     char *w_name = NULL, *w_args = NULL;
-    int ret, input_ret, i;
+    int ret, input_ret = 0, i;
+
+    init_globals();
 
     init_dynload();
 
@@ -4076,6 +4365,13 @@ int ffprobe(int argc, char **argv)
     SET_DO_SHOW(PROGRAM_STREAM_TAGS, stream_tags);
     SET_DO_SHOW(PACKET_TAGS, packet_tags);
 
+    if (print_input_filename && nb_input_filenames > 1) {
+        av_log(NULL, AV_LOG_ERROR,
+               "-print_filename cannot be used with several input files\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
     if (do_bitexact && (do_show_program_version || do_show_library_versions)) {
         av_log(NULL, AV_LOG_ERROR,
                "-bitexact and -show_program_version or -show_library_versions "
@@ -4128,31 +4424,38 @@ int ffprobe(int argc, char **argv)
         if (w == &xml_writer)
             wctx->string_validation_utf8_flags |= AV_UTF8_FLAG_EXCLUDE_XML_INVALID_CONTROL_CODES;
 
-        writer_print_section_header(wctx, SECTION_ID_ROOT);
-
-        if (do_show_program_version)
-            ffprobe_show_program_version(wctx);
-        if (do_show_library_versions)
-            ffprobe_show_library_versions(wctx);
-        if (do_show_pixel_formats)
-            ffprobe_show_pixel_formats(wctx);
-
-        if (!input_filename &&
-            ((do_show_format || do_show_programs || do_show_streams || do_show_chapters || do_show_packets || do_show_error) ||
-             (!do_show_program_version && !do_show_library_versions && !do_show_pixel_formats))) {
-            show_usage();
-            av_log(NULL, AV_LOG_ERROR, "You have to specify one input file.\n");
-            av_log(NULL, AV_LOG_ERROR, "Use -h to get full help or, even better, run 'man %s'.\n", program_name);
-            ret = AVERROR(EINVAL);
-        } else if (input_filename) {
-            ret = probe_file(wctx, input_filename, print_input_filename);
-            if (ret < 0 && do_show_error)
-                show_error(wctx, ret);
-        }
+        /* a batch reuses the writer, each input file gets its own root */
+        i = 0;
+        do {
+            writer_print_section_header(wctx, SECTION_ID_ROOT);
+
+            if (do_show_program_version)
+                ffprobe_show_program_version(wctx);
+            if (do_show_library_versions)
+                ffprobe_show_library_versions(wctx);
+            if (do_show_pixel_formats)
+                ffprobe_show_pixel_formats(wctx);
+
+            if (!nb_input_filenames &&
+                ((do_show_format || do_show_programs || do_show_streams || do_show_chapters || do_show_packets || do_show_error) ||
+                 (!do_show_program_version && !do_show_library_versions && !do_show_pixel_formats))) {
+                show_usage();
+                av_log(NULL, AV_LOG_ERROR, "You have to specify one input file.\n");
+                av_log(NULL, AV_LOG_ERROR, "Use -h to get full help or, even better, run 'man %s'.\n", program_name);
+                ret = AVERROR(EINVAL);
+            } else if (nb_input_filenames) {
+                ret = probe_file(wctx, input_filenames[i], print_input_filename);
+                if (ret < 0 && do_show_error)
+                    show_error(wctx, ret);
+            }
 
-        input_ret = ret;
+            input_ret = FFMIN(input_ret, ret);
+
+            writer_print_section_footer(wctx);
+            ret = writer_flush(wctx);
+            input_ret = FFMIN(input_ret, ret);
+        } while (++i < nb_input_filenames);
 
-        writer_print_section_footer(wctx);
         ret = writer_close(&wctx);
         if (ret < 0)
             av_log(NULL, AV_LOG_ERROR, "Writing output failed: %s\n", av_err2str(ret));
@@ -4162,8 +4465,13 @@ int ffprobe(int argc, char **argv)
 
 end:
     av_freep(&print_format);
+    av_freep(&stream_specifier);
+    av_freep(&show_data_hash);
     av_freep(&read_intervals);
     av_hash_freep(&hash);
+    av_freep(&input_filenames);
+    if (do_show_log)
+        av_log_set_callback(av_log_default_callback);
 
     uninit_opts();
     for (i = 0; i < FF_ARRAY_ELEMS(sections); i++)
@@ -0,0 +1,595 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Batch thumbnail extraction, run in the same core as ffmpeg:
+ *
+ *   thumbnails -i input.mp4 -ts 1,5.5,00:01:30 [-width 320] [-height 180]
+ *              [-accurate] [-sprite 5x4] [-q 3] [-seek_gap 5] thumb-%03d.jpg
+ *
+ * All timestamps are extracted with one demuxer, one decoder, one scaler
+ * and one image encoder. Timestamps are sorted and read forward, seeking
+ * only when a keyframe lies between the last decoded frame and the next
+ * timestamp (or, without an index, when it is more than -seek_gap seconds
+ * ahead), so close timestamps are served from the same GOP.
+ *
+ * By default only keyframes are decoded (as -skip_frame nokey), the
+ * thumbnail of a timestamp is the last keyframe before it. With -accurate
+ * it is the frame shown at that timestamp, and frames no other frame refers
+ * to are skipped until the timestamp is close.
+ *
+ * Each thumbnail is encoded to its own file (jpg, png, webp or bmp chosen
+ * by extension) numbered from 1 in the order of sorted timestamps, or with
+ * -sprite tiled in sprite sheets of COLSxROWS thumbnails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdutils.h"
+#include "opt_common.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#define DEFAULT_SEEK_GAP 5.0
+
+typedef struct ThumbContext {
+    AVFormatContext *ic;
+    AVStream *st;
+    AVCodecContext *dec;
+    AVCodecContext *enc;
+    struct SwsContext *sws;
+
+    AVPacket *pkt;
+    AVFrame *frame;
+    AVFrame *prev;         ///< last decoded frame, shown until the next one
+    AVFrame *sheet;        ///< scaled thumbnail, or sprite sheet being filled
+
+    int64_t *ts;           ///< sorted timestamps in stream time base
+    int nb_ts;
+    int next;              ///< index of the next timestamp to extract
+    int sought;            ///< index of the timestamp of the last seek
+
+    int64_t last_pts;      ///< timestamp of the last decoded frame
+    int64_t seek_gap;      ///< -seek_gap in stream time base
+    int64_t skip_window;   ///< -accurate: non-ref frames are decoded this close
+
+    int tile_w, tile_h;
+    int cols, rows;
+    int nb_tiles;          ///< thumbnails in the current sprite sheet
+    int nb_outputs;
+
+    int nb_decoded;
+    int nb_seeks;
+} ThumbContext;
+
+static const char *input_filename;
+static const char *output_pattern;
+static char *timestamps;
+static char *sprite;
+static int width;
+static int height;
+static int accurate;
+static float quality;
+static double seek_gap;
+
+static ThumbContext thumb;
+
+static int opt_input(void *optctx, const char *opt, const char *arg)
+{
+    if (input_filename) {
+        av_log(NULL, AV_LOG_ERROR, "Only one input file is supported\n");
+        return AVERROR(EINVAL);
+    }
+    input_filename = arg;
+    return 0;
+}
+
+static void opt_output(void *optctx, const char *arg)
+{
+    if (output_pattern) {
+        av_log(NULL, AV_LOG_ERROR, "Only one output pattern is supported\n");
+        exit_program(1);
+    }
+    output_pattern = arg;
+}
+
+static const OptionDef options[] = {
+    CMDUTILS_COMMON_OPTIONS
+    { "i",        HAS_ARG, { .func_arg = opt_input },
+        "input file", "filename" },
+    { "ts",       HAS_ARG | OPT_STRING, { &timestamps },
+        "timestamps to extract, separated by commas", "list" },
+    { "width",    HAS_ARG | OPT_INT, { &width },
+        "thumbnail width, -1 to keep the aspect ratio", "width" },
+    { "height",   HAS_ARG | OPT_INT, { &height },
+        "thumbnail height, -1 to keep the aspect ratio", "height" },
+    { "accurate", OPT_BOOL, { &accurate },
+        "extract the frame shown at each timestamp instead of the last keyframe" },
+    { "sprite",   HAS_ARG | OPT_STRING, { &sprite },
+        "tile thumbnails in sprite sheets", "COLSxROWS" },
+    { "q",        HAS_ARG | OPT_FLOAT, { &quality },
+        "encoder quality scale (VBR)", "q" },
+    { "seek_gap", HAS_ARG | OPT_DOUBLE, { &seek_gap },
+        "seek when the next timestamp is further, if the input has no index", "seconds" },
+    { NULL, },
+};
+
+static void init_globals(void)
+{
+    input_filename = NULL;
+    output_pattern = NULL;
+    av_freep(&timestamps);
+    av_freep(&sprite);
+    width    = -1;
+    height   = -1;
+    accurate = 0;
+    quality  = -1;
+    seek_gap = DEFAULT_SEEK_GAP;
+    memset(&thumb, 0, sizeof(thumb));
+}
+
+static void thumbnails_cleanup(int ret)
+{
+    ThumbContext *t = &thumb;
+
+    av_frame_free(&t->frame);
+    av_frame_free(&t->prev);
+    av_frame_free(&t->sheet);
+    av_packet_free(&t->pkt);
+    sws_freeContext(t->sws);
+    t->sws = NULL;
+    avcodec_free_context(&t->dec);
+    avcodec_free_context(&t->enc);
+    avformat_close_input(&t->ic);
+    av_freep(&t->ts);
+    av_freep(&timestamps);
+    av_freep(&sprite);
+}
+
+static int cmp_ts(const void *a, const void *b)
+{
+    return FFDIFFSIGN(*(const int64_t *)a, *(const int64_t *)b);
+}
+
+static int parse_timestamps(ThumbContext *t)
+{
+    int64_t start = t->st->start_time != AV_NOPTS_VALUE ? t->st->start_time : 0;
+    char *list, *token, *saveptr = NULL;
+    int ret = 0;
+
+    list = av_strdup(timestamps);
+    if (!list)
+        return AVERROR(ENOMEM);
+
+    for (token = av_strtok(list, ",", &saveptr); token;
+         token = av_strtok(NULL, ",", &saveptr)) {
+        int64_t us;
+
+        if ((ret = av_parse_time(&us, token, 1)) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Invalid timestamp: %s\n", token);
+            goto end;
+        }
+        if ((ret = av_reallocp_array(&t->ts, t->nb_ts + 1, sizeof(*t->ts))) < 0) {
+            t->nb_ts = 0;
+            goto end;
+        }
+        t->ts[t->nb_ts++] = start + av_rescale_q(us, AV_TIME_BASE_Q, t->st->time_base);
+    }
+    qsort(t->ts, t->nb_ts, sizeof(*t->ts), cmp_ts);
+
+end:
+    av_free(list);
+    return ret;
+}
+
+static int open_input(ThumbContext *t)
+{
+    const AVCodec *codec;
+    AVRational frame_rate;
+    int i, ret;
+
+    if ((ret = avformat_open_input(&t->ic, input_filename, NULL, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", input_filename, av_err2str(ret));
+        return ret;
+    }
+    if ((ret = avformat_find_stream_info(t->ic, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: could not find codec parameters\n",
+               input_filename);
+        return ret;
+    }
+
+    ret = av_find_best_stream(t->ic, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: no video stream to decode\n",
+               input_filename);
+        return ret;
+    }
+    t->st = t->ic->streams[ret];
+    for (i = 0; i < t->ic->nb_streams; i++)
+        if (i != t->st->index)
+            t->ic->streams[i]->discard = AVDISCARD_ALL;
+
+    t->dec = avcodec_alloc_context3(codec);
+    if (!t->dec)
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_to_context(t->dec, t->st->codecpar)) < 0)
+        return ret;
+    t->dec->pkt_timebase = t->st->time_base;
+    t->dec->skip_frame   = accurate ? AVDISCARD_DEFAULT : AVDISCARD_NONKEY;
+    if ((ret = avcodec_open2(t->dec, codec, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error opening decoder %s: %s\n",
+               codec->name, av_err2str(ret));
+        return ret;
+    }
+
+    t->seek_gap = av_rescale_q(seek_gap * AV_TIME_BASE, AV_TIME_BASE_Q,
+                               t->st->time_base);
+    /* frames up to the reorder delay before a timestamp may be shown at it */
+    frame_rate = t->st->avg_frame_rate.num ? t->st->avg_frame_rate : t->st->r_frame_rate;
+    if (frame_rate.num)
+        t->skip_window = (t->dec->has_b_frames + 2) *
+                         av_rescale_q(1, av_inv_q(frame_rate), t->st->time_base);
+    else
+        t->skip_window = t->seek_gap;
+    return 0;
+}
+
+static const struct {
+    const char *extensions;
+    const char *encoder;
+} image_encoders[] = {
+    { "jpg,jpeg", "mjpeg"   },
+    { "png",      "png"     },
+    /* by name, libwebp_anim would output a single animation */
+    { "webp",     "libwebp" },
+    { "bmp",      "bmp"     },
+};
+
+static const AVCodec *find_image_encoder(const char *filename)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(image_encoders); i++)
+        if (av_match_ext(filename, image_encoders[i].extensions))
+            return avcodec_find_encoder_by_name(image_encoders[i].encoder);
+    return NULL;
+}
+
+static int clear_sheet(ThumbContext *t)
+{
+    enum AVPixelFormat pix_fmt = t->sheet->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    int full_range = desc->flags & AV_PIX_FMT_FLAG_RGB ||
+                     pix_fmt == AV_PIX_FMT_YUVJ420P ||
+                     pix_fmt == AV_PIX_FMT_YUVJ422P ||
+                     pix_fmt == AV_PIX_FMT_YUVJ444P;
+    ptrdiff_t linesize[4];
+    int i, ret;
+
+    if ((ret = av_frame_make_writable(t->sheet)) < 0)
+        return ret;
+    for (i = 0; i < 4; i++)
+        linesize[i] = t->sheet->linesize[i];
+    return av_image_fill_black(t->sheet->data, linesize, pix_fmt,
+                               full_range ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG,
+                               t->sheet->width, t->sheet->height);
+}
+
+static int open_encoder(ThumbContext *t)
+{
+    const AVCodec *codec = find_image_encoder(output_pattern);
+    int ret;
+
+    if (!codec) {
+        av_log(NULL, AV_LOG_ERROR, "No image encoder for %s\n", output_pattern);
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+
+    /* keep the display aspect ratio when only one dimension is given */
+    t->tile_w = width  > 0 ? width  : t->dec->width;
+    t->tile_h = height > 0 ? height : t->dec->height;
+    if (width > 0 && height <= 0)
+        t->tile_h = av_rescale(t->dec->height, width, t->dec->width);
+    else if (height > 0 && width <= 0)
+        t->tile_w = av_rescale(t->dec->width, height, t->dec->height);
+    /* even sizes, so tiles start on a chroma sample */
+    t->tile_w = FFMAX(2, t->tile_w & ~1);
+    t->tile_h = FFMAX(2, t->tile_h & ~1);
+
+    t->enc = avcodec_alloc_context3(codec);
+    if (!t->enc)
+        return AVERROR(ENOMEM);
+    t->enc->width     = t->tile_w * t->cols;
+    t->enc->height    = t->tile_h * t->rows;
+    t->enc->time_base = (AVRational){ 1, 25 };
+    /* the first format is the standard one, ex. yuvj420p for mjpeg */
+    t->enc->pix_fmt   = codec->pix_fmts ? codec->pix_fmts[0] : t->dec->pix_fmt;
+    if (quality >= 0) {
+        t->enc->flags |= AV_CODEC_FLAG_QSCALE;
+        t->enc->global_quality = FF_QP2LAMBDA * quality;
+    }
+    if ((ret = avcodec_open2(t->enc, codec, NULL)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error opening encoder %s: %s\n",
+               codec->name, av_err2str(ret));
+        return ret;
+    }
+
+    t->sheet->format = t->enc->pix_fmt;
+    t->sheet->width  = t->enc->width;
+    t->sheet->height = t->enc->height;
+    if ((ret = av_frame_get_buffer(t->sheet, 0)) < 0)
+        return ret;
+    return clear_sheet(t);
+}
+
+static int write_sheet(ThumbContext *t)
+{
+    char filename[1024];
+    AVIOContext *pb;
+    int ret;
+
+    if (av_get_frame_filename2(filename, sizeof(filename), output_pattern,
+                               t->nb_outputs + 1, AV_FRAME_FILENAME_FLAGS_MULTIPLE) < 0) {
+        if (t->nb_outputs) {
+            av_log(NULL, AV_LOG_ERROR, "%s has no %%d to number several "
+                   "outputs\n", output_pattern);
+            return AVERROR(EINVAL);
+        }
+        av_strlcpy(filename, output_pattern, sizeof(filename));
+    }
+
+    if ((ret = avcodec_send_frame(t->enc, t->sheet)) < 0)
+        return ret;
+    if ((ret = avio_open(&pb, filename, AVIO_FLAG_WRITE)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: %s\n", filename, av_err2str(ret));
+        return ret;
+    }
+    /* image encoders output one whole file per frame */
+    while ((ret = avcodec_receive_packet(t->enc, t->pkt)) >= 0) {
+        avio_write(pb, t->pkt->data, t->pkt->size);
+        av_packet_unref(t->pkt);
+    }
+    if (ret == AVERROR(EAGAIN))
+        ret = 0;
+    if (ret >= 0)
+        ret = avio_closep(&pb);
+    else
+        avio_closep(&pb);
+    if (ret < 0)
+        return ret;
+
+    t->nb_outputs++;
+    t->nb_tiles = 0;
+    /* tiles left empty in the last sprite sheet stay black */
+    return t->cols * t->rows > 1 ? clear_sheet(t) : 0;
+}
+
+/* scales frame into the next tile of the sheet, writing the sheet when full */
+static int add_thumbnail(ThumbContext *t, const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(t->enc->pix_fmt);
+    uint8_t *dst[4] = { NULL };
+    int max_step[4], x, y, i, ret;
+
+    t->sws = sws_getCachedContext(t->sws, frame->width, frame->height, frame->format,
+                                  t->tile_w, t->tile_h, t->enc->pix_fmt,
+                                  SWS_BILINEAR, NULL, NULL, NULL);
+    if (!t->sws)
+        return AVERROR(EINVAL);
+
+    /* the encoder may still hold a reference to the previous sheet */
+    if ((ret = av_frame_make_writable(t->sheet)) < 0)
+        return ret;
+
+    x = t->nb_tiles % t->cols * t->tile_w;
+    y = t->nb_tiles / t->cols * t->tile_h;
+    av_image_fill_max_pixsteps(max_step, NULL, desc);
+    for (i = 0; i < 4 && t->sheet->data[i]; i++) {
+        int chroma = (i == 1 || i == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int sx = chroma ? desc->log2_chroma_w : 0;
+        int sy = chroma ? desc->log2_chroma_h : 0;
+        dst[i] = t->sheet->data[i] + (y >> sy) * t->sheet->linesize[i] +
+                 (x >> sx) * max_step[i];
+    }
+    sws_scale(t->sws, (const uint8_t * const *)frame->data, frame->linesize,
+              0, frame->height, dst, t->sheet->linesize);
+
+    if (++t->nb_tiles == t->cols * t->rows)
+        return write_sheet(t);
+    return 0;
+}
+
+/*
+ * A keyframe lies between the last decoded frame and the next timestamp, so
+ * seeking to it skips reading (or decoding) everything before it. Without
+ * an index, seek only when the timestamp is far enough.
+ */
+static int should_seek(ThumbContext *t)
+{
+    int64_t target = t->ts[t->next];
+    int idx;
+
+    if (t->sought == t->next)
+        return 0;
+    if (t->last_pts == AV_NOPTS_VALUE)
+        return target > (t->st->start_time != AV_NOPTS_VALUE ? t->st->start_time : 0);
+
+    idx = av_index_search_timestamp(t->st, target, AVSEEK_FLAG_BACKWARD);
+    if (idx >= 0)
+        return avformat_index_get_entry(t->st, idx)->timestamp > t->last_pts;
+    return target - t->last_pts > t->seek_gap;
+}
+
+static int seek(ThumbContext *t)
+{
+    int64_t target = t->ts[t->next];
+    int ret;
+
+    t->sought = t->next;
+    ret = avformat_seek_file(t->ic, t->st->index, INT64_MIN, target, target, 0);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_VERBOSE, "Seeking to %"PRId64" failed, decoding "
+               "forward: %s\n", target, av_err2str(ret));
+        return 0;
+    }
+    avcodec_flush_buffers(t->dec);
+    av_frame_unref(t->prev);
+    t->nb_seeks++;
+    return 0;
+}
+
+static int receive_frames(ThumbContext *t)
+{
+    int ret;
+
+    while ((ret = avcodec_receive_frame(t->dec, t->frame)) >= 0) {
+        int64_t pts = t->frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE)
+            pts = t->last_pts;
+        t->nb_decoded++;
+
+        /* the previous frame is shown at timestamps before this one */
+        while (t->next < t->nb_ts && pts != AV_NOPTS_VALUE && pts > t->ts[t->next]) {
+            ret = add_thumbnail(t, t->prev->buf[0] ? t->prev : t->frame);
+            if (ret < 0)
+                return ret;
+            t->next++;
+        }
+        av_frame_unref(t->prev);
+        av_frame_move_ref(t->prev, t->frame);
+        t->last_pts = pts;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int extract(ThumbContext *t)
+{
+    int ret;
+
+    t->last_pts = AV_NOPTS_VALUE;
+    t->sought   = -1;
+    while (t->next < t->nb_ts) {
+        if (should_seek(t) && (ret = seek(t)) < 0)
+            return ret;
+
+        ret = av_read_frame(t->ic, t->pkt);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            return ret;
+        if (t->pkt->stream_index != t->st->index ||
+            (!accurate && !(t->pkt->flags & AV_PKT_FLAG_KEY))) {
+            av_packet_unref(t->pkt);
+            continue;
+        }
+
+        if (accurate)
+            t->dec->skip_frame = t->pkt->pts != AV_NOPTS_VALUE &&
+                                 t->pkt->pts < t->ts[t->next] - t->skip_window ?
+                                 AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+        ret = avcodec_send_packet(t->dec, t->pkt);
+        av_packet_unref(t->pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN))
+            av_log(NULL, AV_LOG_WARNING, "Error decoding packet: %s\n",
+                   av_err2str(ret));
+        if ((ret = receive_frames(t)) < 0)
+            return ret;
+    }
+
+    if (accurate)
+        t->dec->skip_frame = AVDISCARD_DEFAULT;
+    avcodec_send_packet(t->dec, NULL);
+    if ((ret = receive_frames(t)) < 0)
+        return ret;
+
+    /* the last frame is shown until the end */
+    for (; t->next < t->nb_ts && t->prev->buf[0]; t->next++)
+        if ((ret = add_thumbnail(t, t->prev)) < 0)
+            return ret;
+    if (t->nb_tiles && (ret = write_sheet(t)) < 0)
+        return ret;
+    return 0;
+}
+
+int thumbnails(int argc, char **argv)
+{
+    ThumbContext *t = &thumb;
+    int ret;
+
+    init_globals();
+    init_dynload();
+    register_exit(thumbnails_cleanup);
+
+    parse_loglevel(argc, argv, options);
+    parse_options(NULL, argc, argv, options, opt_output);
+
+    if (!input_filename || !output_pattern || !timestamps) {
+        av_log(NULL, AV_LOG_ERROR, "usage: thumbnails -i input -ts list "
+               "[options] output\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    t->cols = t->rows = 1;
+    if (sprite && (sscanf(sprite, "%dx%d", &t->cols, &t->rows) != 2 ||
+                   t->cols <= 0 || t->rows <= 0)) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid sprite layout: %s\n", sprite);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    t->pkt   = av_packet_alloc();
+    t->frame = av_frame_alloc();
+    t->prev  = av_frame_alloc();
+    t->sheet = av_frame_alloc();
+    if (!t->pkt || !t->frame || !t->prev || !t->sheet) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    if ((ret = open_input(t)) < 0 ||
+        (ret = parse_timestamps(t)) < 0 ||
+        (ret = open_encoder(t)) < 0)
+        goto end;
+
+    if ((ret = extract(t)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error extracting thumbnails: %s\n",
+               av_err2str(ret));
+        goto end;
+    }
+    if (t->next < t->nb_ts)
+        av_log(NULL, AV_LOG_WARNING, "%d timestamps after the last frame "
+               "were not extracted\n", t->nb_ts - t->next);
+    av_log(NULL, AV_LOG_INFO, "%d thumbnails in %d files, %d frames decoded, "
+           "%d seeks\n", t->next, t->nb_outputs, t->nb_decoded, t->nb_seeks);
+
+end:
+    thumbnails_cleanup(ret);
+    uninit_opts();
+    return ret < 0;
+}
@@ -6,6 +6,7 @@ const reset = () => {
   core.reset();
   core.setLogger(() => {});
   core.setProgress(() => {});
+  core.setStats(() => {});
 };
 
 before(async () => {
@@ -98,3 +99,463 @@ describe(genName("setProgress()"), () => {
     core.FS.unlink("video.avi");
   });
 });
+
+describe(genName("setStats()"), () => {
+  beforeEach(reset);
+
+  it("should exist", () => {
+    expect("setStats" in core).to.be.true;
+  });
+
+  it("should report stage timers", () => {
+    const types = [];
+    core.setStats(({ type }) => types.push(type));
+    expect(core.exec("-i", "video.mp4", "video.avi")).to.equal(0);
+    expect(types).to.include("stages");
+
+    const { inputs, outputs } = core.stats.stages;
+    expect(inputs.length).to.not.equal(0);
+    expect(outputs.length).to.not.equal(0);
+    expect(inputs[0].demux.count).to.not.equal(0);
+    expect(inputs[0].decode.count).to.not.equal(0);
+    expect(outputs[0].encode.count).to.not.equal(0);
+    expect(outputs[0].mux.count).to.not.equal(0);
+    core.FS.unlink("video.avi");
+  });
+
+  it("should report resources", () => {
+    expect(core.exec("-i", "video.mp4", "video.avi")).to.equal(0);
+
+    const { busy_time, rtime, heap_size, sbrk_high_water, memfs_bytes } =
+      core.stats.resources;
+    expect(busy_time).to.be.above(0);
+    expect(rtime).to.be.at.least(busy_time);
+    expect(heap_size).to.be.at.least(sbrk_high_water);
+    expect(memfs_bytes).to.be.above(core.FS.readFile("video.avi").length);
+    core.FS.unlink("video.avi");
+  });
+
+  it("should report probe time", () => {
+    expect(core.exec("-i", "video.mp4", "video.avi")).to.equal(0);
+
+    const [input] = core.stats.probe.inputs;
+    expect(input.format).to.include("mp4");
+    expect(input.fast_probe).to.be.true;
+    expect(input.find_stream_info).to.be.above(0);
+    core.FS.unlink("video.avi");
+  });
+
+  it("should take stream info from the header when remuxing", () => {
+    expect(core.exec("-i", "video.mp4", "-c", "copy", "video.mkv")).to.equal(0);
+
+    const [input] = core.stats.probe.inputs;
+    expect(input.header_probe).to.be.true;
+    expect(input.find_stream_info).to.equal(0);
+    expect(core.FS.stat("video.mkv").size).to.be.above(0);
+    core.FS.unlink("video.mkv");
+  });
+
+  it("should report auto-inserted conversion filters", () => {
+    expect(
+      core.exec("-i", "video.mp4", "-vf", "format=rgb24", "video.avi")
+    ).to.equal(0);
+
+    const [{ filters }] = core.stats.filters.graphs;
+    const conversions = filters.filter(({ origin }) => origin === "auto");
+    expect(conversions.length).to.not.equal(0);
+    expect(conversions[0].outputs[0].frames).to.not.equal(0);
+    core.FS.unlink("video.avi");
+  });
+
+  it("should report the muxing queue spilled to a file", () => {
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-f", "lavfi", "-i", "sine=duration=1",
+        "-map", "0:v", "-map", "1:a", "-c:a", "copy", "-mux_queue_size", "0",
+        "video.avi"
+      )
+    ).to.equal(0);
+
+    const [output] = core.stats.muxing_queue.outputs;
+    expect(output.spilled_packets).to.equal(output.packets);
+    expect(output.queued).to.equal(0);
+    expect(output.peak_bytes).to.equal(0);
+    expect(core.FS.readdir("/tmp").some((f) => f.endsWith(".spill"))).to.be
+      .false;
+    core.FS.unlink("video.avi");
+  });
+});
+
+describe(genName("-trace_file"), () => {
+  beforeEach(reset);
+
+  it("should write a Chrome trace", () => {
+    expect(
+      core.exec("-trace_file", "trace.json", "-i", "video.mp4", "video.avi")
+    ).to.equal(0);
+
+    const { traceEvents } = JSON.parse(
+      core.FS.readFile("trace.json", { encoding: "utf8" })
+    );
+    const names = traceEvents.map(({ name }) => name);
+    ["thread_name", "demux", "decode", "encode", "mux"].forEach((name) =>
+      expect(names).to.include(name)
+    );
+    // the packet or frame of each stage is identified by its timestamp
+    ["demux", "decode", "encode", "mux"].forEach((stage) =>
+      expect(
+        traceEvents.some(
+          ({ name, args }) =>
+            name === stage && typeof args.pts_time === "number"
+        )
+      ).to.equal(true)
+    );
+    core.FS.unlink("trace.json");
+    core.FS.unlink("video.avi");
+  });
+});
+
+describe(genName("ffprobe()"), () => {
+  beforeEach(reset);
+
+  it("should exist", () => {
+    expect("ffprobe" in core).to.be.true;
+  });
+
+  it("should probe files in a batch", () => {
+    expect(
+      core.ffprobe("-show_format", "-show_streams", "video.mp4", "video.mp4")
+    ).to.equal(0);
+
+    expect(core.probe.length).to.equal(2);
+    core.probe.forEach((output) => {
+      const { format, streams } = JSON.parse(output);
+      expect(format.filename).to.equal("video.mp4");
+      expect(streams.length).to.not.equal(0);
+    });
+  });
+
+  it("should dump packets as binary columns", () => {
+    expect(
+      core.ffprobe("-print_format", "bin", "-show_packets", "video.mp4")
+    ).to.equal(0);
+
+    const [data] = core.probe;
+    const view = new DataView(data.buffer);
+    expect(String.fromCharCode(...data.subarray(0, 4))).to.equal("FFPB");
+    const rows = view.getUint32(8, true);
+    expect(rows).to.not.equal(0);
+    expect(view.getUint32(12, true)).to.equal(8);
+    // pts is the first column, right after the column descriptors
+    const pts = new BigInt64Array(data.buffer, 16 + 8 * 16, rows);
+    expect(pts.some((v) => v >= 0n)).to.be.true;
+  });
+});
+
+describe(genName("-seek_index"), () => {
+  beforeEach(reset);
+
+  it("should save and reuse keyframes of an input without index", () => {
+    expect(
+      core.exec("-i", "video.mp4", "-c", "copy", "-f", "mpegts", "video.ts")
+    ).to.equal(0);
+    expect(
+      core.exec("-seek_index", "video.idx", "-i", "video.ts", "-f", "null", "-")
+    ).to.equal(0);
+    const idx = core.FS.readFile("video.idx");
+    expect(String.fromCharCode(...idx.subarray(0, 4))).to.equal("FFSI");
+
+    expect(
+      core.exec(
+        "-seek_index", "video.idx", "-ss", "0.5", "-i", "video.ts",
+        "-frames:v", "1", "frame.png"
+      )
+    ).to.equal(0);
+    expect(core.FS.readFile("frame.png").length).to.not.equal(0);
+    ["video.ts", "video.idx", "frame.png"].forEach((f) => core.FS.unlink(f));
+  });
+});
+
+describe(genName("thumbnails()"), () => {
+  beforeEach(reset);
+
+  it("should extract thumbnails in one run", () => {
+    expect(
+      core.thumbnails(
+        "-i", "video.mp4", "-ts", "0.8,0,0.5", "-width", "64", "thumb-%d.jpg"
+      )
+    ).to.equal(0);
+    [1, 2, 3].forEach((i) => {
+      const jpeg = core.FS.readFile(`thumb-${i}.jpg`);
+      expect([jpeg[0], jpeg[1]]).to.deep.equal([0xff, 0xd8]);
+      core.FS.unlink(`thumb-${i}.jpg`);
+    });
+  });
+
+  it("should tile accurate thumbnails in a sprite sheet", () => {
+    expect(
+      core.thumbnails(
+        "-i", "video.mp4", "-ts", "0,0.3,0.6", "-accurate",
+        "-width", "64", "-sprite", "2x2", "sprite.png"
+      )
+    ).to.equal(0);
+    const png = core.FS.readFile("sprite.png");
+    // IHDR width and height, big-endian
+    const view = new DataView(png.buffer, png.byteOffset);
+    expect(view.getUint32(16)).to.equal(128);
+    core.FS.unlink("sprite.png");
+  });
+});
+
+describe(genName("-js_frames"), () => {
+  beforeEach(reset);
+
+  it("should send filtered frames to the frame handler", () => {
+    const frames = [];
+    core.setFrameHandler(({ type, format, width, height, planes, linesizes, time }) => {
+      frames.push({ type, format, width, height, time, size: planes[0].length, linesize: linesizes[0] });
+    });
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-an", "-vf", "scale=32:16", "-pix_fmt", "rgb24",
+        "-frames:v", "3", "-js_frames", "-"
+      )
+    ).to.equal(0);
+    core.setFrameHandler(() => {});
+
+    expect(frames.length).to.equal(3);
+    frames.forEach(({ type, format, width, height, size, linesize }) => {
+      expect([type, format, width, height]).to.deep.equal(["video", "rgb24", 32, 16]);
+      expect(linesize).to.be.at.least(32 * 3);
+      expect(size).to.equal(linesize * 16);
+    });
+    expect(frames[2].time).to.be.above(frames[0].time);
+  });
+
+  it("should end the whole output with -frames", () => {
+    const frames = { video: [], audio: [] };
+    core.setFrameHandler(({ type, time }) => frames[type].push(time));
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-f", "lavfi", "-i", "sine=duration=10",
+        "-map", "0:v", "-map", "1:a", "-vf", "scale=32:16",
+        "-frames:v", "3", "-js_frames", "-"
+      )
+    ).to.equal(0);
+    core.setFrameHandler(() => {});
+
+    expect(frames.video.length).to.equal(3);
+    // audio stops with the video instead of running for 10 seconds
+    expect(frames.audio[frames.audio.length - 1]).to.be.below(1);
+  });
+});
+
+describe(genName("js: input"), () => {
+  beforeEach(reset);
+
+  it("should read raw frames from the input reader", () => {
+    const FRAME_SIZE = 16 * 16 * 4;
+    let remaining = 10 * FRAME_SIZE;
+    core.setInputReader((name, dest) => {
+      if (name !== "frames") return -1;
+      const size = Math.min(remaining, dest.length, 1000);
+      dest.fill(0x80, 0, size);
+      remaining -= size;
+      return size;
+    });
+    expect(
+      core.exec(
+        "-f", "rawvideo", "-pix_fmt", "rgba", "-s", "16x16", "-r", "10",
+        "-i", "js:frames", "frames.avi"
+      )
+    ).to.equal(0);
+    core.setInputReader(() => -1);
+
+    expect(remaining).to.equal(0);
+    expect(core.FS.readFile("frames.avi").length).to.not.equal(0);
+    core.FS.unlink("frames.avi");
+  });
+});
+
+describe(genName("decodeAudio()"), () => {
+  beforeEach(reset);
+
+  it("should decode resampled PCM in chunks", () => {
+    expect(
+      core.exec("-f", "lavfi", "-i", "sine=sample_rate=44100:duration=1", "sine.wav")
+    ).to.equal(0);
+    core.reset();
+
+    const chunks = [];
+    core.setAudioHandler(({ data, samples, channels, sampleRate, time, duration }) => {
+      chunks.push({ planes: data.length, size: data[0].length, samples, channels, sampleRate, time, duration });
+    });
+    expect(
+      core.decodeAudio(
+        "-i", "sine.wav", "-ss", "0.25", "-ar", "8000", "-ac", "2",
+        "-planar", "-chunk_size", "1000"
+      )
+    ).to.equal(0);
+    core.setAudioHandler(() => {});
+    core.FS.unlink("sine.wav");
+
+    const total = chunks.reduce((sum, { samples }) => sum + samples, 0);
+    expect(total).to.be.within(5990, 6010);
+    expect(chunks[0].time).to.be.closeTo(0.25, 0.001);
+    expect(chunks[0].duration).to.be.closeTo(0.75, 0.01);
+    chunks.forEach(({ planes, size, samples, channels, sampleRate }) => {
+      expect([planes, channels, sampleRate]).to.deep.equal([2, 2, 8000]);
+      expect(size).to.equal(samples);
+      expect(samples).to.be.at.most(1000);
+    });
+  });
+});
+
+describe(genName("decodeAudio() -peaks"), () => {
+  beforeEach(reset);
+
+  it("should reduce samples to peaks natively", () => {
+    expect(
+      core.exec("-f", "lavfi", "-i", "sine=sample_rate=8000:duration=2", "sine.wav")
+    ).to.equal(0);
+    core.reset();
+
+    let chunks = 0;
+    core.setAudioHandler(() => chunks++);
+    expect(
+      core.decodeAudio("-i", "sine.wav", "-ac", "1", "-peaks", "100")
+    ).to.equal(0);
+    core.setAudioHandler(() => {});
+    core.FS.unlink("sine.wav");
+
+    const { min, max, rms, buckets, channels, bucketDuration } = core.peaks;
+    expect(chunks).to.equal(0);
+    expect([buckets, channels]).to.deep.equal([100, 1]);
+    expect(bucketDuration).to.be.closeTo(0.02, 0.001);
+    // sine of amplitude 1/8
+    expect(max[50]).to.be.closeTo(0.125, 0.01);
+    expect(min[50]).to.be.closeTo(-0.125, 0.01);
+    expect(rms[50]).to.be.closeTo(0.125 / Math.SQRT2, 0.01);
+  });
+});
+
+describe(genName("-reserve_moov"), () => {
+  beforeEach(reset);
+
+  it("should write moov before mdat without a second pass", () => {
+    const logs = [];
+    core.setLogger(({ message }) => logs.push(message));
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-c", "copy", "-movflags", "+faststart",
+        "-reserve_moov", "1", "-v", "verbose", "faststart.mp4"
+      )
+    ).to.equal(0);
+    expect(logs.join("")).to.include("Reserving");
+    expect(logs.join("")).to.not.include("second pass");
+
+    const data = new TextDecoder("latin1").decode(
+      core.FS.readFile("faststart.mp4")
+    );
+    expect(data.indexOf("moov")).to.be.below(data.indexOf("mdat"));
+    expect(core.exec("-i", "faststart.mp4", "-f", "null", "-")).to.equal(0);
+
+    // the unused reservation is a free atom of a few tens of KiB at most
+    expect(core.exec("-i", "video.mp4", "-c", "copy", "plain.mp4")).to.equal(0);
+    expect(
+      core.FS.stat("faststart.mp4").size - core.FS.stat("plain.mp4").size
+    ).to.be.below(32 * 1024);
+    core.FS.unlink("plain.mp4");
+    core.FS.unlink("faststart.mp4");
+  });
+});
+
+describe(genName("-smart_cut"), () => {
+  beforeEach(reset);
+
+  it("should encode again only the frames around the cut", () => {
+    const logs = [];
+    core.setLogger(({ message }) => logs.push(message));
+    expect(
+      core.exec(
+        "-ss", "0.2", "-i", "video.mp4", "-t", "0.5", "-c", "copy",
+        "-tag:v", "avc3", "-smart_cut", "1", "-v", "verbose", "cut.mp4"
+      )
+    ).to.equal(0);
+    expect(logs.join("")).to.match(/Smart cut of stream #0:0: [1-9]\d* frames/);
+
+    expect(core.exec("-i", "cut.mp4", "-f", "null", "-")).to.equal(0);
+    core.FS.unlink("cut.mp4");
+  });
+
+  it("should copy from a keyframe when avc1 cannot describe the encoded frames", () => {
+    const logs = [];
+    core.setLogger(({ message }) => logs.push(message));
+    expect(
+      core.exec(
+        "-ss", "0.2", "-i", "video.mp4", "-t", "0.5", "-c", "copy",
+        "-smart_cut", "1", "-v", "verbose", "cut.mp4"
+      )
+    ).to.equal(0);
+    // frames are only encoded again with the parameter sets of the avcC
+    const log = logs.join("");
+    if (log.includes("parameter sets of the libx264 encoder differ"))
+      expect(log).to.match(/Smart cut of stream #0:0: 0 frames encoded again at the start, 0 at the end/);
+
+    expect(core.exec("-i", "cut.mp4", "-f", "null", "-")).to.equal(0);
+    core.FS.unlink("cut.mp4");
+  });
+});
+
+describe(genName("-mux_thread_queue_size"), () => {
+  beforeEach(reset);
+
+  it("should mux each output in order", () => {
+    expect(
+      core.exec(
+        "-i", "video.mp4",
+        "-mux_thread_queue_size", "4", "-c", "copy", "copy.mp4",
+        "-mux_thread_queue_size", "4", "-c:v", "mpeg4", "-frames:v", "10", "video.avi"
+      )
+    ).to.equal(0);
+
+    ["copy.mp4", "video.avi"].forEach((name) => {
+      expect(core.exec("-i", name, "-f", "null", "-")).to.equal(0);
+      core.FS.unlink(name);
+    });
+  });
+
+  it("should stop at -fs from the size written by the mux thread", () => {
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-f", "null", "-",
+        "-mux_thread_queue_size", "4", "-c", "copy", "-fs", "4096", "copy.mkv"
+      )
+    ).to.equal(0);
+    expect(core.FS.stat("copy.mkv").size).to.be.below(
+      core.FS.stat("video.mp4").size
+    );
+    core.FS.unlink("copy.mkv");
+  });
+});
+
+describe(genName("-ladder"), () => {
+  beforeEach(reset);
+
+  it("should encode an HLS ladder from one decode", () => {
+    expect(
+      core.exec(
+        "-i", "video.mp4", "-ladder", "64x36:100k,128x72:200k", "-ladder_gop", "0.5",
+        "-c:v", "libx264", "-preset", "ultrafast", "-f", "hls", "ladder_%v.m3u8"
+      )
+    ).to.equal(0);
+
+    const master = core.FS.readFile("master.m3u8", { encoding: "utf8" });
+    expect(master.match(/#EXT-X-STREAM-INF/g).length).to.equal(2);
+    // rungs are sorted, the largest is first
+    expect(master).to.match(/RESOLUTION=128x72[\s\S]*RESOLUTION=64x36/);
+    core.FS.readdir(".")
+      .filter((name) => name.startsWith("ladder_") || name === "master.m3u8")
+      .forEach((name) => core.FS.unlink(name));
+  });
+});